@@ -0,0 +1,34 @@
+#include <fstream>
+#include <sstream>
+#include <string>
+#include "Bench.h"
+#include "Driver.h"
+#include "kernels.h"
+
+// Start-up latency (until the first result is available) of kernels linked
+// into this binary ahead of time vs. the same kernels loaded by the JIT.
+K_BENCHMARK(aot) {
+  std::ifstream file(KERNELS_PATH);
+  std::stringstream source;
+  source << file.rdbuf();
+
+  volatile double sink;
+  double aot = bench::seconds([&] {
+    sink = fib(20) + poly(1, 2, 3) + integrate(0, 1, 1000);
+  });
+
+  double jit = bench::seconds([&] {
+    std::ostream quiet(nullptr);
+    std::stringstream code(source.str());
+    Lexer lexer(code);
+    Driver driver(quiet, OptLevel::O2);
+    driver.mainLoop(lexer);
+    auto jitFib = reinterpret_cast<double (*)(double)>(driver.lookupFunction("fib"));
+    auto jitPoly = reinterpret_cast<double (*)(double, double, double)>(driver.lookupFunction("poly"));
+    auto jitIntegrate = reinterpret_cast<double (*)(double, double, double)>(driver.lookupFunction("integrate"));
+    sink = jitFib(20) + jitPoly(1, 2, 3) + jitIntegrate(0, 1, 1000);
+  });
+
+  bench::report("aot", "aot linked", 1.0e3 * aot, "ms");
+  bench::report("aot", "jit loaded", 1.0e3 * jit, "ms");
+}
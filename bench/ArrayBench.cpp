@@ -0,0 +1,71 @@
+#include <cstddef>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "ArrayRuntime.h"
+#include "Bench.h"
+#include "Driver.h"
+#include "ParallelRuntime.h"
+
+namespace {
+std::vector<double> xs, ys;
+}
+
+// Element access through externs, as without arrays. The JIT resolves them
+// in the process, see ENABLE_EXPORTS.
+extern "C" double arrayx(double i) { return xs[static_cast<std::size_t>(i)]; }
+extern "C" double arrayy(double i) { return ys[static_cast<std::size_t>(i)]; }
+extern "C" double arraysety(double i, double v) { return ys[static_cast<std::size_t>(i)] = v; }
+
+// Dot product and saxpy with extern calls per element vs. arrays with
+// bounds-checked indexing vs. a parallel loop over len, where the checks are
+// elided. The parallel loop runs on a single thread to compare code only.
+K_BENCHMARK(array) {
+  constexpr std::size_t n = 1 << 22;
+  xs.resize(n);
+  ys.resize(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    xs[i] = 0.001 * i;
+    ys[i] = 1.0 - 0.002 * i;
+  }
+  Array x{xs.data(), static_cast<std::int64_t>(n)};
+  Array y{ys.data(), static_cast<std::int64_t>(n)};
+
+  std::ostream quiet(nullptr);
+  // "for i = 0, i < n - 1" runs for i = 0, ..., n - 1
+  std::stringstream code(
+    "extern arrayx(i); extern arrayy(i); extern arraysety(i v);\n"
+    "def dotextern(n) var s = 0 in (for i = 0, i < n - 1 in s = s + arrayx(i)*arrayy(i)) + s;\n"
+    "def dotarray(x:array y:array) var s = 0 in (for i = 0, i < len(x) - 1 in s = s + x[i]*y[i]) + s;\n"
+    "def dotparfor(x:array y:array) parfor i = 0, fmin(len(x), len(y)) in x[i]*y[i];\n"
+    "def saxpyextern(a n) for i = 0, i < n - 1 in arraysety(i, a*arrayx(i) + arrayy(i));\n"
+    "def saxpyarray(a x:array y:array) for i = 0, i < len(y) - 1 in y[i] = a*x[i] + y[i];\n"
+    "def saxpyparfor(a x:array y:array) parfor i = 0, fmin(len(x), len(y)) in y[i] = a*x[i] + y[i];\n");
+  Lexer lexer(code);
+  Driver driver(quiet, OptLevel::O2);
+  driver.setLazyCompilation(false);
+  driver.mainLoop(lexer);
+  unsigned threads = ParallelRuntime::get().getNumThreads();
+  driver.setParallelThreads(1);
+
+  using ExternFn = double (*)(double);
+  using ArrayFn = double (*)(Array*, Array*);
+  using ExternSaxpyFn = double (*)(double, double);
+  using ArraySaxpyFn = double (*)(double, Array*, Array*);
+  auto dotExtern = reinterpret_cast<ExternFn>(driver.lookupFunction("dotextern"));
+  auto dotArray = reinterpret_cast<ArrayFn>(driver.lookupFunction("dotarray"));
+  auto dotParfor = reinterpret_cast<ArrayFn>(driver.lookupFunction("dotparfor"));
+  auto saxpyExtern = reinterpret_cast<ExternSaxpyFn>(driver.lookupFunction("saxpyextern"));
+  auto saxpyArray = reinterpret_cast<ArraySaxpyFn>(driver.lookupFunction("saxpyarray"));
+  auto saxpyParfor = reinterpret_cast<ArraySaxpyFn>(driver.lookupFunction("saxpyparfor"));
+
+  auto throughput = [&](double seconds) { return n / seconds / 1.0e6; };
+  bench::report("array", "dot extern", throughput(bench::seconds([&] { dotExtern(n); })), "Melem/s");
+  bench::report("array", "dot array", throughput(bench::seconds([&] { dotArray(&x, &y); })), "Melem/s");
+  bench::report("array", "dot parfor", throughput(bench::seconds([&] { dotParfor(&x, &y); })), "Melem/s");
+  bench::report("array", "saxpy extern", throughput(bench::seconds([&] { saxpyExtern(0.5, n); })), "Melem/s");
+  bench::report("array", "saxpy array", throughput(bench::seconds([&] { saxpyArray(0.5, &x, &y); })), "Melem/s");
+  bench::report("array", "saxpy parfor", throughput(bench::seconds([&] { saxpyParfor(0.5, &x, &y); })), "Melem/s");
+
+  driver.setParallelThreads(threads);
+}
@@ -0,0 +1,74 @@
+#include <fstream>
+#include <string>
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "AstReader.h"
+#include "Bench.h"
+#include "Parser.h"
+#include "visitor/AstWriter.h"
+
+// Load time of a large program from source vs. from its binary AST in a
+// memory-mapped file, resetting the arena after every item like the driver
+// does. Both load into a fresh symbol table.
+K_BENCHMARK(binaryast) {
+  constexpr int repetitions = 5;
+  std::string script = bench::generateScript(16 << 20);
+
+  std::string ast;
+  {
+    SymbolTable symbols;
+    Arena arena;
+    Lexer lexer{std::string_view(script)};
+    Parser parser(lexer, arena, symbols);
+    AstWriter writer(ast);
+    parser.getNextToken();
+    while (parser.curTok == tok_def) {
+      writer.writeDefinition(*parser.parseDefinition());
+      parser.getNextToken();
+      arena.reset();
+    }
+  }
+
+  llvm::SmallString<128> path;
+  if (llvm::sys::fs::createTemporaryFile("kaleidoscope", "kast", path)) {
+    return;
+  }
+  std::ofstream(path.c_str(), std::ios::binary).write(ast.data(), ast.size());
+  auto file = llvm::MemoryBuffer::getFile(path);
+  if (!file) {
+    return;
+  }
+  std::string_view mapped((*file)->getBufferStart(), (*file)->getBufferSize());
+
+  double sourceTime = bench::median(repetitions, [&] {
+    SymbolTable symbols;
+    Arena arena;
+    Lexer lexer{std::string_view(script)};
+    Parser parser(lexer, arena, symbols);
+    parser.getNextToken();
+    while (parser.curTok == tok_def && parser.parseDefinition()) {
+      parser.getNextToken();
+      arena.reset();
+    }
+  });
+  long numRead = 0;
+  double binaryTime = bench::median(repetitions, [&] {
+    SymbolTable symbols;
+    Arena arena;
+    AstReader reader(mapped, arena, symbols);
+    numRead = 0;
+    reader.readHeader();
+    while (reader.getItemKind() == AstItem::Definition && reader.readDefinition()) {
+      ++numRead;
+      arena.reset();
+    }
+  });
+  llvm::sys::fs::remove(path);
+
+  bench::report("binaryast", "source size", script.size() / 1.0e6, "MB");
+  bench::report("binaryast", "binary size", ast.size() / 1.0e6, "MB");
+  bench::report("binaryast", "definitions", numRead, "");
+  bench::report("binaryast", "load from source", 1.0e3 * sourceTime, "ms");
+  bench::report("binaryast", "load from binary", 1.0e3 * binaryTime, "ms");
+}
@@ -0,0 +1,45 @@
+#include <cstddef>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "Bench.h"
+#include "Driver.h"
+
+// Elements per second of evaluating a function over columnar arrays with a
+// loop of scalar calls vs. the generated batch kernel.
+K_BENCHMARK(batch) {
+  constexpr std::size_t n = 1 << 22;
+  std::vector<double> x(n), y(n), z(n), out(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    x[i] = 0.001 * i;
+    y[i] = 1.0 - 0.002 * i;
+    z[i] = 0.5 + 0.0001 * i;
+  }
+  std::vector<double const*> columns{x.data(), y.data(), z.data()};
+
+  std::ostream quiet(nullptr);
+  std::stringstream code(
+    "def poly(x y z) x*y + z*x - y*y*z + 1;\n"
+    "def branchy(x y z) if x < y then x*z else y*z + x;\n");
+  Lexer lexer(code);
+  Driver driver(quiet, OptLevel::O2);
+  driver.mainLoop(lexer);
+
+  for (std::string name : {"poly", "branchy"}) {
+    auto fp = reinterpret_cast<double (*)(double, double, double)>(driver.lookupFunction(name));
+    double scalar = bench::seconds([&] {
+      for (std::size_t i = 0; i < n; ++i) {
+        out[i] = fp(x[i], y[i], z[i]);
+      }
+    });
+
+    // Compile outside of the measurement
+    driver.getBatchFunction(name);
+    double batch = bench::seconds([&] {
+      driver.evaluateBatch(name, columns, out.data(), n);
+    });
+
+    bench::report("batch", name + " scalar", n / scalar / 1.0e6, "Melem/s");
+    bench::report("batch", name + " batch", n / batch / 1.0e6, "Melem/s");
+  }
+}
@@ -0,0 +1,85 @@
+#include "Bench.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <cstring>
+#include <vector>
+
+#include "llvm/Support/TargetSelect.h"
+
+static long numAllocations = 0;
+
+void* operator new(std::size_t size) {
+  ++numAllocations;
+  if (void* p = std::malloc(size)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+  std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+  std::free(p);
+}
+
+namespace bench {
+
+long allocations() {
+  return numAllocations;
+}
+
+std::string generateScript(std::size_t minSize) {
+  std::string script;
+  for (int i = 0; script.size() < minSize; ++i) {
+    script += "# generated definition " + std::to_string(i) + "\n";
+    script += "def kernel" + std::to_string(i) + "(alpha beta gamma)\n";
+    script += "  if alpha < 1.5 then\n";
+    script += "    var tmp = beta*" + std::to_string(i) + ".25 in tmp + gamma*gamma\n";
+    script += "  else\n";
+    script += "    for idx = 0, idx < alpha, 1.0 in kernel" + std::to_string(i) + "(alpha-1, beta, gamma);\n";
+  }
+  return script;
+}
+
+static std::vector<std::pair<char const*, BenchmarkFn>>& registry() {
+  static std::vector<std::pair<char const*, BenchmarkFn>> benchmarks;
+  return benchmarks;
+}
+
+Registration::Registration(char const* name, BenchmarkFn fn) {
+  registry().emplace_back(name, fn);
+}
+
+void report(std::string const& benchmark, std::string const& metric, double value, char const* unit) {
+  std::printf("%-24s %-32s %14.3f %s\n", benchmark.c_str(), metric.c_str(), value, unit);
+}
+
+}
+
+/// Runs all benchmarks, or only those whose name contains one of the arguments.
+/// Benchmarks run in the order of their names, whatever the link order, such
+/// that the output of two builds can be diffed.
+int main(int argc, char** argv) {
+  llvm::InitializeNativeTarget();
+  llvm::InitializeNativeTargetAsmPrinter();
+  llvm::InitializeNativeTargetAsmParser();
+
+  auto& benchmarks = bench::registry();
+  std::sort(benchmarks.begin(), benchmarks.end(), [](auto const& a, auto const& b) {
+    return std::strcmp(a.first, b.first) < 0;
+  });
+  for (auto& benchmark : benchmarks) {
+    bool selected = argc == 1;
+    for (int i = 1; i < argc; ++i) {
+      selected = selected || std::strstr(benchmark.first, argv[i]);
+    }
+    if (selected) {
+      benchmark.second();
+    }
+  }
+  return 0;
+}
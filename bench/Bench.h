@@ -0,0 +1,55 @@
+#ifndef K_BENCH_BENCH_H_
+#define K_BENCH_BENCH_H_
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace bench {
+
+using BenchmarkFn = void (*)();
+
+struct Registration {
+  Registration(char const* name, BenchmarkFn fn);
+};
+
+/// Prints one result line: <benchmark> <metric> <value> <unit>
+void report(std::string const& benchmark, std::string const& metric, double value, char const* unit);
+
+/// Number of heap allocations (operator new) since program start.
+long allocations();
+
+/// Generates a synthetic program of at least minSize bytes.
+std::string generateScript(std::size_t minSize);
+
+template<typename F>
+double seconds(F&& f) {
+  auto start = std::chrono::steady_clock::now();
+  std::forward<F>(f)();
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double>(end - start).count();
+}
+
+/// Median time of several runs of f, which varies less between runs of the
+/// benchmark than a single measurement and hence diffs better.
+template<typename F>
+double median(int repetitions, F&& f) {
+  std::vector<double> times;
+  for (int i = 0; i < repetitions; ++i) {
+    times.push_back(seconds(f));
+  }
+  std::nth_element(times.begin(), times.begin() + times.size() / 2, times.end());
+  return times[times.size() / 2];
+}
+
+}
+
+#define K_BENCHMARK(name)                                             \
+  static void name();                                                 \
+  static ::bench::Registration name##Registration(#name, name);       \
+  static void name()
+
+#endif
@@ -0,0 +1,48 @@
+#include <cstddef>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "Bench.h"
+#include "Driver.h"
+
+// Run time of a polynomial and a trigonometric kernel with IEEE semantics
+// (strict) and with fast-math flags, as a scalar loop and as a batch kernel.
+K_BENCHMARK(fastmath) {
+  char const* definitions =
+    "def horner(x) ((((0.1*x + 0.2)*x - 0.3)*x + 0.4)*x - 0.5)*x + 0.6;\n"
+    "def wave(x) sin(x)*cos(0.5*x) + sqrt(fabs(x))*0.25;\n"
+    "def polysum(n) var s = 0, h = 0.0000001 in\n"
+    "  (for i = 0, i < n in s = s + horner(i*h)) + s;\n"
+    "def wavesum(n) var s = 0, h = 0.0000001 in\n"
+    "  (for i = 0, i < n in s = s + wave(i*h)) + s;\n";
+
+  constexpr std::size_t n = 1 << 22;
+  std::vector<double> x(n), out(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    x[i] = 1.0e-6 * i;
+  }
+  std::vector<double const*> columns{x.data()};
+
+  for (bool fastMath : {false, true}) {
+    std::ostream quiet(nullptr);
+    Driver driver(quiet, OptLevel::O2);
+    driver.setFastMath(fastMath);
+    driver.setInterprocedural(true);
+    std::stringstream definitionStream(definitions);
+    Lexer definitionLexer(definitionStream);
+    driver.mainLoop(definitionLexer);
+
+    std::string mode = fastMath ? "fast" : "strict";
+    for (std::string kernel : {"polysum", "wavesum"}) {
+      std::stringstream runStream(kernel + "(20000000);\n");
+      Lexer runLexer(runStream);
+      double time = bench::seconds([&] { driver.mainLoop(runLexer); });
+      bench::report("fastmath", mode + " " + kernel + " loop", 1.0e3 * time, "ms");
+    }
+    for (std::string kernel : {"horner", "wave"}) {
+      driver.getBatchFunction(kernel);
+      double time = bench::seconds([&] { driver.evaluateBatch(kernel, columns, out.data(), n); });
+      bench::report("fastmath", mode + " " + kernel + " batch", n / time / 1.0e6, "Melem/s");
+    }
+  }
+}
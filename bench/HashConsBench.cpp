@@ -0,0 +1,76 @@
+#include <string>
+#include <utility>
+#include <vector>
+#include "Bench.h"
+#include "KaleidoscopeJIT.h"
+#include "Parser.h"
+#include "visitor/CodeGen.h"
+#include "visitor/HashConser.h"
+#include "visitor/NodeCounter.h"
+#include "visitor/Simplifier.h"
+
+// Nodes and arena bytes of the simplified definitions as trees vs. hash-consed
+// into a DAG, and IR instructions emitted at O0 without vs. with sharing, for
+// the generated script and for definitions that repeat subexpressions.
+K_BENCHMARK(hashcons) {
+  std::string repeated;
+  for (int i = 0; i < 2000; ++i) {
+    std::string c = std::to_string(i) + ".5";
+    repeated += "def poly" + std::to_string(i) + "(x y) var d = x*x + y*y in\n"
+                "  (x*x + y*y)*(x*x + y*y) + sqrt(x*x + y*y)*d + fma(x, y, x*x + y*y) + d*(x*y + " + c + ")\n"
+                "  + (if x*y < " + c + " then x*y*" + c + " else (x*y + " + c + ")*(x*y + " + c + "));\n";
+  }
+  std::vector<std::pair<char const*, std::string>> workloads = {
+    {"generated", bench::generateScript(1 << 20)},
+    {"repeated", std::move(repeated)},
+  };
+
+  llvm::orc::KaleidoscopeJIT jit;
+  for (auto& workload : workloads) {
+    std::string name = workload.first;
+    SymbolTable symbols;
+    Arena trees;
+    Lexer lexer{std::string_view(workload.second)};
+    Parser parser(lexer, trees, symbols);
+    std::vector<FunctionAST*> definitions;
+    unsigned long nodes = 0;
+    parser.getNextToken();
+    while (parser.curTok == tok_def) {
+      auto ast = parser.parseDefinition();
+      ast::visit(Simplifier(trees), *ast);
+      NodeCounter counter;
+      ast::visit(counter, *ast);
+      nodes += counter.getCount();
+      definitions.push_back(ast);
+      parser.getNextToken();
+    }
+
+    Arena dag;
+    HashConser conser(dag);
+    std::vector<FunctionAST*> consed;
+    double time = bench::seconds([&] {
+      for (FunctionAST* ast : definitions) {
+        consed.push_back(ast::visit(conser, *ast));
+      }
+    });
+
+    unsigned long emitted[2] = {0, 0};
+    for (bool sharing : {false, true}) {
+      CodeGen cg(jit.getTargetMachine().createDataLayout(), OptLevel::O0, &jit.getTargetMachine());
+      cg.setSharing(sharing);
+      for (FunctionAST* ast : sharing ? consed : definitions) {
+        ast::visit(cg, *ast);
+        emitted[sharing] += cg.getModule().getInstructionCount();
+        cg.takeModule();
+      }
+    }
+
+    bench::report("hashcons", name + " tree nodes", nodes, "");
+    bench::report("hashcons", name + " dag nodes", conser.getNumCopied(), "");
+    bench::report("hashcons", name + " parsed bytes", trees.getBytesAllocated() / 1.0e3, "kB");
+    bench::report("hashcons", name + " dag bytes", dag.getBytesAllocated() / 1.0e3, "kB");
+    bench::report("hashcons", name + " hash-consing", 1.0e3 * time, "ms");
+    bench::report("hashcons", name + " tree instructions", emitted[0], "");
+    bench::report("hashcons", name + " shared instructions", emitted[1], "");
+  }
+}
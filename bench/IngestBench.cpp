@@ -0,0 +1,125 @@
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <iostream>
+#include <istream>
+#include <mutex>
+#include <streambuf>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Bench.h"
+#include "Driver.h"
+#include "ItemReader.h"
+
+namespace {
+
+// In-memory pipe: reads block until the writer appends or closes
+class Pipe : public std::streambuf {
+private:
+  std::mutex mutex;
+  std::condition_variable written;
+  std::string pending;
+  std::string current;
+  bool closed = false;
+
+protected:
+  int_type underflow() override {
+    std::unique_lock<std::mutex> lock(mutex);
+    written.wait(lock, [this] { return !pending.empty() || closed; });
+    if (pending.empty()) {
+      return traits_type::eof();
+    }
+    current.swap(pending);
+    pending.clear();
+    setg(&current[0], &current[0], &current[0] + current.size());
+    return traits_type::to_int_type(current[0]);
+  }
+
+public:
+  void write(std::string const& text) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      pending += text;
+    }
+    written.notify_one();
+  }
+  void close() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      closed = true;
+    }
+    written.notify_one();
+  }
+};
+
+}
+
+// Latency from writing a definition into one of several streams until the
+// function is compiled and callable, with items arriving every millisecond.
+// Every 20th item is malformed and must not hold up the ones behind it.
+K_BENCHMARK(ingest) {
+  using Clock = ItemReader::Clock;
+  constexpr std::size_t numStreams = 2;
+  constexpr std::size_t numItems = 250;
+
+  std::vector<Pipe> pipes(numStreams);
+  std::vector<std::unique_ptr<std::istream>> streams;
+  std::vector<std::vector<Clock::time_point>> writeTimes(numStreams, std::vector<Clock::time_point>(numItems));
+  ItemReader reader;
+  for (auto& pipe : pipes) {
+    streams.push_back(std::make_unique<std::istream>(&pipe));
+    reader.addStream(*streams.back());
+  }
+
+  auto name = [](std::size_t stream, std::size_t i) {
+    return "s" + std::to_string(stream) + "f" + std::to_string(i);
+  };
+  std::vector<std::thread> writers;
+  for (std::size_t stream = 0; stream < numStreams; ++stream) {
+    writers.emplace_back([&, stream] {
+      for (std::size_t i = 0; i < numItems; ++i) {
+        std::string item = "def " + name(stream, i) + "(x) x*x + " + std::to_string(i) + ";\n";
+        if (i % 20 == 19) {
+          item = "def " + name(stream, i) + "(x) x * (;\n";
+        }
+        writeTimes[stream][i] = Clock::now();
+        pipes[stream].write(item);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+      pipes[stream].close();
+    });
+  }
+
+  std::ostream quiet(nullptr);
+  Driver driver(quiet, OptLevel::O1);
+  driver.setLazyCompilation(false);
+  std::vector<double> latencies;
+  std::vector<std::size_t> received(numStreams);
+  ItemReader::Item item;
+  // Parse errors of the malformed items go to std::cerr
+  std::streambuf* errors = std::cerr.rdbuf(nullptr);
+  auto start = Clock::now();
+  while (reader.next(item)) {
+    std::size_t i = received[item.stream]++;
+    Lexer lexer(item.text);
+    driver.mainLoop(lexer);
+    // Looking the function up compiles it
+    if (i % 20 != 19 && driver.lookupFunction(name(item.stream, i))) {
+      latencies.push_back(std::chrono::duration<double>(Clock::now() - writeTimes[item.stream][i]).count());
+    }
+  }
+  double time = std::chrono::duration<double>(Clock::now() - start).count();
+  std::cerr.rdbuf(errors);
+  for (auto& writer : writers) {
+    writer.join();
+  }
+
+  std::sort(latencies.begin(), latencies.end());
+  bench::report("ingest", "callable items", latencies.size(), "items");
+  bench::report("ingest", "median latency", 1.0e6 * latencies[latencies.size() / 2], "us");
+  bench::report("ingest", "p99 latency", 1.0e6 * latencies[latencies.size() * 99 / 100], "us");
+  bench::report("ingest", "max latency", 1.0e6 * latencies.back(), "us");
+  bench::report("ingest", "throughput", numStreams * numItems / time, "items/s");
+}
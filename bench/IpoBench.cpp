@@ -0,0 +1,35 @@
+#include <sstream>
+#include <string>
+#include "Bench.h"
+#include "Driver.h"
+
+// Compile and run time of a loop calling small helper definitions, with each
+// definition optimized in isolation and with callees imported for inlining.
+K_BENCHMARK(ipo) {
+  char const* definitions =
+    "def sq(x) x*x;\n"
+    "def lerp(a b t) a + (b - a)*t;\n"
+    "def clamp(x lo hi) if x < lo then lo else if hi < x then hi else x;\n"
+    "def shade(x) clamp(lerp(sq(x), 1, 0.25), 0, 0.75);\n"
+    "def kernel(n) var s = 0, h = 0.0000001 in\n"
+    "  (for i = 0, i < n in s = s + shade(i*h)) + s;\n";
+  char const* run = "kernel(20000000);\n";
+
+  char const* names[] = {"O0", "O1", "O2", "O3"};
+  for (int level : {1, 2}) {
+    for (bool interprocedural : {false, true}) {
+      std::ostream quiet(nullptr);
+      Driver driver(quiet, static_cast<OptLevel>(level));
+      driver.setInterprocedural(interprocedural);
+
+      std::stringstream definitionStream(definitions), runStream(run);
+      Lexer definitionLexer(definitionStream), runLexer(runStream);
+      double compileTime = bench::seconds([&] { driver.mainLoop(definitionLexer); });
+      double runTime = bench::seconds([&] { driver.mainLoop(runLexer); });
+
+      std::string mode = std::string(names[level]) + (interprocedural ? " ipo" : "");
+      bench::report("ipo", mode + " compile", 1.0e3 * compileTime, "ms");
+      bench::report("ipo", mode + " run", 1.0e3 * runTime, "ms");
+    }
+  }
+}
@@ -0,0 +1,66 @@
+#include <sstream>
+#include <string>
+#include <vector>
+#include "Bench.h"
+#include "KaleidoscopeJIT.h"
+#include "Parser.h"
+#include "visitor/CodeGen.h"
+
+// Start-up time (codegen + adding to the JIT) of many definitions, the time
+// to look all of them up and the time of calling each once, with lazy and
+// with eager compilation.
+K_BENCHMARK(jit) {
+  constexpr int numDefinitions = 10000;
+  std::string script;
+  for (int i = 0; i < numDefinitions; ++i) {
+    script += "def f" + std::to_string(i) + "(x y) if x < y then x*y + " + std::to_string(i) +
+              " else (x - y) * " + std::to_string(i) + ";\n";
+  }
+
+  for (bool lazy : {true, false}) {
+    llvm::orc::KaleidoscopeJIT jit;
+    CodeGen cg(jit.getTargetMachine().createDataLayout(), OptLevel::O1, &jit.getTargetMachine());
+    SymbolTable symbols;
+    Arena arena;
+    std::stringstream code(script);
+    Lexer lexer(code);
+    Parser parser(lexer, arena, symbols);
+    std::vector<std::string> names;
+
+    double startup = bench::seconds([&] {
+      parser.getNextToken();
+      while (parser.curTok == tok_def) {
+        auto ast = parser.parseDefinition();
+        names.emplace_back(ast->getPrototype().getName().str());
+        ast::visit(cg, *ast);
+        if (lazy) {
+          jit.addLazyModule(cg.takeModule());
+        } else {
+          jit.addModule(cg.takeModule());
+        }
+        arena.reset();
+      }
+    });
+
+    std::vector<double (*)(double, double)> fps;
+    double lookup = bench::seconds([&] {
+      for (auto const& name : names) {
+        auto symbol = cantFail(jit.lookup(name));
+        fps.push_back(reinterpret_cast<double (*)(double, double)>(symbol.getAddress()));
+      }
+    });
+
+    double sum = 0.0;
+    double firstCall = bench::seconds([&] {
+      for (auto fp : fps) {
+        sum += fp(1.0, 2.0);
+      }
+    });
+
+    std::string mode = lazy ? "lazy" : "eager";
+    bench::report("jit", mode + " startup", 1.0e3 * startup, "ms");
+    bench::report("jit", mode + " lookup", 1.0e3 * lookup, "ms");
+    bench::report("jit", mode + " first call", 1.0e3 * firstCall, "ms");
+    bench::report("jit", mode + " total", 1.0e3 * (startup + lookup + firstCall), "ms");
+  }
+}
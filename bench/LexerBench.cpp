@@ -0,0 +1,34 @@
+#include <sstream>
+#include <string>
+#include "Bench.h"
+#include "Lexer.h"
+
+template<typename MakeLexer>
+static void lexThroughput(std::string const& metric, std::string const& script, MakeLexer&& makeLexer) {
+  constexpr int repetitions = 5;
+  long tokens = 0;
+  double time = bench::seconds([&] {
+    for (int r = 0; r < repetitions; ++r) {
+      auto lexer = makeLexer();
+      while (lexer.getToken() != tok_eof) {
+        ++tokens;
+      }
+    }
+  });
+  bench::report("lexer", metric, repetitions * script.size() / (time * 1.0e6), "MB/s");
+  bench::report("lexer", metric + " tokens", tokens / (time * 1.0e6), "Mtokens/s");
+}
+
+K_BENCHMARK(lexer) {
+  std::string script = bench::generateScript(16 << 20);
+
+  std::stringstream stream;
+  lexThroughput("istream", script, [&] {
+    stream.clear();
+    stream.str(script);
+    return Lexer(stream);
+  });
+  lexThroughput("buffer", script, [&] {
+    return Lexer(std::string_view(script));
+  });
+}
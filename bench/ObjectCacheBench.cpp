@@ -0,0 +1,47 @@
+#include <sstream>
+#include <string>
+#include "Bench.h"
+#include "Driver.h"
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+
+// Start-up time of a large script without object cache (lazy and eager),
+// with an empty cache (cold) and with a populated cache (warm).
+K_BENCHMARK(objectcache) {
+  constexpr int numDefinitions = 2000;
+  std::string script;
+  for (int i = 0; i < numDefinitions; ++i) {
+    std::string f = "f" + std::to_string(i);
+    script += "def " + f + "(x y) var s = 0 in\n"
+              "  (for i = 0, i < y in s = s + (if x < i then x*i - " + std::to_string(i) + " else x + i))\n"
+              "  + s;\n";
+  }
+  script += "f0(1, 10) + f1999(2, 20);\n";
+
+  llvm::SmallString<128> directory;
+  if (llvm::sys::fs::createUniqueDirectory("kaleidoscope-cache", directory)) {
+    return;
+  }
+
+  auto run = [&](bool lazy, bool cached) {
+    std::ostream quiet(nullptr);
+    std::stringstream code(script);
+    Lexer lexer(code);
+    return bench::seconds([&] {
+      Driver driver(quiet, OptLevel::O2);
+      driver.setLazyCompilation(lazy);
+      if (cached) {
+        driver.setCacheDirectory(directory.str().str());
+      }
+      driver.mainLoop(lexer);
+    });
+  };
+
+  bench::report("objectcache", "no cache lazy", 1.0e3 * run(true, false), "ms");
+  bench::report("objectcache", "no cache eager", 1.0e3 * run(false, false), "ms");
+  bench::report("objectcache", "cold", 1.0e3 * run(true, true), "ms");
+  bench::report("objectcache", "warm", 1.0e3 * run(true, true), "ms");
+
+  llvm::sys::fs::remove_directories(directory);
+}
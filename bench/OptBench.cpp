@@ -0,0 +1,28 @@
+#include <sstream>
+#include <string>
+#include "Bench.h"
+#include "Driver.h"
+
+// Compile and run time of a numeric workload at every optimization level.
+K_BENCHMARK(optlevels) {
+  char const* definitions =
+    "def poly(x) x*x*x - 2*x*x + 0.5*x + 1;\n"
+    "def smooth(x y) if x < y then poly(x) else poly(y) + 1;\n"
+    "def sweep(n) var s = 0, h = 0.000001 in\n"
+    "  (for i = 0, i < n in s = s + smooth(i*h, 0.5) * h) + s;\n";
+  char const* run = "sweep(10000000);\n";
+
+  char const* names[] = {"O0", "O1", "O2", "O3"};
+  for (int level = 0; level < 4; ++level) {
+    std::ostream quiet(nullptr);
+    Driver driver(quiet, static_cast<OptLevel>(level));
+
+    std::stringstream definitionStream(definitions), runStream(run);
+    Lexer definitionLexer(definitionStream), runLexer(runStream);
+    double compileTime = bench::seconds([&] { driver.mainLoop(definitionLexer); });
+    double runTime = bench::seconds([&] { driver.mainLoop(runLexer); });
+
+    bench::report("optlevels", std::string(names[level]) + " compile", 1.0e3 * compileTime, "ms");
+    bench::report("optlevels", std::string(names[level]) + " run", 1.0e3 * runTime, "ms");
+  }
+}
@@ -0,0 +1,49 @@
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Bench.h"
+#include "Driver.h"
+#include "ParallelRuntime.h"
+
+// Strong scaling of a parallel reduction over a numeric sweep, from a single
+// thread up to the number of hardware threads.
+K_BENCHMARK(parallel) {
+  constexpr double n = 200000;
+  std::ostream quiet(nullptr);
+  std::stringstream code(
+    "def work(x) var s = 0 in (for j = 0, j < 100 in s = s + sin(x + j)*exp(0 - x*0.001)) + s;\n"
+    "def sweep(n) parfor i = 0, n in work(i*0.001);\n");
+  Lexer lexer(code);
+  Driver driver(quiet, OptLevel::O2);
+  driver.mainLoop(lexer);
+  auto sweep = reinterpret_cast<double (*)(double)>(driver.lookupFunction("sweep"));
+
+  unsigned hardware = std::max(1u, std::thread::hardware_concurrency());
+  std::vector<unsigned> threadCounts;
+  for (unsigned threads = 1; threads < hardware; threads *= 2) {
+    threadCounts.push_back(threads);
+  }
+  threadCounts.push_back(hardware);
+
+  double baseline = 0.0;
+  double expected = 0.0;
+  for (unsigned threads : threadCounts) {
+    ParallelRuntime::get().setNumThreads(threads);
+    double result = 0.0;
+    // Warm-up, which also starts the workers
+    sweep(n);
+    double time = bench::seconds([&] { result = sweep(n); });
+    if (threads == 1) {
+      baseline = time;
+      expected = result;
+    }
+    std::string t = std::to_string(threads) + " threads";
+    bench::report("parallel", t, 1.0e3 * time, "ms");
+    bench::report("parallel", t + " speedup", baseline / time, "x");
+    // The reduction order is fixed, hence results must match bit for bit
+    bench::report("parallel", t + " deterministic", result == expected ? 1.0 : 0.0, "bool");
+  }
+  ParallelRuntime::get().setNumThreads(hardware);
+}
@@ -0,0 +1,40 @@
+#include <sstream>
+#include <string>
+#include <thread>
+#include "Bench.h"
+#include "Driver.h"
+
+// Wall-clock time to compile independent definitions on the REPL thread
+// (0 threads) and on background workers.
+K_BENCHMARK(parallelcompile) {
+  constexpr int numDefinitions = 400;
+  std::string script;
+  for (int i = 0; i < numDefinitions; ++i) {
+    std::string f = "f" + std::to_string(i);
+    script += "def " + f + "(x y n) var s = 0 in\n"
+              "  (for i = 0, i < n in s = s + (if x < i then x*y*i - " + std::to_string(i) + " else y*y + x*i))\n"
+              "  + s;\n";
+  }
+
+  unsigned hardwareThreads = std::thread::hardware_concurrency();
+  double sequential = 0.0;
+  for (unsigned threads : {0u, 1u, hardwareThreads}) {
+    std::ostream quiet(nullptr);
+    std::stringstream code(script);
+    Lexer lexer(code);
+    Driver driver(quiet, OptLevel::O2);
+    driver.setCompileThreads(threads);
+
+    double time = bench::seconds([&] {
+      driver.mainLoop(lexer);
+      driver.waitForCompilation();
+    });
+    if (threads == 0) {
+      sequential = time;
+    }
+
+    std::string t = std::to_string(threads) + " threads";
+    bench::report("parallelcompile", t + " time", 1.0e3 * time, "ms");
+    bench::report("parallelcompile", t + " speedup", sequential / time, "x");
+  }
+}
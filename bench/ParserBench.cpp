@@ -0,0 +1,32 @@
+#include <string>
+#include "Bench.h"
+#include "Parser.h"
+
+// Parses a large synthetic program, resetting the arena after every item like
+// the driver does.
+K_BENCHMARK(parser) {
+  std::string script = bench::generateScript(16 << 20);
+
+  SymbolTable symbols;
+  Arena arena;
+  Lexer lexer{std::string_view(script)};
+  Parser parser(lexer, arena, symbols);
+
+  long numDefinitions = 0;
+  long allocations = bench::allocations();
+  double time = bench::seconds([&] {
+    parser.getNextToken();
+    while (parser.curTok != tok_eof) {
+      if (parser.curTok == tok_def && parser.parseDefinition()) {
+        ++numDefinitions;
+      } else {
+        parser.getNextToken();
+      }
+      arena.reset();
+    }
+  });
+  allocations = bench::allocations() - allocations;
+
+  bench::report("parser", "throughput", script.size() / (time * 1.0e6), "MB/s");
+  bench::report("parser", "allocations per definition", static_cast<double>(allocations) / numDefinitions, "");
+}
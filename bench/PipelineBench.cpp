@@ -0,0 +1,46 @@
+#include <string>
+#include <vector>
+#include "llvm/ExecutionEngine/Orc/CompileUtils.h"
+#include "Bench.h"
+#include "CompileStats.h"
+#include "KaleidoscopeJIT.h"
+#include "Parser.h"
+#include "visitor/CodeGen.h"
+
+// Time of the pass pipeline and of machine code generation per opt level,
+// one module per definition as in the driver. Instruction counts and object
+// sizes do not depend on the machine's load and show what a change to
+// the pipeline does to the code.
+K_BENCHMARK(pipeline) {
+  std::string script = bench::generateScript(256 << 10);
+  SymbolTable symbols;
+  Arena arena;
+  Lexer lexer{std::string_view(script)};
+  Parser parser(lexer, arena, symbols);
+  std::vector<FunctionAST*> functions;
+  parser.getNextToken();
+  while (parser.curTok == tok_def) {
+    functions.push_back(parser.parseDefinition());
+    parser.getNextToken();
+  }
+
+  llvm::orc::KaleidoscopeJIT jit;
+  llvm::orc::SimpleCompiler compile(jit.getTargetMachine());
+  char const* names[] = {"O0", "O1", "O2", "O3"};
+  for (int level = 0; level < 4; ++level) {
+    CodeGen cg(jit.getTargetMachine().createDataLayout(), static_cast<OptLevel>(level), &jit.getTargetMachine());
+    CompileRecord record;
+    for (FunctionAST* f : functions) {
+      ast::visit(cg, *f);
+      auto module = cg.takeModule(&record);
+      PhaseTimer timer(&record, Phase::Emit);
+      record.objectBytes += compile(*module.getModuleUnlocked())->getBufferSize();
+    }
+
+    std::string prefix = std::string(names[level]) + " ";
+    bench::report("pipeline", prefix + "optimize", 1.0e3 * record[Phase::Optimize], "ms");
+    bench::report("pipeline", prefix + "emit", 1.0e3 * record[Phase::Emit], "ms");
+    bench::report("pipeline", prefix + "instructions", record.instructionsAfter, "");
+    bench::report("pipeline", prefix + "object size", record.objectBytes, "bytes");
+  }
+}
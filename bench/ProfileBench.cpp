@@ -0,0 +1,38 @@
+#include <sstream>
+#include <string>
+#include "Bench.h"
+#include "Driver.h"
+
+// Cost of profiling counters and gain of recompiling with the profile, on a
+// loop calling a function whose first branch is rarely taken. The profiled
+// and recompiled drivers are warmed up such that every function is called
+// more often than the threshold.
+K_BENCHMARK(profile) {
+  char const* definitions =
+    "def step(x) if x < 1 then x * x * x - 2 * x else if x < 1000000 then x + 1 else x - 1;\n"
+    "def kernel(n) var s = 0 in (for i = 0, i < n in s = s + step(i)) + s;\n";
+  char const* warmup = "kernel(1000);\nkernel(1000);\nkernel(1000);\n";
+  double const n = 1.0e8;
+
+  struct Mode {
+    char const* name;
+    bool profiling;
+    unsigned long threshold;
+  };
+  Mode modes[] = {{"plain", false, 0}, {"instrumented", true, 0}, {"recompiled", false, 2}};
+  for (Mode const& mode : modes) {
+    std::ostream quiet(nullptr);
+    Driver driver(quiet, OptLevel::O2);
+    driver.setLazyCompilation(false);
+    driver.setProfiling(mode.profiling);
+    driver.setProfileGuidedThreshold(mode.threshold);
+    std::stringstream definitionStream(std::string(definitions) + warmup);
+    Lexer definitionLexer(definitionStream);
+    driver.mainLoop(definitionLexer);
+
+    std::stringstream runStream("kernel(" + std::to_string(static_cast<long>(n)) + ");\n");
+    Lexer runLexer(runStream);
+    double time = bench::seconds([&] { driver.mainLoop(runLexer); });
+    bench::report("profile", std::string(mode.name) + " throughput", n / time / 1.0e6, "Mcalls/s");
+  }
+}
@@ -0,0 +1,97 @@
+#include <sstream>
+#include <string>
+#include <vector>
+#include "ArrayRuntime.h"
+#include "Bench.h"
+#include "Driver.h"
+
+namespace {
+
+struct Program {
+  char const* name;
+  char const* definitions;
+  char const* entry;
+  std::vector<double> args;
+  // Units of work done by a run, given its result
+  double (*work)(double result);
+  char const* unit;
+};
+
+double call(void* fn, std::vector<double> const& args) {
+  switch (args.size()) {
+    case 1: return reinterpret_cast<double (*)(double)>(fn)(args[0]);
+    case 2: return reinterpret_cast<double (*)(double, double)>(fn)(args[0], args[1]);
+    case 3: return reinterpret_cast<double (*)(double, double, double)>(fn)(args[0], args[1], args[2]);
+  }
+  return 0;
+}
+
+}
+
+// End-to-end programs: compile latency of their definitions (eagerly, such
+// that machine code is generated right away), run time and throughput of
+// their entry point, and the result, which must not change between commits
+// unless the semantics do.
+K_BENCHMARK(programs) {
+  Program programs[] = {
+    {"fib",
+     "def fib(n) if n < 2 then n else fib(n - 1) + fib(n - 2);\n",
+     "fib", {32},
+     // fib(n) makes 2*fib(n + 1) - 1 calls
+     [](double) { return 2 * 3524578.0 - 1; }, "Mcalls/s"},
+    {"mandelbrot",
+     "def escape(cr ci) var zr = 0, zi = 0, n = 0 in\n"
+     "  (for i = 0, (i < 254) * (zr*zr + zi*zi < 4) in\n"
+     "     var t = zr*zr - zi*zi + cr in (zi = 2*zr*zi + ci) + (zr = t) + (n = n + 1)) + n;\n"
+     "def mandel(size h) var s = 0 in\n"
+     "  (for y = 0, y < size - 1 in\n"
+     "     for x = 0, x < size - 1 in s = s + escape(x*h - 2, y*h - 1.5)) + s;\n",
+     // The result is the total number of iterations
+     "mandel", {400, 0.0075},
+     [](double iterations) { return iterations; }, "Miterations/s"},
+    {"integration",
+     "def f(x) 4*pow(1 + x*x, 0 - 1);\n"
+     "def integrate(n h) var s = 0 in (for i = 0, i < n - 1 in s = s + f((i + 0.5)*h)*h) + s;\n",
+     "integrate", {1.0e7, 1.0e-7},
+     [](double) { return 1.0e7; }, "Mevaluations/s"},
+    {"nbody",
+     "def nbody(n steps dt) var x = array(n), y = array(n), vx = array(n), vy = array(n) in\n"
+     "  (for i = 0, i < n - 1 in (x[i] = cos(i)) + (y[i] = sin(i)))\n"
+     "  + (for s = 0, s < steps - 1 in\n"
+     "       (for i = 0, i < n - 1 in\n"
+     "          for j = 0, j < n - 1 in\n"
+     "            var dx = x[j] - x[i], dy = y[j] - y[i] in\n"
+     "            var k = dt*pow(dx*dx + dy*dy + 0.01, 0 - 1.5) in\n"
+     "            (vx[i] = vx[i] + dx*k) + (vy[i] = vy[i] + dy*k))\n"
+     "       + (for i = 0, i < n - 1 in (x[i] = x[i] + dt*vx[i]) + (y[i] = y[i] + dt*vy[i])))\n"
+     "  + (var e = 0 in (for i = 0, i < n - 1 in e = e + vx[i]*vx[i] + vy[i]*vy[i]) + e);\n",
+     // The result is twice the kinetic energy
+     "nbody", {400, 20, 0.001},
+     [](double) { return 400.0 * 400.0 * 20.0; }, "Minteractions/s"},
+  };
+
+  constexpr int repetitions = 3;
+  for (OptLevel level : {OptLevel::O0, OptLevel::O2}) {
+    std::string prefix = level == OptLevel::O0 ? "O0 " : "O2 ";
+    for (Program const& program : programs) {
+      std::ostream quiet(nullptr);
+      Driver driver(quiet, level);
+      driver.setLazyCompilation(false);
+      std::stringstream code(program.definitions);
+      Lexer lexer(code);
+      double compileTime = bench::seconds([&] { driver.mainLoop(lexer); });
+
+      void* fn = driver.lookupFunction(program.entry);
+      double result = 0;
+      double runTime = bench::median(repetitions, [&] { result = call(fn, program.args); });
+      // Arrays of direct calls are only released here
+      ArrayHeap::get().release();
+
+      std::string name = prefix + program.name;
+      bench::report("programs", name + " compile", 1.0e3 * compileTime, "ms");
+      bench::report("programs", name + " run", 1.0e3 * runTime, "ms");
+      bench::report("programs", name + " throughput", program.work(result) / runTime / 1.0e6, program.unit);
+      bench::report("programs", name + " result", result, "");
+    }
+  }
+}
@@ -0,0 +1,43 @@
+#include <sstream>
+#include <string>
+#include "Bench.h"
+#include "Driver.h"
+
+// Throughput of deep recursion: a self tail call, which becomes a loop, a
+// mutual tail call through if branches, which reuses the frame, and a call
+// that is not in tail position. The tail recursive definitions run to a
+// depth that would overflow any stack with one frame per call.
+K_BENCHMARK(recursion) {
+  char const* definitions =
+    "def sumto(n acc) if n < 1 then acc else sumto(n - 1, acc + n);\n"
+    "extern odd(n);\n"
+    "def even(n) if n < 1 then 1 else odd(n - 1);\n"
+    "def odd(n) if n < 1 then 0 else even(n - 1);\n"
+    "def count(n) if n < 1 then 0 else 1 + count(n - 1);\n";
+
+  struct Run {
+    char const* name;
+    char const* call;
+    double depth;
+  };
+  Run runs[] = {{"self", "sumto(100000000, 0);\n", 1.0e8},
+                {"mutual", "even(100000000);\n", 1.0e8},
+                {"nontail", "count(100000);\n", 1.0e5}};
+  for (OptLevel level : {OptLevel::O0, OptLevel::O2}) {
+    std::ostream quiet(nullptr);
+    Driver driver(quiet, level);
+    driver.setLazyCompilation(false);
+    std::stringstream definitionStream(definitions);
+    Lexer definitionLexer(definitionStream);
+    driver.mainLoop(definitionLexer);
+
+    std::string prefix = level == OptLevel::O0 ? "O0 " : "O2 ";
+    for (Run const& run : runs) {
+      std::stringstream runStream(run.call);
+      Lexer runLexer(runStream);
+      double time = bench::seconds([&] { driver.mainLoop(runLexer); });
+      bench::report("recursion", prefix + run.name + " depth", run.depth, "calls");
+      bench::report("recursion", prefix + run.name + " throughput", run.depth / time / 1.0e6, "Mcalls/s");
+    }
+  }
+}
@@ -0,0 +1,52 @@
+#include <sstream>
+#include "Bench.h"
+#include "Driver.h"
+
+// Every top-level expression is compiled into a module, added to the JIT and
+// executed, so this measures the per-expression compile+execute cost.
+K_BENCHMARK(repl) {
+  constexpr int numExpressions = 2000;
+
+  std::stringstream code;
+  code << "def poly(x) x*x*x + 3*x*x + 2*x + 1;\n";
+  for (int i = 0; i < numExpressions; ++i) {
+    code << "poly(" << i << ") + poly(" << i + 1 << ");\n";
+  }
+
+  std::ostream quiet(nullptr);
+  Lexer lexer(code);
+  Driver driver(quiet);
+
+  double time = bench::seconds([&] { driver.mainLoop(lexer); });
+
+  bench::report("repl", "expressions/s", numExpressions / time, "1/s");
+  bench::report("repl", "time per expression", 1.0e6 * time / numExpressions, "us");
+}
+
+// Every definition is compiled into a module of its own, hence the cost per
+// definition should not grow with the number of definitions before it.
+K_BENCHMARK(definitions) {
+  constexpr int numDefinitions = 4000;
+  constexpr int window = 500;
+
+  std::stringstream first, middle, last;
+  first << "def f0(x) x+1;\n";
+  for (int i = 1; i < numDefinitions; ++i) {
+    auto& code = i < window ? first : (i < numDefinitions - window ? middle : last);
+    code << "def f" << i << "(x) f" << i - 1 << "(x)*0.5 + x;\n";
+  }
+
+  std::ostream quiet(nullptr);
+  Driver driver(quiet);
+  auto run = [&](std::stringstream& code) {
+    Lexer lexer(code);
+    driver.mainLoop(lexer);
+  };
+
+  double firstTime = bench::seconds([&] { run(first); });
+  run(middle);
+  double lastTime = bench::seconds([&] { run(last); });
+
+  bench::report("definitions", "time per definition (first)", 1.0e6 * firstTime / window, "us");
+  bench::report("definitions", "time per definition (last)", 1.0e6 * lastTime / window, "us");
+}
@@ -0,0 +1,86 @@
+#include <sstream>
+#include <string>
+#include "Bench.h"
+#include "Driver.h"
+#include "KaleidoscopeJIT.h"
+#include "Parser.h"
+#include "visitor/CodeGen.h"
+#include "visitor/Simplifier.h"
+
+// IR instruction counts (as emitted and after the O1 pipeline) and time of
+// simplification, code generation and optimization for generated code full
+// of constant subtrees, without and with the AST simplifier.
+K_BENCHMARK(simplifier) {
+  constexpr int numDefinitions = 2000;
+  std::string script;
+  for (int i = 0; i < numDefinitions; ++i) {
+    std::string c = std::to_string(i % 7);
+    script += "def g" + std::to_string(i) + "(x y) var k = " + c + ", s = 2*0.5, w in\n"
+              "  if k < 3 then x*(k*4 + 1) + y*s*1 - 0 + w else x*y*(2*3*4 - k) + (1 < 2)*y;\n";
+  }
+
+  llvm::orc::KaleidoscopeJIT jit;
+  for (bool simplify : {false, true}) {
+    CodeGen cg(jit.getTargetMachine().createDataLayout(), OptLevel::O1, &jit.getTargetMachine());
+    SymbolTable symbols;
+    Arena arena;
+    std::stringstream code(script);
+    Lexer lexer(code);
+    Parser parser(lexer, arena, symbols);
+
+    unsigned long emitted = 0, optimized = 0;
+    double time = bench::seconds([&] {
+      parser.getNextToken();
+      while (parser.curTok == tok_def) {
+        auto ast = parser.parseDefinition();
+        if (simplify) {
+          ast::visit(Simplifier(arena), *ast);
+        }
+        ast::visit(cg, *ast);
+        emitted += cg.getModule().getInstructionCount();
+        optimized += cg.takeModule().getModuleUnlocked()->getInstructionCount();
+        arena.reset();
+      }
+    });
+
+    std::string mode = simplify ? "simplified" : "unsimplified";
+    bench::report("simplifier", mode + " emitted instructions", emitted, "");
+    bench::report("simplifier", mode + " optimized instructions", optimized, "");
+    bench::report("simplifier", mode + " compile", 1.0e3 * time, "ms");
+  }
+}
+
+// Results of folded constants next to i64 and f32 operands, which must not
+// depend on whether constants are folded: a folded 2*2 stays a double, while
+// the literal 4 would be an i64 and the product would wrap.
+K_BENCHMARK(folding) {
+  char const* definitions =
+    "def foldi64(x) var k:i64 = x in k*(2*2) + (var c = 2 in k*c);\n"
+    "def foldf32(x) var f:f32 = x in f*(0.1 + 0.2);\n"
+    "def foldbranch(x) var f:f32 = x in f*(if 1 < 2 then 0.7 else 0);\n";
+  char const* names[] = {"foldi64", "foldf32", "foldbranch"};
+  double args[] = {4611686018427387904.0, 1.0 / 3.0, 1.0 / 3.0};
+
+  double results[2][3];
+  for (bool folding : {false, true}) {
+    std::ostream quiet(nullptr);
+    Driver driver(quiet, OptLevel::O1);
+    driver.setConstantFolding(folding);
+    driver.setLazyCompilation(false);
+    std::stringstream code(definitions);
+    Lexer lexer(code);
+    driver.mainLoop(lexer);
+    for (int i = 0; i < 3; ++i) {
+      auto fn = reinterpret_cast<double (*)(double)>(driver.lookupFunction(names[i]));
+      results[folding][i] = fn ? fn(args[i]) : 0.0;
+    }
+  }
+
+  int mismatches = 0;
+  for (int i = 0; i < 3; ++i) {
+    bench::report("folding", std::string(names[i]) + " unfolded", results[0][i], "");
+    bench::report("folding", std::string(names[i]) + " folded", results[1][i], "");
+    mismatches += results[0][i] != results[1][i];
+  }
+  bench::report("folding", "mismatches", mismatches, "");
+}
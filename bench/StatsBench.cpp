@@ -0,0 +1,39 @@
+#include <sstream>
+#include <string>
+#include "Bench.h"
+#include "CompileStats.h"
+#include "Driver.h"
+
+// Overhead of compile statistics on eager compilation of many definitions,
+// and the time per phase they report.
+K_BENCHMARK(stats) {
+  constexpr int numDefinitions = 1000;
+  std::string script;
+  for (int i = 0; i < numDefinitions; ++i) {
+    script += "def f" + std::to_string(i) + "(x y) var s = 0 in\n"
+              "  (for i = 0, i < y in s = s + (if x < i then x*i - " + std::to_string(i) + " else x + i))\n"
+              "  + s;\n";
+  }
+
+  CompileRecord total;
+  for (bool enabled : {false, true}) {
+    std::ostream quiet(nullptr);
+    std::stringstream code(script);
+    Lexer lexer(code);
+    Driver driver(quiet, OptLevel::O2);
+    driver.setLazyCompilation(false);
+    driver.setStatistics(enabled);
+    double time = bench::seconds([&] { driver.mainLoop(lexer); });
+    bench::report("stats", enabled ? "time per definition (on)" : "time per definition (off)",
+                  1.0e6 * time / numDefinitions, "us");
+    if (enabled) {
+      total = driver.getStatistics()->total();
+    }
+  }
+  for (std::size_t i = 0; i < numPhases; ++i) {
+    bench::report("stats", std::string(getPhaseName(static_cast<Phase>(i))) + " per definition",
+                  1.0e6 * total.seconds[i] / numDefinitions, "us");
+  }
+  bench::report("stats", "instructions before optimization", total.instructionsBefore, "insts");
+  bench::report("stats", "instructions after optimization", total.instructionsAfter, "insts");
+}
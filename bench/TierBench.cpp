@@ -0,0 +1,34 @@
+#include <sstream>
+#include <string>
+#include "Bench.h"
+#include "Driver.h"
+
+static double runScript(std::string const& script, unsigned long threshold) {
+  std::ostream quiet(nullptr);
+  std::stringstream code(script);
+  Lexer lexer(code);
+  return bench::seconds([&] {
+    Driver driver(quiet);
+    driver.setTierUpThreshold(threshold);
+    driver.mainLoop(lexer);
+  });
+}
+
+// Start-up dominated job vs. long-running kernel, compiled right away
+// (threshold 0) or interpreted first.
+K_BENCHMARK(tiering) {
+  std::string shortJob;
+  for (int i = 0; i < 50; ++i) {
+    shortJob += "def f" + std::to_string(i) + "(x y) if x < y then x*y + " + std::to_string(i) + " else x - y;\n";
+    shortJob += "f" + std::to_string(i) + "(1, 2);\n";
+  }
+  std::string kernel =
+    "def f(x) x*x*x - 2*x + 1;\n"
+    "var s = 0 in (for i = 0, i < 1000000 in s = s + f(i*0.000001)) + s;\n";
+
+  for (unsigned long threshold : {0ul, 100ul, 10000ul}) {
+    std::string t = "threshold " + std::to_string(threshold);
+    bench::report("tiering", t + " short job", 1.0e3 * runScript(shortJob, threshold), "ms");
+    bench::report("tiering", t + " kernel", 1.0e3 * runScript(kernel, threshold), "ms");
+  }
+}
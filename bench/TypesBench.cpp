@@ -0,0 +1,45 @@
+#include <sstream>
+#include <string>
+#include "Bench.h"
+#include "Driver.h"
+
+// Run time of a branchy and a loop-heavy kernel with double loop variables
+// (-no-int-loops), with inferred i64 loop variables, and with i64 and bool
+// annotations on all variables.
+K_BENCHMARK(types) {
+  char const* definitions =
+    "def branchy(n h q) var c = 0 in\n"
+    "  (for i = 0, i < n in c = c + (if i < q then 1 else if i < h then 2 else 3)) + c;\n"
+    "def nested(n) var s = 0 in\n"
+    "  (for i = 0, i < n in for j = 0, j < i in s = s + (if j < 7 then j else 1)) + s;\n"
+    "def branchytyped(n:i64 h:i64 q:i64) : i64 var c:i64 = 0 in\n"
+    "  (for i = 0, i < n in c = c + (if i < q then 1 else if i < h then 2 else 3)) + c;\n"
+    "def nestedtyped(n:i64) : i64 var s:i64 = 0, small:bool in\n"
+    "  (for i = 0, i < n in for j = 0, j < i in\n"
+    "    (small = j < 7) + (s = s + (if small then j else 1))) + s;\n";
+
+  struct Mode {
+    char const* name;
+    bool integerLoops;
+    char const* suffix;
+  };
+  for (Mode mode : {Mode{"double", false, ""}, Mode{"inferred", true, ""}, Mode{"typed", true, "typed"}}) {
+    std::ostream quiet(nullptr);
+    Driver driver(quiet, OptLevel::O2);
+    driver.setIntegerLoops(mode.integerLoops);
+    driver.setLazyCompilation(false);
+    std::stringstream definitionStream(definitions);
+    Lexer definitionLexer(definitionStream);
+    driver.mainLoop(definitionLexer);
+
+    std::string suffix = mode.suffix;
+    std::string calls[] = {"branchy" + suffix + "(100000000, 50000000, 25000000);\n",
+                           "nested" + suffix + "(20000);\n"};
+    for (std::string const& call : calls) {
+      std::stringstream runStream(call);
+      Lexer runLexer(runStream);
+      double time = bench::seconds([&] { driver.mainLoop(runLexer); });
+      bench::report("types", std::string(mode.name) + " " + call.substr(0, call.find('(')), 1.0e3 * time, "ms");
+    }
+  }
+}
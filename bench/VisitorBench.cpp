@@ -0,0 +1,114 @@
+#include <string>
+#include <vector>
+#include <md/visit.hpp>
+#include "Bench.h"
+#include "Parser.h"
+#include "visitor/Visit.h"
+
+namespace {
+
+struct MdDispatch {
+  template<typename Visitor, typename Node>
+  static void visit(Visitor& visitor, Node& node) { md::visit(visitor, node); }
+};
+
+struct KindDispatch {
+  template<typename Visitor, typename Node>
+  static void visit(Visitor& visitor, Node& node) { ast::visit(visitor, node); }
+};
+
+template<typename Dispatch>
+struct NodeCounter {
+  long count = 0;
+
+  void operator()(ExprAST&) {}
+  void operator()(NumberExprAST&) { ++count; }
+  void operator()(VariableExprAST&) { ++count; }
+  void operator()(BinaryExprAST& node) {
+    ++count;
+    Dispatch::visit(*this, node.getLHS());
+    Dispatch::visit(*this, node.getRHS());
+  }
+  void operator()(CallExprAST& node) {
+    ++count;
+    for (auto arg : node.getArgs()) {
+      Dispatch::visit(*this, *arg);
+    }
+  }
+  void operator()(IfExprAST& node) {
+    ++count;
+    Dispatch::visit(*this, node.getCond());
+    Dispatch::visit(*this, node.getThen());
+    Dispatch::visit(*this, node.getElse());
+  }
+  void operator()(ForExprAST& node) {
+    ++count;
+    Dispatch::visit(*this, node.getStart());
+    Dispatch::visit(*this, node.getEnd());
+    if (node.getStep()) {
+      Dispatch::visit(*this, node.getStep()->get());
+    }
+    Dispatch::visit(*this, node.getBody());
+  }
+  void operator()(VarExprAST& node) {
+    ++count;
+    for (auto& var : node.getVarNames()) {
+      if (var.second) {
+        Dispatch::visit(*this, *var.second);
+      }
+    }
+    Dispatch::visit(*this, node.getBody());
+  }
+  void operator()(PrototypeAST&) { ++count; }
+  void operator()(FunctionAST& node) {
+    ++count;
+    Dispatch::visit(*this, node.getPrototype());
+    Dispatch::visit(*this, node.getBody());
+  }
+};
+
+template<typename Dispatch>
+double visitsPerSecond(std::vector<FunctionAST*> const& functions) {
+  constexpr int repetitions = 20;
+  NodeCounter<Dispatch> counter;
+  double time = bench::seconds([&] {
+    for (int r = 0; r < repetitions; ++r) {
+      for (auto f : functions) {
+        Dispatch::visit(counter, *f);
+      }
+    }
+  });
+  return counter.count / time;
+}
+
+}
+
+K_BENCHMARK(visitor) {
+  std::string script = bench::generateScript(4 << 20);
+  // Deep left-leaning trees
+  for (int i = 0; i < 1000; ++i) {
+    script += "def deep" + std::to_string(i) + "(x y) x";
+    for (int j = 0; j < 200; ++j) {
+      script += j % 2 ? "+y" : "*x";
+    }
+    script += ";\n";
+  }
+
+  SymbolTable symbols;
+  Arena arena;
+  Lexer lexer{std::string_view(script)};
+  Parser parser(lexer, arena, symbols);
+  std::vector<FunctionAST*> functions;
+  parser.getNextToken();
+  while (parser.curTok != tok_eof) {
+    FunctionAST* f = nullptr;
+    if (parser.curTok == tok_def && (f = parser.parseDefinition())) {
+      functions.push_back(f);
+    } else {
+      parser.getNextToken();
+    }
+  }
+
+  bench::report("visitor", "md::visit", visitsPerSecond<MdDispatch>(functions), "visits/s");
+  bench::report("visitor", "ast::visit", visitsPerSecond<KindDispatch>(functions), "visits/s");
+}
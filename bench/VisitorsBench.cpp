@@ -0,0 +1,100 @@
+#include <iostream>
+#include <streambuf>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include "Bench.h"
+#include "KaleidoscopeJIT.h"
+#include "Parser.h"
+#include "visitor/AssignmentCollector.h"
+#include "visitor/CalleeCollector.h"
+#include "visitor/CodeGen.h"
+#include "visitor/Hasher.h"
+#include "visitor/NodeCounter.h"
+#include "visitor/PrettyPrinter.h"
+#include "visitor/Simplifier.h"
+#include "visitor/TailCallCollector.h"
+
+namespace {
+
+// Formats everything, keeps nothing
+struct NullBuffer : std::streambuf {
+  int overflow(int c) override { return c; }
+};
+
+}
+
+// Time of one pass of each visitor over the same generated definitions; see
+// visitor for the cost of dispatch alone and tier for the interpreter.
+// CodeGen emits without optimizing, see pipeline. The simplifier rewrites
+// the trees, hence it runs last.
+K_BENCHMARK(visitors) {
+  constexpr int repetitions = 5;
+  std::string script = bench::generateScript(1 << 20);
+  SymbolTable symbols;
+  Arena arena;
+  Lexer lexer{std::string_view(script)};
+  Parser parser(lexer, arena, symbols);
+  std::vector<FunctionAST*> functions;
+  parser.getNextToken();
+  while (parser.curTok == tok_def) {
+    functions.push_back(parser.parseDefinition());
+    parser.getNextToken();
+  }
+
+  auto run = [&](char const* name, auto&& visit) {
+    double time = bench::median(repetitions, [&] {
+      for (FunctionAST* f : functions) {
+        visit(*f);
+      }
+    });
+    bench::report("visitors", name, 1.0e3 * time, "ms");
+  };
+
+  NodeCounter nodes;
+  for (FunctionAST* f : functions) {
+    ast::visit(nodes, *f);
+  }
+  bench::report("visitors", "nodes", nodes.getCount(), "");
+
+  run("NodeCounter", [](FunctionAST& f) {
+    NodeCounter counter;
+    ast::visit(counter, f);
+  });
+  run("CalleeCollector", [](FunctionAST& f) {
+    CalleeCollector callees;
+    ast::visit(callees, f);
+  });
+  run("AssignmentCollector", [](FunctionAST& f) {
+    std::unordered_set<Symbol> assigned;
+    ast::visit(AssignmentCollector(assigned), f.getBody());
+  });
+  run("TailCallCollector", [](FunctionAST& f) {
+    std::unordered_set<CallExprAST const*> tailCalls;
+    ast::visit(TailCallCollector(tailCalls), f.getBody());
+  });
+  run("Hasher", [](FunctionAST& f) {
+    Hasher hasher;
+    ast::visit(hasher, f);
+    hasher.digest();
+  });
+
+  NullBuffer discard;
+  std::streambuf* console = std::cout.rdbuf(&discard);
+  run("PrettyPrinter", [](FunctionAST& f) { ast::visit(PrettyPrinter(), f); });
+  std::cout.rdbuf(console);
+
+  llvm::orc::KaleidoscopeJIT jit;
+  CodeGen cg(jit.getTargetMachine().createDataLayout(), OptLevel::O0, &jit.getTargetMachine());
+  run("CodeGen", [&](FunctionAST& f) {
+    ast::visit(cg, f);
+    cg.takeModule();
+  });
+
+  double time = bench::seconds([&] {
+    for (FunctionAST* f : functions) {
+      ast::visit(Simplifier(arena), *f);
+    }
+  });
+  bench::report("visitors", "Simplifier", 1.0e3 * time, "ms");
+}
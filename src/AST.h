@@ -1,157 +1,273 @@
 #ifndef K_AST_H_
 #define K_AST_H_
 
-#include <memory>
 #include <utility>
-#include <string>
-#include <vector>
 #include <optional>
+#include <functional>
 
 #include <md/type.hpp>
 
+#include "Arena.h"
+#include "Reduction.h"
+#include "Symbol.h"
+#include "Types.h"
+
 // Sort from derived to base classes
 using ast_type = md::type< class NumberExprAST,
                            class VariableExprAST,
                            class BinaryExprAST,
                            class CallExprAST,
+                           class IndexExprAST,
                            class IfExprAST,
                            class ForExprAST,
+                           class ParForExprAST,
                            class VarExprAST,
                            class ExprAST,
                            class PrototypeAST,
                            class FunctionAST>;
 
+// All nodes are allocated from an Arena that owns the tree, therefore
+// children are plain pointers and names are interned Symbols.
+
+// Tag of the concrete ExprAST subclass, see visitor/Visit.h
+enum class ExprKind {
+  Number,
+  Variable,
+  Binary,
+  Call,
+  Index,
+  If,
+  For,
+  ParFor,
+  Var
+};
+
 class ExprAST : public ast_type {
+private:
+  ExprKind kind;
+
+protected:
+  explicit ExprAST(ExprKind kind)
+    : kind(kind) {}
+
 public:
   virtual ~ExprAST() {}
+
+  ExprKind getKind() const { return kind; }
 };
 
 class NumberExprAST : public md::with_type<NumberExprAST,ExprAST> {
 private:
   double val;
+  bool literal;
 
 public:
-  NumberExprAST(double val)
-    : val(val) {}
+  NumberExprAST(double val, bool literal = true)
+    : with_type(ExprKind::Number), val(val), literal(literal) {}
 
   double getNumber() const { return val; }
+  /// Whether the number is written in the source. Numbers computed by the
+  /// Simplifier are doubles, whereas literals take the type of the other
+  /// operand, see CodeGen.
+  bool isLiteral() const { return literal; }
 };
 
 class VariableExprAST : public md::with_type<VariableExprAST,ExprAST> {
 private:
-  std::string name;
+  Symbol name;
 
 public:
-  VariableExprAST(std::string const& name)
-    : name(name) {}
+  VariableExprAST(Symbol name)
+    : with_type(ExprKind::Variable), name(name) {}
 
-  std::string const& getName() const { return name; }
+  Symbol getName() const { return name; }
 };
 
 class BinaryExprAST : public md::with_type<BinaryExprAST,ExprAST> {
 private:
   char op;
-  std::unique_ptr<ExprAST> lhs, rhs;
+  ExprAST *lhs, *rhs;
 
 public:
-  BinaryExprAST(char op, std::unique_ptr<ExprAST> lhs, std::unique_ptr<ExprAST> rhs)
-    : op(op), lhs(std::move(lhs)), rhs(std::move(rhs)) {}
+  BinaryExprAST(char op, ExprAST* lhs, ExprAST* rhs)
+    : with_type(ExprKind::Binary), op(op), lhs(lhs), rhs(rhs) {}
 
   char getOp() const { return op; }
   ExprAST& getLHS() { return *lhs; }
   ExprAST& getRHS() { return *rhs; }
+  void setLHS(ExprAST* node) { lhs = node; }
+  void setRHS(ExprAST* node) { rhs = node; }
 };
 
 class CallExprAST : public md::with_type<CallExprAST,ExprAST> {
 private:
-  std::string callee;
-  std::vector<std::unique_ptr<ExprAST>> args;
+  Symbol callee;
+  Span<ExprAST*> args;
 
 public:
-  CallExprAST(std::string const& callee, std::vector<std::unique_ptr<ExprAST>> args)
-    : callee(callee), args(std::move(args)) {}
+  CallExprAST(Symbol callee, Span<ExprAST*> args)
+    : with_type(ExprKind::Call), callee(callee), args(args) {}
+
+  Span<ExprAST*> getArgs() const { return args; }
 
-  auto const& getArgs() const { return args; }
+  Symbol getCallee() const { return callee; }
+};
+
+/// Element of an array, array[index]. Also the destination of '='.
+class IndexExprAST : public md::with_type<IndexExprAST,ExprAST> {
+private:
+  ExprAST *Array, *Index;
+
+public:
+  IndexExprAST(ExprAST* Array, ExprAST* Index)
+    : with_type(ExprKind::Index), Array(Array), Index(Index)
+  {}
 
-  std::string const& getCallee() const { return callee; }
+  ExprAST& getArray() { return *Array; }
+  ExprAST& getIndex() { return *Index; }
+  void setArray(ExprAST* node) { Array = node; }
+  void setIndex(ExprAST* node) { Index = node; }
 };
 
 class IfExprAST : public md::with_type<IfExprAST,ExprAST> {
 private:
-  std::unique_ptr<ExprAST> Cond, Then, Else;
+  ExprAST *Cond, *Then, *Else;
 
 public:
-  IfExprAST(std::unique_ptr<ExprAST> Cond,
-            std::unique_ptr<ExprAST> Then,
-            std::unique_ptr<ExprAST> Else)
-    : Cond(std::move(Cond)), Then(std::move(Then)), Else(std::move(Else))
+  IfExprAST(ExprAST* Cond, ExprAST* Then, ExprAST* Else)
+    : with_type(ExprKind::If), Cond(Cond), Then(Then), Else(Else)
   {}
 
   ExprAST& getCond() { return *Cond; }
   ExprAST& getThen() { return *Then; }
   ExprAST& getElse() { return *Else; }
+  void setCond(ExprAST* node) { Cond = node; }
+  void setThen(ExprAST* node) { Then = node; }
+  void setElse(ExprAST* node) { Else = node; }
 };
 
 class ForExprAST : public md::with_type<ForExprAST,ExprAST> {
 private:
-  std::string varName;
-  std::unique_ptr<ExprAST> Start, End, Step, Body;
+  Symbol varName;
+  ExprAST *Start, *End, *Step, *Body;
 
 public:
-  ForExprAST(std::string const& varName,
-             std::unique_ptr<ExprAST> Start,
-             std::unique_ptr<ExprAST> End,
-             std::unique_ptr<ExprAST> Step,
-             std::unique_ptr<ExprAST> Body)
-    : varName(varName), Start(std::move(Start)), End(std::move(End)),
-      Step(std::move(Step)), Body(std::move(Body))
+  ForExprAST(Symbol varName,
+             ExprAST* Start,
+             ExprAST* End,
+             ExprAST* Step,
+             ExprAST* Body)
+    : with_type(ExprKind::For), varName(varName), Start(Start), End(End), Step(Step), Body(Body)
   {}
 
-  std::string const& getVarName() const { return varName; }
+  Symbol getVarName() const { return varName; }
   ExprAST& getStart() { return *Start; }
   ExprAST& getEnd() { return *End; }
   std::optional<std::reference_wrapper<ExprAST>> getStep() {
     return Step ? std::optional<std::reference_wrapper<ExprAST>>{*Step} : std::nullopt;
   }
   ExprAST& getBody() { return *Body; }
+  void setStart(ExprAST* node) { Start = node; }
+  void setEnd(ExprAST* node) { End = node; }
+  void setStep(ExprAST* node) { Step = node; }
+  void setBody(ExprAST* node) { Body = node; }
+};
+
+/// Iterations varName = start, start+1, ... while varName < end, which run in
+/// parallel. The body sees a private copy of all outer variables, taken at
+/// loop entry, hence assignments to them only last for one iteration. The
+/// value is the reduction of the values of all iterations.
+class ParForExprAST : public md::with_type<ParForExprAST,ExprAST> {
+private:
+  Symbol varName;
+  Reduction reduction;
+  ExprAST *Start, *End, *Body;
+
+public:
+  ParForExprAST(Symbol varName,
+                Reduction reduction,
+                ExprAST* Start,
+                ExprAST* End,
+                ExprAST* Body)
+    : with_type(ExprKind::ParFor), varName(varName), reduction(reduction), Start(Start), End(End), Body(Body)
+  {}
+
+  Symbol getVarName() const { return varName; }
+  Reduction getReduction() const { return reduction; }
+  ExprAST& getStart() { return *Start; }
+  ExprAST& getEnd() { return *End; }
+  ExprAST& getBody() { return *Body; }
+  void setStart(ExprAST* node) { Start = node; }
+  void setEnd(ExprAST* node) { End = node; }
+  void setBody(ExprAST* node) { Body = node; }
 };
 
 class VarExprAST : public md::with_type<VarExprAST,ExprAST> {
 private:
-  std::vector<std::pair<std::string, std::unique_ptr<ExprAST>>> varNames;
-  std::unique_ptr<ExprAST> body;
+  Span<std::pair<Symbol, ExprAST*>> varNames;
+  // Empty if no variable is annotated
+  Span<std::optional<ValueType>> varTypes;
+  ExprAST* body;
 public:
-  VarExprAST(std::vector<std::pair<std::string, std::unique_ptr<ExprAST>>> varNames,
-             std::unique_ptr<ExprAST> body)
-    : varNames(std::move(varNames)), body(std::move(body))
+  VarExprAST(Span<std::pair<Symbol, ExprAST*>> varNames, ExprAST* body,
+             Span<std::optional<ValueType>> varTypes = {})
+    : with_type(ExprKind::Var), varNames(varNames), varTypes(varTypes), body(body)
   {}
 
-  auto const& getVarNames() const { return varNames; }
+  Span<std::pair<Symbol, ExprAST*>> getVarNames() const { return varNames; }
+  /// Annotated type of the i-th variable. Variables without annotation are
+  /// arrays if they are initialized with one and doubles otherwise.
+  std::optional<ValueType> getVarType(std::size_t i) const {
+    return varTypes.empty() ? std::nullopt : varTypes[i];
+  }
+  bool hasVarTypes() const { return !varTypes.empty(); }
   ExprAST& getBody() { return *body; }
+  void setVarNames(Span<std::pair<Symbol, ExprAST*>> names) { varNames = names; }
+  void setBody(ExprAST* node) { body = node; }
 };
 
 class PrototypeAST : public md::with_type<PrototypeAST,ast_type>{
 private:
-  std::string name;
-  std::vector<std::string> args;
+  Symbol name;
+  Span<Symbol> args;
+  Span<ValueType> argTypes;
+  ValueType returnType;
 
 public:
-  PrototypeAST(std::string const& name, std::vector<std::string> args)
-    : name(name), args(std::move(args)) {}
-
-  std::string const& getName() const { return name; }
-
-  auto const& getArgs() const { return args; }
+  /// argTypes is either empty, i.e. all arguments are doubles, or holds the
+  /// type of every argument.
+  PrototypeAST(Symbol name, Span<Symbol> args,
+               Span<ValueType> argTypes = {},
+               ValueType returnType = ValueType::Double)
+    : name(name), args(args), argTypes(argTypes), returnType(returnType) {}
+
+  Symbol getName() const { return name; }
+
+  Span<Symbol> getArgs() const { return args; }
+  ValueType getArgType(std::size_t i) const {
+    return argTypes.empty() ? ValueType::Double : argTypes[i];
+  }
+  ValueType getReturnType() const { return returnType; }
+
+  /// Whether all arguments and the result are doubles.
+  bool isScalar() const {
+    for (std::size_t i = 0; i < args.size(); ++i) {
+      if (getArgType(i) != ValueType::Double) {
+        return false;
+      }
+    }
+    return returnType == ValueType::Double;
+  }
 };
 
 class FunctionAST : public md::with_type<FunctionAST,ast_type> {
 private:
-  std::unique_ptr<PrototypeAST> proto;
-  std::unique_ptr<ExprAST> body;
+  PrototypeAST* proto;
+  ExprAST* body;
 
 public:
-  FunctionAST(std::unique_ptr<PrototypeAST> proto, std::unique_ptr<ExprAST> body)
-    : proto(std::move(proto)), body(std::move(body)) {}
+  FunctionAST(PrototypeAST* proto, ExprAST* body)
+    : proto(proto), body(body) {}
 
   PrototypeAST& getPrototype() {
     return *proto;
@@ -160,6 +276,10 @@ public:
   ExprAST& getBody() {
     return *body;
   }
+
+  void setBody(ExprAST* node) {
+    body = node;
+  }
 };
 
 #endif
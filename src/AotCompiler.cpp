@@ -0,0 +1,156 @@
+#include "AotCompiler.h"
+
+#include <cctype>
+#include <iostream>
+#include <sstream>
+
+#include "llvm/ExecutionEngine/Orc/CompileUtils.h"
+#include "llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h"
+#include "llvm/Object/ArchiveWriter.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include "Parser.h"
+#include "visitor/Simplifier.h"
+
+using namespace llvm;
+
+static std::unique_ptr<TargetMachine> createHostTargetMachine() {
+  auto jtmb = cantFail(orc::JITTargetMachineBuilder::detectHost());
+  // The objects end up in arbitrary executables and shared libraries
+  jtmb.setRelocationModel(Reloc::PIC_);
+  return cantFail(jtmb.createTargetMachine());
+}
+
+AotCompiler::AotCompiler(OptLevel optLevel)
+  : tm(createHostTargetMachine()),
+    cg(tm->createDataLayout(), optLevel, tm.get()) {}
+
+void AotCompiler::addSource(Lexer& lexer) {
+  Parser parser(lexer, arena, symbols);
+  parser.getNextToken();
+  while (parser.curTok != tok_eof) {
+    arena.reset();
+    switch (parser.curTok) {
+    case ';':
+      parser.getNextToken();
+      break;
+    case tok_def:
+      if (auto ast = parser.parseDefinition()) {
+        if (constantFolding) {
+          ast::visit(Simplifier(arena), *ast);
+        }
+        if (ast::visit(cg, *ast)) {
+          exported.push_back(ast->getPrototype().getName());
+        } else {
+          ok = false;
+        }
+      } else {
+        ok = false;
+        parser.synchronize();
+      }
+      break;
+    case tok_extern:
+      if (auto ast = parser.parseExtern()) {
+        ast::visit(cg, *ast);
+      } else {
+        ok = false;
+        parser.synchronize();
+      }
+      break;
+    default:
+      std::cerr << "Error: top-level expressions cannot be compiled ahead of time" << std::endl;
+      ok = false;
+      if (!parser.parseTopLevelExpr()) {
+        parser.synchronize();
+      }
+      break;
+    }
+  }
+}
+
+void AotCompiler::finishObject(std::string const& name) {
+  auto module = cg.takeModule();
+  module.getModuleUnlocked()->setModuleIdentifier(name);
+  objects.emplace_back(name, orc::SimpleCompiler(*tm)(*module.getModuleUnlocked()));
+}
+
+static bool writeFile(std::string const& path, StringRef data) {
+  std::error_code error;
+  raw_fd_ostream file(path, error, sys::fs::OF_None);
+  if (error) {
+    std::cerr << "Error: could not write " << path << ": " << error.message() << std::endl;
+    return false;
+  }
+  file << data;
+  return true;
+}
+
+bool AotCompiler::writeObject(std::string const& path) {
+  if (objects.size() != 1) {
+    std::cerr << "Error: expected a single object, use a library instead" << std::endl;
+    return false;
+  }
+  return writeFile(path, objects.front().second->getBuffer());
+}
+
+bool AotCompiler::writeArchive(std::string const& path) {
+  std::vector<NewArchiveMember> members;
+  for (auto& object : objects) {
+    members.emplace_back(object.second->getMemBufferRef());
+    members.back().MemberName = object.first;
+  }
+  auto kind = tm->getTargetTriple().isOSDarwin() ? object::Archive::K_DARWIN : object::Archive::K_GNU;
+  if (auto error = llvm::writeArchive(path, members, true, kind, true, false)) {
+    std::cerr << "Error: could not write " << path << ": " << toString(std::move(error)) << std::endl;
+    return false;
+  }
+  return true;
+}
+
+bool AotCompiler::writeHeader(std::string const& path) {
+  std::string guard;
+  for (char c : sys::path::filename(path)) {
+    guard += std::isalnum(static_cast<unsigned char>(c)) ? std::toupper(static_cast<unsigned char>(c)) : '_';
+  }
+  guard += '_';
+
+  std::ostringstream os;
+  os << "/* Generated by kaleidoscope, do not edit. */\n"
+     << "#ifndef " << guard << "\n"
+     << "#define " << guard << "\n\n"
+     << "#include <stdbool.h>\n\n"
+     << "#ifdef __cplusplus\n"
+     << "extern \"C\" {\n"
+     << "#endif\n\n";
+  // Same layout as Array; the runtime of the kaleidoscope-core library must
+  // be linked if arrays are created
+  os << "struct kaleidoscope_array {\n"
+     << "  double* data;\n"
+     << "  long long length;\n"
+     << "};\n\n";
+  auto typeName = [](ValueType type) {
+    switch (type) {
+      case ValueType::Array: return "struct kaleidoscope_array*";
+      case ValueType::I64: return "long long";
+      case ValueType::Bool: return "bool";
+      case ValueType::F32: return "float";
+      default: return "double";
+    }
+  };
+  // Parameters stay unnamed as kaleidoscope names may be C keywords or macros
+  for (Symbol name : exported) {
+    auto const* signature = cg.findPrototype(name);
+    os << typeName(signature->returnType) << " " << name << "(";
+    for (std::size_t i = 0; i < signature->args.size(); ++i) {
+      os << (i > 0 ? ", " : "") << typeName(signature->argTypes[i]);
+    }
+    os << (signature->args.empty() ? "void" : "") << ");\n";
+  }
+  os << "\n#ifdef __cplusplus\n"
+     << "}\n"
+     << "#endif\n\n"
+     << "#endif\n";
+  return writeFile(path, os.str());
+}
@@ -0,0 +1,63 @@
+#ifndef K_AOTCOMPILER_H_
+#define K_AOTCOMPILER_H_
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Target/TargetMachine.h"
+
+#include "Arena.h"
+#include "Lexer.h"
+#include "Symbol.h"
+#include "visitor/CodeGen.h"
+
+/// Compiles definitions and externs ahead of time to object files for the
+/// host, which can be linked like C code via a generated header. Top-level
+/// expressions are rejected, as there is nothing to evaluate them.
+class AotCompiler {
+private:
+  std::unique_ptr<llvm::TargetMachine> tm;
+  SymbolTable symbols;
+  Arena arena;
+  CodeGen cg;
+  // Compiled objects, named after their source
+  std::vector<std::pair<std::string, std::unique_ptr<llvm::MemoryBuffer>>> objects;
+  // Defined functions in order of definition
+  std::vector<Symbol> exported;
+  bool constantFolding = true;
+  bool ok = true;
+
+public:
+  /// Requires the native target to be initialized.
+  explicit AotCompiler(OptLevel optLevel = OptLevel::O1);
+
+  /// See CodeGen::setFastMath.
+  void setFastMath(bool enabled) { cg.setFastMath(enabled); }
+
+  /// See CodeGen::setIntegerLoops.
+  void setIntegerLoops(bool enabled) { cg.setIntegerLoops(enabled); }
+
+  /// See Driver::setConstantFolding.
+  void setConstantFolding(bool enabled) { constantFolding = enabled; }
+
+  /// Parses all items from lexer and emits them into the current object.
+  void addSource(Lexer& lexer);
+
+  /// Compiles everything added since the last call into an object file.
+  void finishObject(std::string const& name);
+
+  /// False if any error was reported so far.
+  bool succeeded() const { return ok; }
+
+  /// Requires exactly one finished object.
+  bool writeObject(std::string const& path);
+  /// Writes all finished objects into a static library.
+  bool writeArchive(std::string const& path);
+  /// Writes a C header declaring all defined functions.
+  bool writeHeader(std::string const& path);
+};
+
+#endif
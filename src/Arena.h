@@ -0,0 +1,114 @@
+#ifndef K_ARENA_H_
+#define K_ARENA_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+/// View of a contiguous array, e.g. one that was copied into an Arena.
+template<typename T>
+class Span {
+private:
+  T* first = nullptr;
+  std::size_t count = 0;
+
+public:
+  Span() = default;
+  Span(T* first, std::size_t count)
+    : first(first), count(count) {}
+
+  T* begin() const { return first; }
+  T* end() const { return first + count; }
+  std::size_t size() const { return count; }
+  bool empty() const { return count == 0; }
+  T& operator[](std::size_t i) const { return first[i]; }
+};
+
+/// Bump allocator. Destructors of objects created in an arena are never run;
+/// all memory is released at once by reset() or when the arena is destroyed.
+/// Hence, objects placed in an arena must not own any other resources.
+class Arena {
+private:
+  static constexpr std::size_t blockSize = 64 * 1024;
+
+  std::vector<std::unique_ptr<char[]>> blocks;
+  std::uintptr_t cur = 0;
+  std::uintptr_t end = 0;
+  std::size_t firstBlockSize = 0;
+  std::size_t bytesAllocated = 0;
+
+  void newBlock(std::size_t minSize) {
+    std::size_t size = minSize > blockSize ? minSize : blockSize;
+    if (blocks.empty()) {
+      firstBlockSize = size;
+    }
+    blocks.emplace_back(new char[size]);
+    cur = reinterpret_cast<std::uintptr_t>(blocks.back().get());
+    end = cur + size;
+  }
+
+public:
+  Arena() = default;
+  Arena(Arena const&) = delete;
+  Arena& operator=(Arena const&) = delete;
+
+  void* allocate(std::size_t size, std::size_t alignment) {
+    std::uintptr_t p = (cur + alignment - 1) & ~(alignment - 1);
+    if (p + size > end) {
+      newBlock(size + alignment);
+      p = (cur + alignment - 1) & ~(alignment - 1);
+    }
+    cur = p + size;
+    bytesAllocated += size;
+    return reinterpret_cast<void*>(p);
+  }
+
+  template<typename T, typename... Args>
+  T* make(Args&&... args) {
+    return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+  }
+
+  template<typename T>
+  Span<T> copy(T const* first, std::size_t count) {
+    if (count == 0) {
+      return {};
+    }
+    T* data = static_cast<T*>(allocate(count * sizeof(T), alignof(T)));
+    for (std::size_t i = 0; i < count; ++i) {
+      new (data + i) T(first[i]);
+    }
+    return {data, count};
+  }
+
+  /// count value-initialized objects, e.g. to be filled in place.
+  template<typename T>
+  Span<T> makeSpan(std::size_t count) {
+    if (count == 0) {
+      return {};
+    }
+    T* data = static_cast<T*>(allocate(count * sizeof(T), alignof(T)));
+    for (std::size_t i = 0; i < count; ++i) {
+      new (data + i) T();
+    }
+    return {data, count};
+  }
+
+  /// Releases everything at once. The first block is kept for reuse.
+  void reset() {
+    if (blocks.size() > 1) {
+      blocks.erase(blocks.begin() + 1, blocks.end());
+    }
+    if (!blocks.empty()) {
+      cur = reinterpret_cast<std::uintptr_t>(blocks.front().get());
+      end = cur + firstBlockSize;
+    }
+    bytesAllocated = 0;
+  }
+
+  std::size_t getBytesAllocated() const { return bytesAllocated; }
+};
+
+#endif
@@ -0,0 +1,51 @@
+#include "ArrayRuntime.h"
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+
+ArrayHeap::~ArrayHeap() {
+  release();
+}
+
+ArrayHeap& ArrayHeap::get() {
+  static ArrayHeap heap;
+  return heap;
+}
+
+Array* ArrayHeap::allocate(std::int64_t length) {
+  if (length < 0) {
+    length = 0;
+  }
+  // The elements directly follow the descriptor; longer arrays overflow the size
+  constexpr std::size_t maxLength = (SIZE_MAX - sizeof(Array)) / sizeof(double);
+  auto array = static_cast<std::uint64_t>(length) > maxLength
+                   ? nullptr
+                   : static_cast<Array*>(std::calloc(1, sizeof(Array) + length * sizeof(double)));
+  if (!array) {
+    std::cerr << "Error: could not allocate an array of " << length << " elements" << std::endl;
+    // Every access is out of bounds
+    static Array empty{nullptr, 0};
+    return &empty;
+  }
+  array->data = reinterpret_cast<double*>(array + 1);
+  array->length = length;
+  std::lock_guard<std::mutex> lock(mutex);
+  arrays.push_back(array);
+  return array;
+}
+
+void ArrayHeap::release() {
+  std::lock_guard<std::mutex> lock(mutex);
+  for (Array* array : arrays) {
+    std::free(array);
+  }
+  arrays.clear();
+}
+
+extern "C" Array* kaleidoscope_array_new(std::int64_t length) {
+  return ArrayHeap::get().allocate(length);
+}
+
+extern "C" void kaleidoscope_bounds_error() {
+  ArrayHeap::get().reportBoundsError();
+}
@@ -0,0 +1,50 @@
+#ifndef K_ARRAYRUNTIME_H_
+#define K_ARRAYRUNTIME_H_
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+/// Contiguous array of doubles. Generated code passes arrays as pointers to
+/// this descriptor, hence hosts can hand in storage of their own.
+struct Array {
+  double* data;
+  std::int64_t length;
+};
+
+/// Owns the arrays created by generated code. Arrays cannot be stored
+/// anywhere but in variables, hence they cannot outlive the top-level
+/// expression that created them; the Driver releases them afterwards.
+/// Arrays returned to a host stay valid until the next release().
+class ArrayHeap {
+private:
+  std::mutex mutex;
+  std::vector<Array*> arrays;
+  std::atomic<bool> boundsError{false};
+
+  ArrayHeap() = default;
+
+public:
+  ~ArrayHeap();
+
+  ArrayHeap(ArrayHeap const&) = delete;
+  ArrayHeap& operator=(ArrayHeap const&) = delete;
+
+  static ArrayHeap& get();
+
+  /// Zero-initialized; thread-safe.
+  Array* allocate(std::int64_t length);
+  void release();
+
+  void reportBoundsError() { boundsError = true; }
+  /// Whether an access was out of bounds since the last call.
+  bool takeBoundsError() { return boundsError.exchange(false); }
+};
+
+/// Entry points called by generated code. An access out of bounds reads NaN
+/// or stores nothing and is reported after the top-level expression.
+extern "C" Array* kaleidoscope_array_new(std::int64_t length);
+extern "C" void kaleidoscope_bounds_error();
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef K_AST_FORMAT_H_
+#define K_AST_FORMAT_H_
+
+#include <cstdint>
+#include <string_view>
+
+/// Binary encoding of the AST, see AstWriter and AstReader. A file is the
+/// magic, the version and a sequence of items, each an AstItem tag and
+///   definition: prototype, node
+///   extern: prototype
+///   top-level expression: node
+/// where
+///   prototype: symbol, count, symbol*, typed byte, [type byte* return type byte]
+///   node: AstTag, then the fields of the node in the order of AST.h
+///   symbol: varint 0, length, bytes for the first occurrence in the file,
+///           varint id + 1 for later ones, where ids count from 0
+/// Counts and integers are unsigned LEB128 varints, doubles are 8 bytes in
+/// the host's byte order. Children that may be missing (the step of for,
+/// the initializer of var) are AstTag::None.
+namespace astformat {
+
+constexpr std::string_view magic = "KAST";
+/// Must be increased with every change to the encoding.
+constexpr std::uint64_t version = 1;
+
+}
+
+enum class AstItem : std::uint8_t {
+  End = 0,  // not written, returned by AstReader at the end of the data
+  Definition = 1,
+  Extern = 2,
+  TopLevelExpr = 3
+};
+
+enum class AstTag : std::uint8_t {
+  None = 0,
+  Number = 1,
+  Integer = 2,  // number that is a small non-negative integer, as a varint
+  Variable = 3,
+  Binary = 4,
+  Call = 5,
+  Index = 6,
+  If = 7,
+  For = 8,
+  ParFor = 9,
+  Var = 10
+};
+
+#endif
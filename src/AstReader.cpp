@@ -0,0 +1,289 @@
+#include "AstReader.h"
+
+#include <cstring>
+#include <iostream>
+
+bool AstReader::fail(char const* str) {
+  if (!failed) {
+    std::cerr << "Error: " << str << " at byte " << pos << " of the AST" << std::endl;
+    failed = true;
+  }
+  return false;
+}
+
+std::uint8_t AstReader::readByte() {
+  if (pos >= data.size()) {
+    fail("Unexpected end");
+    return 0;
+  }
+  return static_cast<std::uint8_t>(data[pos++]);
+}
+
+std::uint64_t AstReader::readVarint() {
+  std::uint64_t value = 0;
+  for (unsigned shift = 0; shift < 64 && !failed; shift += 7) {
+    std::uint8_t byte = readByte();
+    value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      return value;
+    }
+  }
+  fail("Malformed number");
+  return 0;
+}
+
+double AstReader::readDouble() {
+  double value = 0;
+  if (data.size() - pos < sizeof(value)) {
+    fail("Unexpected end");
+    return value;
+  }
+  std::memcpy(&value, data.data() + pos, sizeof(value));
+  pos += sizeof(value);
+  return value;
+}
+
+bool AstReader::readSymbol(Symbol& symbol) {
+  std::uint64_t id = readVarint();
+  if (failed) {
+    return false;
+  }
+  if (id > 0) {
+    if (id > symbolIds.size()) {
+      return fail("Unknown symbol");
+    }
+    symbol = symbolIds[id - 1];
+    return true;
+  }
+  std::uint64_t length = readVarint();
+  if (failed || length > data.size() - pos) {
+    return fail("Unexpected end");
+  }
+  symbol = symbols.intern(data.substr(pos, length));
+  symbolIds.push_back(symbol);
+  pos += length;
+  return true;
+}
+
+bool AstReader::readType(ValueType& type) {
+  std::uint8_t byte = readByte();
+  if (failed || byte > static_cast<std::uint8_t>(ValueType::F32)) {
+    return fail("Unknown type");
+  }
+  type = static_cast<ValueType>(byte);
+  return true;
+}
+
+ExprAST* AstReader::readExpr(bool optional) {
+  auto tag = static_cast<AstTag>(readByte());
+  if (failed) {
+    return nullptr;
+  }
+  switch (tag) {
+    case AstTag::None:
+      if (!optional) {
+        fail("Missing expression");
+      }
+      return nullptr;
+    case AstTag::Number: {
+      double number = readDouble();
+      return failed ? nullptr : arena->make<NumberExprAST>(number);
+    }
+    case AstTag::Integer: {
+      std::uint64_t number = readVarint();
+      return failed ? nullptr : arena->make<NumberExprAST>(static_cast<double>(number));
+    }
+    case AstTag::Variable: {
+      Symbol name;
+      return readSymbol(name) ? arena->make<VariableExprAST>(name) : nullptr;
+    }
+    case AstTag::Binary: {
+      char op = static_cast<char>(readByte());
+      ExprAST* lhs = readExpr();
+      ExprAST* rhs = lhs ? readExpr() : nullptr;
+      return rhs ? arena->make<BinaryExprAST>(op, lhs, rhs) : nullptr;
+    }
+    case AstTag::Call: {
+      Symbol callee;
+      if (!readSymbol(callee)) {
+        return nullptr;
+      }
+      std::uint64_t count = readVarint();
+      // Every argument takes at least a byte, which bounds the allocation
+      if (failed || count > data.size() - pos) {
+        fail("Unexpected end");
+        return nullptr;
+      }
+      auto args = arena->makeSpan<ExprAST*>(count);
+      for (auto& arg : args) {
+        if (!(arg = readExpr())) {
+          return nullptr;
+        }
+      }
+      return arena->make<CallExprAST>(callee, args);
+    }
+    case AstTag::Index: {
+      ExprAST* array = readExpr();
+      ExprAST* index = array ? readExpr() : nullptr;
+      return index ? arena->make<IndexExprAST>(array, index) : nullptr;
+    }
+    case AstTag::If: {
+      ExprAST* cond = readExpr();
+      ExprAST* then = cond ? readExpr() : nullptr;
+      ExprAST* otherwise = then ? readExpr() : nullptr;
+      return otherwise ? arena->make<IfExprAST>(cond, then, otherwise) : nullptr;
+    }
+    case AstTag::For: {
+      Symbol varName;
+      if (!readSymbol(varName)) {
+        return nullptr;
+      }
+      ExprAST* start = readExpr();
+      ExprAST* end = start ? readExpr() : nullptr;
+      ExprAST* step = end ? readExpr(true) : nullptr;
+      ExprAST* body = !failed ? readExpr() : nullptr;
+      return body ? arena->make<ForExprAST>(varName, start, end, step, body) : nullptr;
+    }
+    case AstTag::ParFor: {
+      Symbol varName;
+      if (!readSymbol(varName)) {
+        return nullptr;
+      }
+      std::uint8_t reduction = readByte();
+      if (!failed && reduction > static_cast<std::uint8_t>(Reduction::Max)) {
+        fail("Unknown reduction");
+      }
+      ExprAST* start = !failed ? readExpr() : nullptr;
+      ExprAST* end = start ? readExpr() : nullptr;
+      ExprAST* body = end ? readExpr() : nullptr;
+      return body ? arena->make<ParForExprAST>(varName, static_cast<Reduction>(reduction), start, end, body)
+                  : nullptr;
+    }
+    case AstTag::Var: {
+      std::uint64_t count = readVarint();
+      bool typed = readByte() != 0;
+      if (failed || count > data.size() - pos) {
+        fail("Unexpected end");
+        return nullptr;
+      }
+      auto varNames = arena->makeSpan<std::pair<Symbol, ExprAST*>>(count);
+      auto varTypes = typed ? arena->makeSpan<std::optional<ValueType>>(count)
+                            : Span<std::optional<ValueType>>();
+      for (std::size_t i = 0; i < count; ++i) {
+        if (!readSymbol(varNames[i].first)) {
+          return nullptr;
+        }
+        if (typed) {
+          std::uint8_t type = readByte();
+          if (failed || type > static_cast<std::uint8_t>(ValueType::F32) + 1) {
+            fail("Unknown type");
+            return nullptr;
+          }
+          if (type > 0) {
+            varTypes[i] = static_cast<ValueType>(type - 1);
+          }
+        }
+        varNames[i].second = readExpr(true);
+        if (failed) {
+          return nullptr;
+        }
+      }
+      ExprAST* body = readExpr();
+      return body ? arena->make<VarExprAST>(varNames, body, varTypes) : nullptr;
+    }
+  }
+  fail("Unknown expression");
+  return nullptr;
+}
+
+PrototypeAST* AstReader::readPrototype() {
+  Symbol name;
+  if (!readSymbol(name)) {
+    return nullptr;
+  }
+  std::uint64_t count = readVarint();
+  if (failed || count > data.size() - pos) {
+    fail("Unexpected end");
+    return nullptr;
+  }
+  auto args = arena->makeSpan<Symbol>(count);
+  for (auto& arg : args) {
+    if (!readSymbol(arg)) {
+      return nullptr;
+    }
+  }
+  bool typed = readByte() != 0;
+  Span<ValueType> argTypes;
+  ValueType returnType = ValueType::Double;
+  if (typed) {
+    argTypes = arena->makeSpan<ValueType>(count);
+    for (auto& type : argTypes) {
+      if (!readType(type)) {
+        return nullptr;
+      }
+    }
+    if (!readType(returnType)) {
+      return nullptr;
+    }
+  }
+  return failed ? nullptr : arena->make<PrototypeAST>(name, args, argTypes, returnType);
+}
+
+bool AstReader::readHeader() {
+  if (!isAst(data)) {
+    return fail("Not an AST");
+  }
+  pos = astformat::magic.size();
+  std::uint64_t version = readVarint();
+  if (!failed && version != astformat::version) {
+    return fail("Unsupported AST version");
+  }
+  return !failed;
+}
+
+AstItem AstReader::getItemKind() {
+  if (failed || pos == data.size()) {
+    return AstItem::End;
+  }
+  auto item = static_cast<AstItem>(data[pos]);
+  switch (item) {
+    case AstItem::Definition:
+    case AstItem::Extern:
+    case AstItem::TopLevelExpr:
+      return item;
+    default:
+      fail("Unknown item");
+      return AstItem::End;
+  }
+}
+
+FunctionAST* AstReader::readDefinition() {
+  if (getItemKind() != AstItem::Definition) {
+    return nullptr;
+  }
+  ++pos;
+  PrototypeAST* proto = readPrototype();
+  ExprAST* body = proto ? readExpr() : nullptr;
+  return body ? arena->make<FunctionAST>(proto, body) : nullptr;
+}
+
+PrototypeAST* AstReader::readExtern() {
+  if (getItemKind() != AstItem::Extern) {
+    return nullptr;
+  }
+  ++pos;
+  return readPrototype();
+}
+
+FunctionAST* AstReader::readTopLevelExpr() {
+  if (getItemKind() != AstItem::TopLevelExpr) {
+    return nullptr;
+  }
+  ++pos;
+  ExprAST* body = readExpr();
+  if (!body) {
+    return nullptr;
+  }
+  auto proto = arena->make<PrototypeAST>(symbols.intern("__anon_expr"), Span<Symbol>());
+  return arena->make<FunctionAST>(proto, body);
+}
@@ -0,0 +1,62 @@
+#ifndef K_AST_READER_H_
+#define K_AST_READER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "AST.h"
+#include "AstFormat.h"
+
+/// Reconstructs the items written by AstWriter in a single pass over data,
+/// e.g. a memory-mapped file, without tokenizing anything. Malformed data is
+/// reported once; all reads fail from then on, as there is no way to resync.
+class AstReader {
+private:
+  std::string_view data;
+  std::size_t pos = 0;
+  Arena* arena;
+  SymbolTable& symbols;
+  // By id, see AstFormat.h
+  std::vector<Symbol> symbolIds;
+  bool failed = false;
+
+  bool fail(char const* str);
+
+  std::uint8_t readByte();
+  std::uint64_t readVarint();
+  double readDouble();
+  bool readSymbol(Symbol& symbol);
+  bool readType(ValueType& type);
+
+  /// nullptr for AstTag::None, which is an error unless optional.
+  ExprAST* readExpr(bool optional = false);
+  PrototypeAST* readPrototype();
+
+public:
+  /// Nodes are allocated from arena, identifiers are interned into symbols.
+  AstReader(std::string_view data, Arena& arena, SymbolTable& symbols)
+    : data(data), arena(&arena), symbols(symbols) {}
+
+  /// Whether data starts like a file written by AstWriter.
+  static bool isAst(std::string_view data) {
+    return data.substr(0, astformat::magic.size()) == astformat::magic;
+  }
+
+  /// Nodes read from now on are allocated from arena.
+  void setArena(Arena& newArena) { arena = &newArena; }
+
+  /// Checks magic and version; must be called first.
+  bool readHeader();
+
+  /// Kind of the next item, which must be read with the matching function
+  /// below. AstItem::End at the end of the data or after an error.
+  AstItem getItemKind();
+
+  FunctionAST* readDefinition();
+  PrototypeAST* readExtern();
+  FunctionAST* readTopLevelExpr();
+};
+
+#endif
@@ -0,0 +1,107 @@
+#ifndef K_BUILTINS_H_
+#define K_BUILTINS_H_
+
+#include <cmath>
+#include <cstddef>
+#include <string_view>
+
+/// Functions known to the compiler. They can be called without an extern and
+/// cannot be redefined. CodeGen lowers the math functions to LLVM intrinsics,
+/// which the optimizer can fold and vectorize, unlike opaque libm calls.
+/// Their names and semantics follow libm. array(n) creates a zeroed array of
+/// trunc(n) elements and len(a) is the number of elements of a.
+enum class Builtin {
+  Sqrt,
+  Sin,
+  Cos,
+  Exp,
+  Exp2,
+  Log,
+  Log2,
+  Log10,
+  Fabs,
+  Floor,
+  Ceil,
+  Trunc,
+  Round,
+  Pow,
+  Fma,
+  Fmin,
+  Fmax,
+  Copysign,
+  Array,
+  Length
+};
+
+struct BuiltinInfo {
+  std::string_view name;
+  Builtin builtin;
+  std::size_t arity;
+};
+
+/// Returns nullptr if name is not a builtin.
+inline BuiltinInfo const* findBuiltin(std::string_view name) {
+  static constexpr BuiltinInfo builtins[] = {
+    {"sqrt", Builtin::Sqrt, 1},
+    {"sin", Builtin::Sin, 1},
+    {"cos", Builtin::Cos, 1},
+    {"exp", Builtin::Exp, 1},
+    {"exp2", Builtin::Exp2, 1},
+    {"log", Builtin::Log, 1},
+    {"log2", Builtin::Log2, 1},
+    {"log10", Builtin::Log10, 1},
+    {"fabs", Builtin::Fabs, 1},
+    {"floor", Builtin::Floor, 1},
+    {"ceil", Builtin::Ceil, 1},
+    {"trunc", Builtin::Trunc, 1},
+    {"round", Builtin::Round, 1},
+    {"pow", Builtin::Pow, 2},
+    {"fma", Builtin::Fma, 3},
+    {"fmin", Builtin::Fmin, 2},
+    {"fmax", Builtin::Fmax, 2},
+    {"copysign", Builtin::Copysign, 2},
+    {"array", Builtin::Array, 1},
+    {"len", Builtin::Length, 1}
+  };
+  for (auto const& info : builtins) {
+    if (info.name == name) {
+      return &info;
+    }
+  }
+  return nullptr;
+}
+
+/// Array builtins take or return arrays and cannot be evaluated on doubles.
+inline bool isArrayBuiltin(Builtin builtin) {
+  return builtin == Builtin::Array || builtin == Builtin::Length;
+}
+
+/// Evaluates a builtin that is not an array builtin, e.g. in the interpreter.
+inline double evaluateBuiltin(Builtin builtin, double const* args) {
+  switch (builtin) {
+    case Builtin::Sqrt: return std::sqrt(args[0]);
+    case Builtin::Sin: return std::sin(args[0]);
+    case Builtin::Cos: return std::cos(args[0]);
+    case Builtin::Exp: return std::exp(args[0]);
+    case Builtin::Exp2: return std::exp2(args[0]);
+    case Builtin::Log: return std::log(args[0]);
+    case Builtin::Log2: return std::log2(args[0]);
+    case Builtin::Log10: return std::log10(args[0]);
+    case Builtin::Fabs: return std::fabs(args[0]);
+    case Builtin::Floor: return std::floor(args[0]);
+    case Builtin::Ceil: return std::ceil(args[0]);
+    case Builtin::Trunc: return std::trunc(args[0]);
+    case Builtin::Round: return std::round(args[0]);
+    case Builtin::Pow: return std::pow(args[0], args[1]);
+    case Builtin::Fma: return std::fma(args[0], args[1], args[2]);
+    case Builtin::Fmin: return std::fmin(args[0], args[1]);
+    case Builtin::Fmax: return std::fmax(args[0], args[1]);
+    case Builtin::Copysign: return std::copysign(args[0], args[1]);
+    case Builtin::Array:
+    case Builtin::Length:
+      break;
+  }
+  return 0.0;
+}
+
+#endif
@@ -0,0 +1,133 @@
+#include "CompileStats.h"
+
+#include <utility>
+
+char const* getPhaseName(Phase phase) {
+  switch (phase) {
+    case Phase::Parse: return "parse";
+    case Phase::Simplify: return "simplify";
+    case Phase::CodeGen: return "codegen";
+    case Phase::Optimize: return "optimize";
+    case Phase::Emit: return "emit";
+  }
+  return "";
+}
+
+void CompileRecord::add(CompileRecord const& other) {
+  for (std::size_t i = 0; i < numPhases; ++i) {
+    seconds[i] += other.seconds[i];
+  }
+  tokens += other.tokens;
+  astNodes += other.astNodes;
+  instructionsBefore += other.instructionsBefore;
+  instructionsAfter += other.instructionsAfter;
+  objectBytes += other.objectBytes;
+  for (auto const& pass : other.passes) {
+    passes[pass.first] += pass.second;
+  }
+}
+
+void CompileStats::add(CompileRecord record) {
+  std::lock_guard<std::mutex> lock(mutex);
+  records.push_back(std::move(record));
+}
+
+CompileRecord CompileStats::total() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  CompileRecord sum;
+  sum.name = "total";
+  for (auto const& record : records) {
+    sum.add(record);
+  }
+  return sum;
+}
+
+namespace {
+
+// Pass names may hold quotes or commas, e.g. in template arguments
+std::string quote(std::string const& str) {
+  std::string result = "\"";
+  for (char c : str) {
+    if (c == '"' || c == '\\') {
+      result += '\\';
+    }
+    result += c;
+  }
+  return result + "\"";
+}
+
+std::string quoteCSV(std::string const& str) {
+  std::string result = "\"";
+  for (char c : str) {
+    result += c;
+    if (c == '"') {
+      result += c;
+    }
+  }
+  return result + "\"";
+}
+
+template<typename F>
+void forEachCounter(CompileRecord const& record, F&& f) {
+  f("tokens", record.tokens);
+  f("ast_nodes", record.astNodes);
+  f("instructions_before", record.instructionsBefore);
+  f("instructions_after", record.instructionsAfter);
+  f("object_bytes", record.objectBytes);
+}
+
+void writeRecord(std::ostream& os, CompileRecord const& record, char const* indent) {
+  os << "{\n" << indent << "  \"name\": " << quote(record.name) << ",\n";
+  os << indent << "  \"seconds\": {";
+  for (std::size_t i = 0; i < numPhases; ++i) {
+    os << (i > 0 ? ", " : "") << quote(getPhaseName(static_cast<Phase>(i))) << ": " << record.seconds[i];
+  }
+  os << "},\n";
+  forEachCounter(record, [&](char const* name, std::uint64_t value) {
+    os << indent << "  " << quote(name) << ": " << value << ",\n";
+  });
+  os << indent << "  \"passes\": {";
+  bool first = true;
+  for (auto const& pass : record.passes) {
+    os << (first ? "" : ", ") << quote(pass.first) << ": " << pass.second;
+    first = false;
+  }
+  os << "}\n" << indent << "}";
+}
+
+}
+
+void CompileStats::writeJSON(std::ostream& os) const {
+  CompileRecord sum = total();
+  std::lock_guard<std::mutex> lock(mutex);
+  os << "{\n  \"total\": ";
+  writeRecord(os, sum, "  ");
+  os << ",\n  \"items\": [";
+  for (std::size_t i = 0; i < records.size(); ++i) {
+    os << (i > 0 ? ", " : "\n    ");
+    writeRecord(os, records[i], "    ");
+  }
+  os << "\n  ]\n}\n";
+}
+
+void CompileStats::writeCSV(std::ostream& os) const {
+  CompileRecord sum = total();
+  std::lock_guard<std::mutex> lock(mutex);
+  os << "item,metric,value\n";
+  auto write = [&](CompileRecord const& record) {
+    std::string item = quoteCSV(record.name);
+    for (std::size_t i = 0; i < numPhases; ++i) {
+      os << item << "," << getPhaseName(static_cast<Phase>(i)) << "_seconds," << record.seconds[i] << "\n";
+    }
+    forEachCounter(record, [&](char const* name, std::uint64_t value) {
+      os << item << "," << name << "," << value << "\n";
+    });
+    for (auto const& pass : record.passes) {
+      os << item << "," << quoteCSV("pass:" + pass.first) << "," << pass.second << "\n";
+    }
+  };
+  for (auto const& record : records) {
+    write(record);
+  }
+  write(sum);
+}
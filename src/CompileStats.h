@@ -0,0 +1,86 @@
+#ifndef K_COMPILESTATS_H_
+#define K_COMPILESTATS_H_
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/// Phases of compiling a top-level item. Lexing is interleaved with parsing
+/// and part of Parse; Emit covers machine code generation and linking,
+/// which lazily compiled definitions only go through on their first call.
+enum class Phase { Parse, Simplify, CodeGen, Optimize, Emit };
+
+constexpr std::size_t numPhases = 5;
+
+char const* getPhaseName(Phase phase);
+
+/// Statistics of a single top-level item, or of a whole session.
+struct CompileRecord {
+  std::string name;
+  std::array<double, numPhases> seconds{};
+  std::uint64_t tokens = 0;
+  std::uint64_t astNodes = 0;
+  std::uint64_t instructionsBefore = 0; // before optimization
+  std::uint64_t instructionsAfter = 0;
+  std::uint64_t objectBytes = 0;
+  // Seconds per optimization pass, including the analyses it requests
+  std::map<std::string, double> passes;
+
+  double& operator[](Phase phase) { return seconds[static_cast<std::size_t>(phase)]; }
+
+  /// Adds the counters and times of other.
+  void add(CompileRecord const& other);
+};
+
+/// Adds the time until destruction to a phase of record. Does nothing if
+/// record is nullptr, hence statistics cost a branch when they are off.
+class PhaseTimer {
+private:
+  CompileRecord* record;
+  Phase phase;
+  std::chrono::steady_clock::time_point start;
+
+public:
+  PhaseTimer(CompileRecord* record, Phase phase)
+    : record(record), phase(phase) {
+    if (record) {
+      start = std::chrono::steady_clock::now();
+    }
+  }
+  ~PhaseTimer() {
+    if (record) {
+      (*record)[phase] += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+  }
+
+  PhaseTimer(PhaseTimer const&) = delete;
+  PhaseTimer& operator=(PhaseTimer const&) = delete;
+};
+
+/// Collects the records of a session. Records may be added from any thread;
+/// they are kept in the order in which they are added.
+class CompileStats {
+private:
+  mutable std::mutex mutex;
+  std::vector<CompileRecord> records;
+
+public:
+  void add(CompileRecord record);
+
+  /// Sum over all records, named "total".
+  CompileRecord total() const;
+
+  /// {"total": {...}, "items": [{...}, ...]} with times in seconds.
+  void writeJSON(std::ostream& os) const;
+  /// One "item,metric,value" row per counter, phase and pass of every record
+  /// and of the total.
+  void writeCSV(std::ostream& os) const;
+};
+
+#endif
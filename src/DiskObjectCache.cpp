@@ -0,0 +1,58 @@
+#include "DiskObjectCache.h"
+
+#include <iostream>
+
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+
+using namespace llvm;
+
+DiskObjectCache::DiskObjectCache(std::string directory)
+  : directory(std::move(directory)) {
+  if (auto error = sys::fs::create_directories(this->directory)) {
+    std::cerr << "Error: could not create cache directory " << this->directory << ": "
+              << error.message() << std::endl;
+  }
+}
+
+std::string DiskObjectCache::getPath(StringRef key) const {
+  SmallString<128> path(directory);
+  sys::path::append(path, key + ".o");
+  return path.str().str();
+}
+
+std::unique_ptr<MemoryBuffer> DiskObjectCache::load(StringRef key) {
+  auto buffer = MemoryBuffer::getFile(getPath(key), -1, false);
+  if (!buffer) {
+    return nullptr;
+  }
+  return std::move(*buffer);
+}
+
+void DiskObjectCache::store(StringRef key, MemoryBufferRef object) {
+  SmallString<128> model(directory);
+  sys::path::append(model, key + "-%%%%%%.tmp");
+  int fd;
+  SmallString<128> tmpPath;
+  if (sys::fs::createUniqueFile(model, fd, tmpPath)) {
+    return;
+  }
+  {
+    raw_fd_ostream file(fd, true);
+    file << object.getBuffer();
+  }
+  if (auto error = sys::fs::rename(tmpPath, getPath(key))) {
+    std::cerr << "Error: could not write " << getPath(key) << ": " << error.message() << std::endl;
+    sys::fs::remove(tmpPath);
+  }
+}
+
+void DiskObjectCache::notifyObjectCompiled(Module const* module, MemoryBufferRef object) {
+  store(module->getModuleIdentifier(), object);
+}
+
+std::unique_ptr<MemoryBuffer> DiskObjectCache::getObject(Module const* module) {
+  return load(module->getModuleIdentifier());
+}
@@ -0,0 +1,35 @@
+#ifndef K_DISKOBJECTCACHE_H_
+#define K_DISKOBJECTCACHE_H_
+
+#include <memory>
+#include <string>
+
+#include "llvm/ADT/StringRef.h"
+#include "llvm/ExecutionEngine/ObjectCache.h"
+#include "llvm/IR/Module.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+/// Stores object files in a directory, one file per key. The key of a module
+/// is its module identifier, which callers set to a digest of everything the
+/// object code depends on (see Driver::cacheKey). Objects are written to a
+/// temporary file first and renamed, hence several processes and threads may
+/// share a directory.
+class DiskObjectCache : public llvm::ObjectCache {
+private:
+  std::string directory;
+
+  std::string getPath(llvm::StringRef key) const;
+
+public:
+  /// Creates the directory if it does not exist.
+  explicit DiskObjectCache(std::string directory);
+
+  /// Returns nullptr if nothing is cached under key.
+  std::unique_ptr<llvm::MemoryBuffer> load(llvm::StringRef key);
+  void store(llvm::StringRef key, llvm::MemoryBufferRef object);
+
+  void notifyObjectCompiled(llvm::Module const* module, llvm::MemoryBufferRef object) override;
+  std::unique_ptr<llvm::MemoryBuffer> getObject(llvm::Module const* module) override;
+};
+
+#endif
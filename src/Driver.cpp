@@ -0,0 +1,832 @@
+#include "Driver.h"
+#include <algorithm>
+#include <unordered_set>
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/raw_ostream.h"
+#include "ArrayRuntime.h"
+#include "ParallelRuntime.h"
+#include "visitor/CalleeCollector.h"
+#include "visitor/NodeCounter.h"
+#include "visitor/Simplifier.h"
+#include "visitor/Hasher.h"
+
+Driver::Driver(std::ostream& out, OptLevel optLevel)
+  : jit(std::make_unique<llvm::orc::KaleidoscopeJIT>()),
+    cg(jit->getTargetMachine().createDataLayout(), optLevel, &jit->getTargetMachine()),
+    batchOptimizer(OptLevel::O3, &jit->getTargetMachine()),
+    interpreter(functions, [this](Symbol name) { return tierUp(name); }, tierUpThreshold),
+    out(out)
+{
+  jit->addSymbol("kaleidoscope_parallel_for", reinterpret_cast<void*>(&kaleidoscope_parallel_for));
+  jit->addSymbol("kaleidoscope_array_new", reinterpret_cast<void*>(&kaleidoscope_array_new));
+  jit->addSymbol("kaleidoscope_bounds_error", reinterpret_cast<void*>(&kaleidoscope_bounds_error));
+  cg.setSharing(hashConsing);
+}
+
+void Driver::setOptLevel(OptLevel level) {
+  waitForCompilation();
+  cg.setOptLevel(level);
+  for (auto& worker : workers) {
+    worker.cg->setOptLevel(level);
+  }
+}
+
+void Driver::setLazyCompilation(bool enabled) {
+  lazy = enabled;
+}
+
+void Driver::setConstantFolding(bool enabled) {
+  constantFolding = enabled;
+}
+
+void Driver::setHashConsing(bool enabled) {
+  waitForCompilation();
+  hashConsing = enabled;
+  cg.setSharing(enabled);
+  for (auto& worker : workers) {
+    worker.cg->setSharing(enabled);
+  }
+}
+
+void Driver::setStatistics(bool enabled) {
+  waitForCompilation();
+  if (!enabled) {
+    stats.reset();
+  } else if (!stats) {
+    stats = std::make_unique<CompileStats>();
+  }
+}
+
+std::unique_ptr<CompileRecord> Driver::newRecord(std::string name) {
+  if (!stats) {
+    return nullptr;
+  }
+  auto record = std::make_unique<CompileRecord>();
+  record->name = std::move(name);
+  return record;
+}
+
+void Driver::commit(std::unique_ptr<CompileRecord> record) {
+  if (record && stats) {
+    stats->add(std::move(*record));
+  }
+}
+
+FunctionAST* Driver::parseItem(Parser& parser, FunctionAST* (Parser::*parse)(), Arena& nodes,
+                               CompileRecord* record) {
+  std::size_t tokens = parser.lexer.getNumTokens();
+  FunctionAST* ast;
+  {
+    PhaseTimer timer(record, Phase::Parse);
+    ast = (parser.*parse)();
+  }
+  if (ast && record) {
+    record->tokens += parser.lexer.getNumTokens() - tokens;
+  }
+  return ast ? prepareItem(ast, nodes, record) : nullptr;
+}
+
+FunctionAST* Driver::readItem(AstReader& reader, FunctionAST* (AstReader::*read)(), Arena& nodes,
+                              CompileRecord* record) {
+  FunctionAST* ast;
+  {
+    PhaseTimer timer(record, Phase::Parse);
+    reader.setArena(nodes);
+    ast = (reader.*read)();
+    reader.setArena(arena);
+  }
+  return ast ? prepareItem(ast, nodes, record) : nullptr;
+}
+
+FunctionAST* Driver::prepareItem(FunctionAST* ast, Arena& nodes, CompileRecord* record) {
+  if (record) {
+    record->name = ast->getPrototype().getName().string();
+    NodeCounter counter;
+    ast::visit(counter, *ast);
+    record->astNodes += counter.getCount();
+  }
+  if (constantFolding) {
+    PhaseTimer timer(record, Phase::Simplify);
+    ast::visit(Simplifier(nodes), *ast);
+  }
+  return ast;
+}
+
+Arena& Driver::getDefinitionArena() {
+  return hashConsing ? arena : definitionArena;
+}
+
+void Driver::setCacheDirectory(std::string const& directory) {
+  objectCache = std::make_unique<DiskObjectCache>(directory);
+}
+
+DiskObjectCache* Driver::getObjectCache() const {
+  return cg.getInstrumentation() ? nullptr : objectCache.get();
+}
+
+void Driver::setProfiling(bool enabled) {
+  waitForCompilation();
+  if (enabled && !profile) {
+    profile = std::make_unique<Profile>();
+  }
+  Profile* instrumentation = enabled ? profile.get() : nullptr;
+  cg.setInstrumentation(instrumentation);
+  for (auto& worker : workers) {
+    worker.cg->setInstrumentation(instrumentation);
+  }
+}
+
+void Driver::setProfileGuidedThreshold(unsigned long calls) {
+  pgoThreshold = calls;
+  if (calls > 0) {
+    setProfiling(true);
+  }
+}
+
+void Driver::setInterprocedural(bool enabled) {
+  waitForCompilation();
+  interprocedural = enabled;
+  cg.setInterprocedural(enabled);
+  for (auto& worker : workers) {
+    worker.cg->setInterprocedural(enabled);
+  }
+}
+
+void Driver::setFastMath(bool enabled) {
+  waitForCompilation();
+  cg.setFastMath(enabled);
+  for (auto& worker : workers) {
+    worker.cg->setFastMath(enabled);
+  }
+}
+
+void Driver::setIntegerLoops(bool enabled) {
+  waitForCompilation();
+  cg.setIntegerLoops(enabled);
+  for (auto& worker : workers) {
+    worker.cg->setIntegerLoops(enabled);
+  }
+}
+
+void Driver::setTierUpThreshold(unsigned long calls) {
+  tierUpThreshold = calls;
+  interpreter.setThreshold(calls);
+}
+
+void Driver::setParallelThreads(unsigned threads) {
+  ParallelRuntime::get().setNumThreads(threads);
+}
+
+void Driver::setCompileThreads(unsigned threads) {
+  waitForCompilation();
+  pool.reset();
+  workers.clear();
+  for (unsigned i = 0; i < threads; ++i) {
+    // Neither contexts nor target machines may be shared between threads
+    auto tm = jit->createTargetMachine();
+    auto workerCG = std::make_unique<CodeGen>(tm->createDataLayout(), cg.getOptLevel(), tm.get());
+    workerCG->setInterprocedural(interprocedural);
+    workerCG->setFastMath(cg.isFastMath());
+    workerCG->setIntegerLoops(cg.isIntegerLoops());
+    workerCG->setSharing(cg.isSharing());
+    workerCG->setInstrumentation(cg.getInstrumentation());
+    workers.push_back(CompileWorker{std::move(tm), std::move(workerCG)});
+  }
+  if (threads > 0) {
+    pool = std::make_unique<::ThreadPool>(threads);
+  }
+}
+
+void Driver::handleDefinition(Parser& parser) {
+  auto record = newRecord("");
+  if (auto ast = parseItem(parser, &Parser::parseDefinition, getDefinitionArena(), record.get())) {
+    handleDefinition(ast, std::move(record));
+  } else {
+    parser.synchronize();
+    commit(std::move(record));
+  }
+}
+
+void Driver::handleDefinition(FunctionAST* ast, std::unique_ptr<CompileRecord> record) {
+  if (hashConsing) {
+    PhaseTimer timer(record.get(), Phase::Simplify);
+    ast = ast::visit(conser, *ast);
+  }
+  auto& proto = ast->getPrototype();
+  if (findBuiltin(proto.getName().str())) {
+    std::cerr << "Error: Builtins cannot be redefined." << std::endl;
+  } else if (!definitions.emplace(proto.getName(), ast).second) {
+    std::cerr << "Error: Function cannot be redefined." << std::endl;
+  } else if (!cg.checkPrototype(proto)) {
+    // e.g. an extern with another signature; checked here, as the prototype
+    // is recorded before interpretation or background compilation
+    definitions.erase(proto.getName());
+  } else if (tierUpThreshold > 0 && interpreter.canInterpret(*ast)) {
+    cg.addPrototype(proto);
+    functions.insert_or_assign(proto.getName(), TieredFunction{ast, proto.getArgs().size()});
+    out << "Parsed a function definition." << std::endl;
+  } else if (!tierUpCallees(*ast)) {
+    definitions.erase(proto.getName());
+  } else if (pool) {
+    compileInBackground(ast, std::move(record));
+    functions.insert_or_assign(proto.getName(), TieredFunction{nullptr, proto.getArgs().size(), proto.isScalar()});
+    out << "Parsed a function definition." << std::endl;
+  } else if (compileDefinition(*ast, record.get())) {
+    functions.insert_or_assign(proto.getName(), TieredFunction{nullptr, proto.getArgs().size(), proto.isScalar()});
+    out << "Parsed a function definition." << std::endl;
+  } else {
+    definitions.erase(proto.getName());
+  }
+  commit(std::move(record));
+}
+
+void Driver::handleExtern(Parser& parser) {
+  if (auto ast = parser.parseExtern()) {
+    handleExtern(ast);
+  } else {
+    parser.synchronize();
+  }
+}
+
+void Driver::handleExtern(PrototypeAST* ast) {
+  if (ast::visit(cg, *ast)) {
+    functions.insert_or_assign(ast->getName(), TieredFunction{nullptr, ast->getArgs().size(), ast->isScalar()});
+    out << "Parsed an extern" << std::endl;
+  }
+}
+
+void Driver::handleTopLevelExpression(Parser& parser) {
+  auto record = newRecord("");
+  if (auto ast = parseItem(parser, &Parser::parseTopLevelExpr, arena, record.get())) {
+    handleTopLevelExpression(ast, std::move(record));
+  } else {
+    parser.synchronize();
+    commit(std::move(record));
+  }
+}
+
+void Driver::handleTopLevelExpression(FunctionAST* ast, std::unique_ptr<CompileRecord> record) {
+  // Evaluate a top-level expression into an anonymous function.
+  if (tierUpThreshold > 0 && interpreter.canInterpret(*ast)) {
+    commit(std::move(record));
+    double result;
+    // Compiled callees may allocate arrays, too
+    reportResult(interpreter.evaluate(*ast, result), result);
+    return;
+  }
+
+  CalleeCollector callees;
+  ast::visit(callees, *ast);
+  waitForDefinitions(callees.getCallees());
+
+  bool ok = tierUpCallees(*ast);
+  if (ok) {
+    // Top-level expressions run only once, hence are not profiled
+    PhaseTimer timer(record.get(), Phase::CodeGen);
+    Profile* instrumentation = cg.getInstrumentation();
+    cg.setInstrumentation(nullptr);
+    ok = ast::visit(cg, *ast) != nullptr;
+    cg.setInstrumentation(instrumentation);
+  }
+  if (ok) {
+    auto module = cg.takeModule(record.get());
+    // Expressions run once, hence their code is released right after, see
+    // KaleidoscopeJIT::TransientObject
+    std::unique_ptr<llvm::orc::KaleidoscopeJIT::TransientObject> code;
+    {
+      PhaseTimer timer(record.get(), Phase::Emit);
+      auto object = llvm::orc::SimpleCompiler(jit->getTargetMachine())(*module.getModuleUnlocked());
+      if (record) {
+        record->objectBytes += object->getBufferSize();
+      }
+      // Fails e.g. if an extern is not defined
+      if (auto loaded = jit->addTransientObject(std::move(object))) {
+        code = std::move(*loaded);
+      } else {
+        llvm::logAllUnhandledErrors(loaded.takeError(), llvm::errs(), "Error: ");
+      }
+    }
+    commit(std::move(record));
+
+    llvm::JITTargetAddress address = code ? code->getAddress("__anon_expr") : 0;
+    double result = 0.0;
+    if (address) {
+      result = reinterpret_cast<double (*)()>(address)();
+    }
+    reportResult(address != 0, result);
+
+    code.reset();
+    if (pgoThreshold > 0) {
+      recompileHot();
+    }
+  }
+  commit(std::move(record));
+}
+
+void Driver::reportResult(bool evaluated, double result) {
+  // No array can outlive the expression
+  ArrayHeap::get().release();
+  if (ArrayHeap::get().takeBoundsError()) {
+    std::cerr << "Error: Array index out of bounds" << std::endl;
+  } else if (evaluated) {
+    out << "Evaluated to " << result << std::endl;
+  }
+}
+
+bool Driver::compileDefinition(FunctionAST& ast, CompileRecord* record) {
+  auto imports = collectImports(ast);
+  DiskObjectCache* cache = getObjectCache();
+  std::string key;
+  if (cache) {
+    key = cacheKey(ast, imports);
+    PhaseTimer timer(record, Phase::Emit);
+    if (auto object = cache->load(key)) {
+      cg.addPrototype(ast.getPrototype());
+      if (record) {
+        record->objectBytes += object->getBufferSize();
+      }
+      jit->addObject(std::move(object));
+      return true;
+    }
+  }
+
+  {
+    PhaseTimer timer(record, Phase::CodeGen);
+    if (!ast::visit(cg, ast)) {
+      return false;
+    }
+    for (FunctionAST* import : imports) {
+      cg.emitImport(*import);
+    }
+  }
+  auto module = cg.takeModule(record);
+  if (lazy && !cache) {
+    jit->addLazyModule(std::move(module));
+    return true;
+  }
+  // Eager definitions are compiled right away, as on background compilers,
+  // such that the time is attributed to the definition
+  PhaseTimer timer(record, Phase::Emit);
+  if (cache) {
+    // The cache stores the object under the module identifier.
+    module.getModuleUnlocked()->setModuleIdentifier(key);
+  }
+  llvm::orc::SimpleCompiler compile(jit->getTargetMachine(), cache);
+  auto object = compile(*module.getModuleUnlocked());
+  if (record) {
+    record->objectBytes += object->getBufferSize();
+  }
+  jit->addObject(std::move(object));
+  return true;
+}
+
+std::string Driver::cacheKey(FunctionAST& ast, std::vector<FunctionAST*> const& imports) {
+  auto& tm = jit->getTargetMachine();
+  Hasher hasher;
+  hasher.addString(LLVM_VERSION_STRING);
+  hasher.addString(tm.getTargetTriple().str());
+  hasher.addString(tm.getTargetCPU());
+  hasher.addString(tm.getTargetFeatureString());
+  hasher.addString(std::to_string(static_cast<int>(cg.getOptLevel())));
+  hasher.addString(cg.isFastMath() ? "fast-math" : "strict");
+  hasher.addString(cg.isIntegerLoops() ? "int-loops" : "double-loops");
+  hasher.addString(cg.isSharing() ? "shared" : "tree");
+  ast::visit(hasher, ast);
+  CalleeCollector callees;
+  ast::visit(callees, ast);
+  for (FunctionAST* import : imports) {
+    ast::visit(hasher, *import);
+    ast::visit(callees, *import);
+  }
+  // A cached object links against its callees as they were declared then,
+  // hence a callee redefined with another signature must miss the cache
+  for (Symbol callee : callees.getCallees()) {
+    // Hashed with the definition already
+    if (callee == ast.getPrototype().getName()) {
+      continue;
+    }
+    std::string signature = callee.string() + "(";
+    if (auto proto = cg.findPrototype(callee)) {
+      for (ValueType type : proto->argTypes) {
+        signature += std::to_string(static_cast<int>(type)) + ",";
+      }
+      signature += ")" + std::to_string(static_cast<int>(proto->returnType));
+    } else {
+      signature += "?";
+    }
+    hasher.addString(signature);
+  }
+  return hasher.digest();
+}
+
+std::vector<FunctionAST*> Driver::collectImports(FunctionAST& ast) {
+  // Bounds the size of a module for deep call graphs
+  constexpr std::size_t maxImports = 32;
+  std::vector<FunctionAST*> imports;
+  if (!interprocedural || cg.getOptLevel() == OptLevel::O0) {
+    return imports;
+  }
+
+  std::unordered_set<Symbol> seen{ast.getPrototype().getName()};
+  std::vector<FunctionAST*> worklist{&ast};
+  for (std::size_t i = 0; i < worklist.size() && imports.size() < maxImports; ++i) {
+    CalleeCollector callees;
+    ast::visit(callees, *worklist[i]);
+    for (Symbol callee : callees.getCallees()) {
+      auto definition = definitions.find(callee);
+      if (definition != definitions.end() && seen.insert(callee).second && imports.size() < maxImports) {
+        imports.push_back(definition->second);
+        worklist.push_back(definition->second);
+      }
+    }
+  }
+  return imports;
+}
+
+NativeFunction Driver::tierUp(Symbol name) {
+  // Native code can only call native code, hence every interpreted function
+  // reachable from name is compiled into the same module.
+  std::vector<Symbol> reachable{name};
+  std::vector<Symbol> closure;
+  for (std::size_t i = 0; i < reachable.size(); ++i) {
+    auto fn = functions.find(reachable[i]);
+    if (fn == functions.end() && findBuiltin(reachable[i].str())) {
+      // Lowered to intrinsics
+      continue;
+    }
+    if (fn == functions.end()) {
+      std::cerr << "Error: Unknown function referenced" << std::endl;
+      return nullptr;
+    }
+    if (fn->second.native) {
+      continue;
+    }
+    closure.push_back(reachable[i]);
+    if (fn->second.ast) {
+      CalleeCollector callees;
+      ast::visit(callees, *fn->second.ast);
+      for (Symbol callee : callees.getCallees()) {
+        if (std::find(reachable.begin(), reachable.end(), callee) == reachable.end()) {
+          reachable.push_back(callee);
+        }
+      }
+    }
+  }
+  waitForDefinitions(reachable);
+
+  auto record = newRecord("tier-up:" + name.string());
+  bool ok = true;
+  {
+    PhaseTimer timer(record.get(), Phase::CodeGen);
+    for (Symbol s : closure) {
+      FunctionAST* ast = functions[s].ast;
+      ok = ok && (!ast || ast::visit(cg, *ast)) && cg.emitArgvWrapper(s);
+    }
+  }
+  auto module = cg.takeModule(record.get());
+  if (!ok) {
+    commit(std::move(record));
+    return nullptr;
+  }
+
+  {
+    PhaseTimer timer(record.get(), Phase::Emit);
+    jit->addModule(std::move(module));
+    for (Symbol s : closure) {
+      auto symbol = cantFail(jit->lookup(s.string() + ".argv"));
+      functions[s].native = reinterpret_cast<NativeFunction>(symbol.getAddress());
+    }
+  }
+  commit(std::move(record));
+  return functions[name].native;
+}
+
+bool Driver::tierUpCallees(FunctionAST& ast) {
+  CalleeCollector callees;
+  ast::visit(callees, ast);
+  for (Symbol callee : callees.getCallees()) {
+    auto fn = functions.find(callee);
+    if (fn != functions.end() && fn->second.ast && !fn->second.native && !tierUp(callee)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+Driver::BatchFunction Driver::compileBatch(Symbol name) {
+  auto definition = definitions.find(name);
+  if (definition == definitions.end()) {
+    std::cerr << "Error: Unknown function referenced" << std::endl;
+    return nullptr;
+  }
+  // The kernel calls into whatever the function calls.
+  waitForDefinitions({name});
+
+  auto record = newRecord(name.string() + ".batch");
+  bool ok;
+  {
+    // The function is emitted once more, such that it can be inlined.
+    PhaseTimer timer(record.get(), Phase::CodeGen);
+    ok = ast::visit(cg, *definition->second) && cg.emitBatchWrapper(name);
+    for (FunctionAST* import : collectImports(*definition->second)) {
+      ok = ok && cg.emitImport(*import);
+    }
+  }
+  auto module = cg.takeModule(batchOptimizer, record.get());
+  if (!ok) {
+    commit(std::move(record));
+    return nullptr;
+  }
+  llvm::JITTargetAddress address;
+  {
+    PhaseTimer timer(record.get(), Phase::Emit);
+    jit->addModule(std::move(module));
+    address = cantFail(jit->lookup(name.string() + ".batch")).getAddress();
+  }
+  commit(std::move(record));
+  return reinterpret_cast<BatchFunction>(address);
+}
+
+void Driver::recompileHot() {
+  for (Symbol name : profile->getFunctions()) {
+    auto definition = definitions.find(name);
+    auto fn = functions.find(name);
+    // Functions that are still interpreted are only counted where they were
+    // inlined, and are compiled by tierUp
+    if (profile->getCount(name, SiteKind::Entry) <= pgoThreshold || recompiled.count(name) ||
+        definition == definitions.end() || fn == functions.end() ||
+        (fn->second.ast && !fn->second.native)) {
+      continue;
+    }
+    recompiled.insert(name);
+    waitForDefinitions({name});
+
+    auto record = newRecord("pgo:" + name.string());
+    Profile* instrumentation = cg.getInstrumentation();
+    cg.setInstrumentation(nullptr);
+    cg.setFeedback(profile.get());
+    bool ok;
+    {
+      PhaseTimer timer(record.get(), Phase::CodeGen);
+      // The prototype is known, but the definition must be emitted anew
+      ok = ast::visit(cg, *definition->second) != nullptr;
+      for (FunctionAST* import : collectImports(*definition->second)) {
+        ok = ok && cg.emitImport(*import);
+      }
+    }
+    cg.setFeedback(nullptr);
+    cg.setInstrumentation(instrumentation);
+    auto module = cg.takeModule(record.get());
+    if (ok) {
+      PhaseTimer timer(record.get(), Phase::Emit);
+      auto object = llvm::orc::SimpleCompiler(jit->getTargetMachine())(*module.getModuleUnlocked());
+      if (record) {
+        record->objectBytes += object->getBufferSize();
+      }
+      jit->removeSymbol(name.string());
+      jit->addObject(std::move(object));
+      // Links the object right away rather than on the next lookup
+      cantFail(jit->lookup(name.string()));
+    }
+    commit(std::move(record));
+  }
+}
+
+void* Driver::lookupFunction(std::string_view name) {
+  Symbol symbol = symbols.intern(name);
+  if (functions.find(symbol) == functions.end()) {
+    return nullptr;
+  }
+  waitForDefinitions({symbol});
+  auto address = jit->lookup(symbol.string());
+  if (!address) {
+    llvm::consumeError(address.takeError());
+    return nullptr;
+  }
+  return reinterpret_cast<void*>(address->getAddress());
+}
+
+Driver::BatchFunction Driver::getBatchFunction(std::string_view name) {
+  Symbol symbol = symbols.intern(name);
+  auto kernel = batchKernels.find(symbol);
+  if (kernel != batchKernels.end()) {
+    return kernel->second;
+  }
+  BatchFunction fn = compileBatch(symbol);
+  if (fn) {
+    batchKernels[symbol] = fn;
+  }
+  return fn;
+}
+
+bool Driver::evaluateBatch(std::string_view name, std::vector<double const*> const& columns,
+                           double* out, std::size_t n) {
+  auto fn = functions.find(symbols.intern(name));
+  if (fn == functions.end()) {
+    std::cerr << "Error: Unknown function referenced" << std::endl;
+    return false;
+  }
+  if (fn->second.arity != columns.size()) {
+    std::cerr << "Error: Incorrect number of arguments passed" << std::endl;
+    return false;
+  }
+  BatchFunction kernel = getBatchFunction(name);
+  if (!kernel) {
+    return false;
+  }
+  kernel(columns.data(), out, static_cast<std::int64_t>(n));
+  return true;
+}
+
+void Driver::compileInBackground(FunctionAST* ast, std::unique_ptr<CompileRecord> record) {
+  Symbol name = ast->getPrototype().getName();
+  cg.addPrototype(ast->getPrototype());
+
+  auto imports = collectImports(*ast);
+  DiskObjectCache* cache = getObjectCache();
+  std::string key;
+  if (cache) {
+    key = cacheKey(*ast, imports);
+    PhaseTimer timer(record.get(), Phase::Emit);
+    if (auto object = cache->load(key)) {
+      if (record) {
+        record->objectBytes += object->getBufferSize();
+      }
+      jit->addObject(std::move(object));
+      commit(std::move(record));
+      return;
+    }
+  }
+
+  CalleeCollector callees;
+  ast::visit(callees, *ast);
+  // Only the callees of the definition itself need to be waited for
+  auto directCallees = callees.getCallees();
+  for (FunctionAST* import : imports) {
+    ast::visit(callees, *import);
+  }
+
+  auto job = std::make_shared<CompileJob>();
+  job->ast = ast;
+  job->imports = std::move(imports);
+  job->cacheKey = std::move(key);
+  job->record = std::move(record);
+  for (Symbol callee : callees.getCallees()) {
+    if (auto args = cg.findPrototype(callee)) {
+      job->prototypes.emplace_back(callee, *args);
+    }
+  }
+  pending[name] = PendingDefinition{job->done.get_future().share(), std::move(directCallees)};
+
+  pool->enqueue([this, job](std::size_t worker) { compileJob(*job, workers[worker]); });
+}
+
+void Driver::compileJob(CompileJob& job, CompileWorker& worker) {
+  for (auto& proto : job.prototypes) {
+    worker.cg->addPrototype(proto.first, proto.second);
+  }
+  CompileRecord* record = job.record.get();
+  bool ok;
+  {
+    PhaseTimer timer(record, Phase::CodeGen);
+    ok = ast::visit(*worker.cg, *job.ast) != nullptr;
+    for (FunctionAST* import : job.imports) {
+      ok = ok && worker.cg->emitImport(*import);
+    }
+  }
+  auto module = worker.cg->takeModule(record);
+  if (!ok) {
+    // Recursive definitions get their own prototype along with the callees
+    worker.cg->removePrototype(job.ast->getPrototype().getName());
+  } else {
+    // Machine code is generated here, the JIT only needs to link it.
+    PhaseTimer timer(record, Phase::Emit);
+    llvm::ObjectCache* cache = nullptr;
+    if (!job.cacheKey.empty()) {
+      module.getModuleUnlocked()->setModuleIdentifier(job.cacheKey);
+      cache = objectCache.get();
+    }
+    auto object = llvm::orc::SimpleCompiler(*worker.tm, cache)(*module.getModuleUnlocked());
+    if (record) {
+      record->objectBytes += object->getBufferSize();
+    }
+    jit->addObject(std::move(object));
+  }
+  commit(std::move(job.record));
+  job.done.set_value(ok);
+}
+
+void Driver::waitForDefinitions(std::vector<Symbol> names) {
+  std::unordered_set<Symbol> seen;
+  while (!names.empty()) {
+    Symbol name = names.back();
+    names.pop_back();
+    if (!seen.insert(name).second) {
+      continue;
+    }
+    auto definition = pending.find(name);
+    if (definition != pending.end()) {
+      finishDefinition(name, definition->second);
+      names.insert(names.end(), definition->second.callees.begin(), definition->second.callees.end());
+    }
+  }
+  for (Symbol name : seen) {
+    pending.erase(name);
+  }
+}
+
+void Driver::finishDefinition(Symbol name, PendingDefinition const& definition) {
+  if (!definition.done.get()) {
+    definitions.erase(name);
+    functions.erase(name);
+    cg.removePrototype(name);
+  }
+}
+
+void Driver::waitForCompilation() {
+  for (auto& definition : pending) {
+    finishDefinition(definition.first, definition.second);
+  }
+  pending.clear();
+}
+
+void Driver::mainLoop(Lexer& lexer) {
+  Parser parser(lexer, arena, symbols);
+  parser.getNextToken();
+  while (true) {
+    out << "ready> ";
+    if (parser.curTok == tok_eof) {
+      return;
+    }
+    handleItem(parser);
+  }
+}
+
+void Driver::mainLoop(ItemReader& reader) {
+  ItemReader::Item item;
+  while (reader.next(item)) {
+    Lexer lexer(item.text);
+    Parser parser(lexer, arena, symbols);
+    parser.getNextToken();
+    // Usually a single item, but e.g. "def f(x) x 1;" is only split at ";"
+    while (parser.curTok != tok_eof) {
+      handleItem(parser);
+    }
+  }
+}
+
+void Driver::loadAst(std::string_view data) {
+  AstReader reader(data, arena, symbols);
+  if (!reader.readHeader()) {
+    return;
+  }
+  while (true) {
+    // The AST of the previous item has been generated and can go.
+    arena.reset();
+    switch (reader.getItemKind()) {
+    case AstItem::End:
+      return;
+    case AstItem::Definition: {
+      auto record = newRecord("");
+      if (auto ast = readItem(reader, &AstReader::readDefinition, getDefinitionArena(), record.get())) {
+        handleDefinition(ast, std::move(record));
+      }
+      break;
+    }
+    case AstItem::Extern:
+      if (auto ast = reader.readExtern()) {
+        handleExtern(ast);
+      }
+      break;
+    case AstItem::TopLevelExpr: {
+      auto record = newRecord("");
+      if (auto ast = readItem(reader, &AstReader::readTopLevelExpr, arena, record.get())) {
+        handleTopLevelExpression(ast, std::move(record));
+      }
+      break;
+    }
+    }
+  }
+}
+
+void Driver::handleItem(Parser& parser) {
+  // The AST of the previous item has been generated and can go.
+  arena.reset();
+  switch (parser.curTok) {
+  case ';': // ignore top-level semicolons.
+    parser.getNextToken();
+    break;
+  case tok_def:
+    parser.setArena(getDefinitionArena());
+    handleDefinition(parser);
+    parser.setArena(arena);
+    break;
+  case tok_extern:
+    handleExtern(parser);
+    break;
+  default:
+    handleTopLevelExpression(parser);
+    break;
+  }
+}
@@ -0,0 +1,257 @@
+#ifndef K_DRIVER_H_
+#define K_DRIVER_H_
+
+#include <future>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "AstReader.h"
+#include "CompileStats.h"
+#include "DiskObjectCache.h"
+#include "ItemReader.h"
+#include "KaleidoscopeJIT.h"
+#include "Parser.h"
+#include "Profile.h"
+#include "ThreadPool.h"
+#include "visitor/CodeGen.h"
+#include "visitor/HashConser.h"
+#include "visitor/Interpreter.h"
+
+class Driver {
+public:
+  /// Evaluates a function for n tuples of arguments; columns[k][i] is the
+  /// k-th argument of the i-th tuple.
+  using BatchFunction = void (*)(double const* const* columns, double* out, std::int64_t n);
+
+private:
+  // Per-thread state of a background compiler
+  struct CompileWorker {
+    std::unique_ptr<llvm::TargetMachine> tm;
+    std::unique_ptr<CodeGen> cg;
+  };
+
+  struct CompileJob {
+    FunctionAST* ast;
+    // Definitions of callees for inlining
+    std::vector<FunctionAST*> imports;
+    // Prototypes of all callees, including those of imports
+    std::vector<std::pair<Symbol, Signature>> prototypes;
+    // Empty if there is no object cache
+    std::string cacheKey;
+    // nullptr unless statistics are enabled
+    std::unique_ptr<CompileRecord> record;
+    // Whether the definition compiled
+    std::promise<bool> done;
+  };
+
+  struct PendingDefinition {
+    std::shared_future<bool> done;
+    std::vector<Symbol> callees;
+  };
+
+  SymbolTable symbols;
+  // Holds the AST of the top-level item currently being processed
+  Arena arena;
+  // Holds the ASTs of all definitions, as they are needed for interpretation
+  // and batch kernels. Nodes never move, hence background compilers may read
+  // them while new definitions are parsed.
+  Arena definitionArena;
+  // Copies definitions into definitionArena, see setHashConsing
+  HashConser conser{definitionArena};
+  bool hashConsing = true;
+  std::unique_ptr<llvm::orc::KaleidoscopeJIT> jit;
+  CodeGen cg;
+  // Batch kernels are compiled for throughput regardless of the opt level
+  Optimizer batchOptimizer;
+  bool lazy = true;
+  bool constantFolding = true;
+  bool interprocedural = false;
+  std::unique_ptr<DiskObjectCache> objectCache;
+  std::unique_ptr<CompileStats> stats;
+  // Kept when profiling is disabled again, as compiled code may still count
+  std::unique_ptr<Profile> profile;
+  unsigned long pgoThreshold = 0;
+  // Functions that were recompiled with their profile
+  std::unordered_set<Symbol> recompiled;
+  std::unordered_map<Symbol, TieredFunction> functions;
+  // Functions with a body; the JIT does not allow redefinitions
+  std::unordered_map<Symbol, FunctionAST*> definitions;
+  std::unordered_map<Symbol, BatchFunction> batchKernels;
+  unsigned long tierUpThreshold = 0;
+  Interpreter interpreter;
+  std::ostream& out;
+  std::vector<CompileWorker> workers;
+  std::unordered_map<Symbol, PendingDefinition> pending;
+  // Declared last such that queued jobs finish before anything else goes
+  std::unique_ptr<::ThreadPool> pool;
+
+  /// Handles the item starting at the current token.
+  void handleItem(Parser& parser);
+  void handleDefinition(Parser& parser);
+  void handleExtern(Parser& parser);
+  void handleTopLevelExpression(Parser& parser);
+  /// Same as above, for items that were already parsed.
+  void handleDefinition(FunctionAST* ast, std::unique_ptr<CompileRecord> record);
+  void handleExtern(PrototypeAST* ast);
+  void handleTopLevelExpression(FunctionAST* ast, std::unique_ptr<CompileRecord> record);
+  /// Releases the arrays of a top-level expression and prints its result,
+  /// or the bounds error it ran into.
+  void reportResult(bool evaluated, double result);
+
+  /// nullptr unless statistics are enabled, hence records cost nothing
+  /// otherwise.
+  std::unique_ptr<CompileRecord> newRecord(std::string name);
+  void commit(std::unique_ptr<CompileRecord> record);
+  /// Parses and simplifies an item with parse, which allocates from nodes.
+  FunctionAST* parseItem(Parser& parser, FunctionAST* (Parser::*parse)(), Arena& nodes,
+                         CompileRecord* record);
+  /// Same as parseItem, for items of a binary AST.
+  FunctionAST* readItem(AstReader& reader, FunctionAST* (AstReader::*read)(), Arena& nodes,
+                        CompileRecord* record);
+  /// Counts the nodes of ast and simplifies it, see parseItem.
+  FunctionAST* prepareItem(FunctionAST* ast, Arena& nodes, CompileRecord* record);
+  /// Where definitions are parsed to; the scratch arena if they are copied
+  /// to definitionArena by the conser afterwards.
+  Arena& getDefinitionArena();
+
+  /// nullptr while profiling, as instrumented code refers to counters of
+  /// this process.
+  DiskObjectCache* getObjectCache() const;
+  /// Compiles a definition on the calling thread, or loads it from the cache.
+  bool compileDefinition(FunctionAST& ast, CompileRecord* record);
+  /// Digest of everything the object code of ast depends on.
+  std::string cacheKey(FunctionAST& ast, std::vector<FunctionAST*> const& imports);
+  /// Definitions that are emitted alongside ast for inlining; empty unless
+  /// interprocedural optimization is enabled.
+  std::vector<FunctionAST*> collectImports(FunctionAST& ast);
+
+  NativeFunction tierUp(Symbol name);
+  /// Compiled code can only call compiled code, hence interpreted callees of
+  /// code that cannot be interpreted are compiled first.
+  bool tierUpCallees(FunctionAST& ast);
+  BatchFunction compileBatch(Symbol name);
+  /// Recompiles the functions called more often than pgoThreshold with
+  /// their profile, see setProfileGuidedThreshold.
+  void recompileHot();
+
+  void compileInBackground(FunctionAST* ast, std::unique_ptr<CompileRecord> record);
+  void compileJob(CompileJob& job, CompileWorker& worker);
+  /// Blocks until the given functions and everything they call are compiled.
+  void waitForDefinitions(std::vector<Symbol> names);
+  /// Waits for a pending definition and forgets it if it failed to compile,
+  /// as the synchronous path does.
+  void finishDefinition(Symbol name, PendingDefinition const& definition);
+
+public:
+  /// Requires the native target to be initialized.
+  explicit Driver(std::ostream& out, OptLevel optLevel = OptLevel::O1);
+
+  /// Applies to all definitions compiled from now on.
+  void setOptLevel(OptLevel level);
+
+  /// With lazy compilation (the default) a compiled definition is only
+  /// turned into machine code when it is called for the first time.
+  void setLazyCompilation(bool enabled);
+
+  /// See CodeGen::setFastMath.
+  void setFastMath(bool enabled);
+
+  /// See CodeGen::setIntegerLoops.
+  void setIntegerLoops(bool enabled);
+
+  /// Retains the definitions of all functions, such that a function's callees
+  /// are emitted into its module and can be inlined. Interprocedural passes
+  /// are added to O1. Has no effect at O0.
+  void setInterprocedural(bool enabled);
+
+  /// Simplifies definitions and expressions with Simplifier before they
+  /// are compiled or interpreted. Enabled by default.
+  void setConstantFolding(bool enabled);
+
+  /// Hash-conses definitions after simplification, i.e. structurally equal
+  /// pure subtrees of all definitions are stored once, see HashConser, and
+  /// each is emitted once per block where possible, see
+  /// CodeGen::setSharing. Enabled by default.
+  void setHashConsing(bool enabled);
+
+  /// Records per top-level item how long each compile phase and pass takes,
+  /// and counts tokens, AST nodes, instructions before and after
+  /// optimization and bytes of object code. Off by default.
+  void setStatistics(bool enabled);
+  /// nullptr unless statistics are enabled.
+  CompileStats const* getStatistics() const { return stats.get(); }
+
+  /// Instruments all definitions compiled from now on, see
+  /// CodeGen::setInstrumentation. Interpreted code is not counted. Off by
+  /// default.
+  void setProfiling(bool enabled);
+  /// nullptr unless profiling was ever enabled.
+  Profile const* getProfile() const { return profile.get(); }
+
+  /// With a threshold > 0, profiling is enabled and after every top-level
+  /// expression, each function that has been called more often than
+  /// threshold is recompiled once with its profile as branch weights and
+  /// entry count, see CodeGen::setFeedback. New callers get the recompiled
+  /// version, code compiled before keeps calling the instrumented one.
+  void setProfileGuidedThreshold(unsigned long calls);
+
+  /// Compiled definitions are stored in and loaded from directory, which
+  /// skips code generation and optimization of unchanged definitions.
+  /// Definitions are compiled eagerly when they are not in the cache yet.
+  void setCacheDirectory(std::string const& directory);
+
+  /// With a threshold of 0 every definition is compiled right away.
+  /// Otherwise definitions and top-level expressions are interpreted and a
+  /// function is compiled once it has been called more often than threshold.
+  void setTierUpThreshold(unsigned long calls);
+
+  /// With threads > 0, definitions are compiled concurrently in the
+  /// background (only if they are not interpreted first). Callers block only
+  /// when they need a function which is still being compiled.
+  void setCompileThreads(unsigned threads);
+
+  /// Number of threads running parallel loops, including the thread that
+  /// starts a loop. Defaults to the number of hardware threads.
+  void setParallelThreads(unsigned threads);
+
+  /// Blocks until all background compilation has finished.
+  void waitForCompilation();
+
+  /// Address of the compiled function name, which has the signature
+  /// double(double, ...), or nullptr if the function is not known. Arrays
+  /// are passed and returned as Array*; arrays created by the function stay
+  /// valid until the next top-level expression.
+  void* lookupFunction(std::string_view name);
+
+  /// Returns a kernel that evaluates name over whole arrays, compiling it on
+  /// first use. The function body is inlined into the loop, which is then
+  /// optimized at O3 and may be vectorized. Returns nullptr on error.
+  BatchFunction getBatchFunction(std::string_view name);
+
+  /// Evaluates name for n tuples of arguments and writes the results to out.
+  /// columns must hold one array of n elements per argument.
+  bool evaluateBatch(std::string_view name, std::vector<double const*> const& columns,
+                     double* out, std::size_t n);
+
+  /// top ::= definition | external | expression | ';'
+  void mainLoop(Lexer& lexer);
+
+  /// Handles every item as soon as it is complete, until all streams of
+  /// reader have ended. A malformed item is skipped up to the next ";",
+  /// "def" or "extern", see Parser::synchronize.
+  void mainLoop(ItemReader& reader);
+
+  /// Handles every item of a binary AST written by AstWriter, e.g. a
+  /// memory-mapped file, without lexing or parsing. Stops at the first
+  /// malformed item, as there is no way to resync.
+  void loadAst(std::string_view data);
+};
+
+#endif
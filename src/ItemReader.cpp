@@ -0,0 +1,97 @@
+#include "ItemReader.h"
+
+#include <cctype>
+#include <string_view>
+#include <utility>
+
+ItemReader::~ItemReader() {
+  for (auto& reader : readers) {
+    reader.join();
+  }
+}
+
+void ItemReader::addStream(std::istream& in) {
+  std::lock_guard<std::mutex> lock(mutex);
+  ++openStreams;
+  std::size_t stream = readers.size();
+  readers.emplace_back([this, &in, stream] { read(in, stream); });
+}
+
+bool ItemReader::next(Item& item) {
+  std::unique_lock<std::mutex> lock(mutex);
+  arrived.wait(lock, [this] { return !items.empty() || openStreams == 0; });
+  if (items.empty()) {
+    return false;
+  }
+  item = std::move(items.front());
+  items.pop_front();
+  return true;
+}
+
+void ItemReader::push(std::string& text, std::size_t stream) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    items.push_back(Item{std::move(text), stream, Clock::now()});
+  }
+  arrived.notify_one();
+  text.clear();
+}
+
+// Splits the stream the way Lexer tokenizes it, such that ";", "def" and
+// "extern" in comments or inside identifiers do not end an item.
+void ItemReader::read(std::istream& in, std::size_t stream) {
+  std::string text;
+  // Whether text holds a token before the current word
+  bool hasContent = false;
+  bool inComment = false;
+  std::size_t wordStart = std::string::npos;
+  auto endWord = [&] {
+    std::string_view word(text.data() + wordStart, text.size() - wordStart);
+    if ((word == "def" || word == "extern") && hasContent) {
+      std::string keyword(word);
+      text.resize(wordStart);
+      push(text, stream);
+      text = std::move(keyword);
+    }
+    wordStart = std::string::npos;
+    hasContent = true;
+  };
+
+  char c;
+  while (in.get(c)) {
+    unsigned char uc = static_cast<unsigned char>(c);
+    if (inComment) {
+      text += c;
+      inComment = c != '\n' && c != '\r';
+      continue;
+    }
+    if (wordStart != std::string::npos && !std::isalnum(uc)) {
+      endWord();
+    }
+    if (c == '#') {
+      inComment = true;
+    } else if (wordStart == std::string::npos && std::isalpha(uc)) {
+      wordStart = text.size();
+    } else if (wordStart == std::string::npos && !std::isspace(uc)) {
+      hasContent = true;
+    }
+    text += c;
+    if (c == ';') {
+      push(text, stream);
+      hasContent = false;
+    }
+  }
+  if (wordStart != std::string::npos) {
+    endWord();
+  }
+  // Trailing whitespace and comments are no item
+  if (hasContent) {
+    push(text, stream);
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    --openStreams;
+  }
+  arrived.notify_all();
+}
@@ -0,0 +1,58 @@
+#ifndef K_ITEMREADER_H_
+#define K_ITEMREADER_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <istream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/// Reads top-level items from any number of streams concurrently, one thread
+/// per stream, and hands out each item as soon as it is complete. An item
+/// ends after a ";" or where a "def" or "extern" starts, hence it is complete
+/// without reading ahead any further than the parser would. Items of one
+/// stream keep their order; items of different streams are interleaved in
+/// the order they arrive.
+class ItemReader {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  struct Item {
+    std::string text;
+    // Index of the stream, in the order of addStream
+    std::size_t stream;
+    // When the item was complete
+    Clock::time_point arrival;
+  };
+
+private:
+  std::vector<std::thread> readers;
+  std::deque<Item> items;
+  std::mutex mutex;
+  std::condition_variable arrived;
+  std::size_t openStreams = 0;
+
+  void read(std::istream& in, std::size_t stream);
+  void push(std::string& text, std::size_t stream);
+
+public:
+  ItemReader() = default;
+  /// Waits for all streams to end.
+  ~ItemReader();
+
+  ItemReader(ItemReader const&) = delete;
+  ItemReader& operator=(ItemReader const&) = delete;
+
+  /// Starts reading in; the stream must outlive the reader.
+  void addStream(std::istream& in);
+
+  /// Blocks until the next item is complete. False once all streams have
+  /// ended and all items have been taken.
+  bool next(Item& item);
+};
+
+#endif
@@ -13,124 +13,157 @@
 #ifndef LLVM_EXECUTIONENGINE_ORC_KALEIDOSCOPEJIT_H
 #define LLVM_EXECUTIONENGINE_ORC_KALEIDOSCOPEJIT_H
 
-#include "llvm/ADT/STLExtras.h"
-#include "llvm/ADT/iterator_range.h"
-#include "llvm/ExecutionEngine/ExecutionEngine.h"
+#include "llvm/ADT/StringRef.h"
 #include "llvm/ExecutionEngine/JITSymbol.h"
 #include "llvm/ExecutionEngine/Orc/CompileUtils.h"
-#include "llvm/ExecutionEngine/Orc/IRCompileLayer.h"
-#include "llvm/ExecutionEngine/Orc/LambdaResolver.h"
-#include "llvm/ExecutionEngine/Orc/RTDyldObjectLinkingLayer.h"
-#include "llvm/ExecutionEngine/RTDyldMemoryManager.h"
+#include "llvm/ExecutionEngine/Orc/Core.h"
+#include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
+#include "llvm/ExecutionEngine/Orc/JITTargetMachineBuilder.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
+#include "llvm/ExecutionEngine/RuntimeDyld.h"
 #include "llvm/ExecutionEngine/SectionMemoryManager.h"
 #include "llvm/IR/DataLayout.h"
-#include "llvm/IR/Mangler.h"
-#include "llvm/Support/DynamicLibrary.h"
+#include "llvm/Object/ObjectFile.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/raw_ostream.h"
 #include "llvm/Target/TargetMachine.h"
-#include <algorithm>
-#include <map>
 #include <memory>
 #include <string>
-#include <vector>
 
 namespace llvm {
 namespace orc {
 
+/// Thin wrapper around LLLazyJIT. Modules added with addLazyModule are only
+/// compiled once one of their functions is called for the first time, so
+/// adding a definition is cheap and definitions that are never called are
+/// never compiled. ORCv2 is thread-safe, hence no external locking is needed.
 class KaleidoscopeJIT {
 public:
-  using ObjLayerT = LegacyRTDyldObjectLinkingLayer;
-  using CompileLayerT = LegacyIRCompileLayer<ObjLayerT, SimpleCompiler>;
-
   KaleidoscopeJIT()
-      : Resolver(createLegacyLookupResolver(
-            ES,
-            [this](const std::string &Name) { return findMangledSymbol(Name); },
-            [](Error Err) { cantFail(std::move(Err), "lookupFlags failed"); })),
-        TM(EngineBuilder().selectTarget()), DL(TM->createDataLayout()),
-        ObjectLayer(AcknowledgeORCv1Deprecation, ES,
-                    [this](VModuleKey) {
-                      return ObjLayerT::Resources{
-                          std::make_shared<SectionMemoryManager>(), Resolver};
-                    }),
-        CompileLayer(AcknowledgeORCv1Deprecation, ObjectLayer,
-                     SimpleCompiler(*TM)) {
-    llvm::sys::DynamicLibrary::LoadLibraryPermanently(nullptr);
+      : JTMB(cantFail(JITTargetMachineBuilder::detectHost())),
+        TM(cantFail(JTMB.createTargetMachine())),
+        J(cantFail(LLLazyJITBuilder().setJITTargetMachineBuilder(JTMB).create())) {
+    // Resolve externs (e.g. sin, putchard) against the host process.
+    J->getMainJITDylib().addGenerator(cantFail(
+        DynamicLibrarySearchGenerator::GetForCurrentProcess(J->getDataLayout().getGlobalPrefix())));
   }
 
   TargetMachine &getTargetMachine() { return *TM; }
 
-  VModuleKey addModule(std::unique_ptr<Module> M) {
-    auto K = ES.allocateVModule();
-    cantFail(CompileLayer.addModule(K, std::move(M)));
-    ModuleKeys.push_back(K);
-    return K;
+  /// Target machines must not be shared between threads; this creates
+  /// another one for the host, e.g. for a background compiler.
+  std::unique_ptr<TargetMachine> createTargetMachine() {
+    return cantFail(JTMB.createTargetMachine());
   }
 
-  void removeModule(VModuleKey K) {
-    ModuleKeys.erase(find(ModuleKeys, K));
-    cantFail(CompileLayer.removeModule(K));
+  /// The module's functions are compiled on first call.
+  void addLazyModule(ThreadSafeModule M) {
+    cantFail(J->addLazyIRModule(std::move(M)));
   }
 
-  JITSymbol findSymbol(const std::string Name) {
-    return findMangledSymbol(mangle(Name));
+  /// The module is compiled as soon as one of its symbols is looked up.
+  void addModule(ThreadSafeModule M) {
+    cantFail(J->addIRModule(std::move(M)));
   }
 
-private:
-  std::string mangle(const std::string &Name) {
-    std::string MangledName;
-    {
-      raw_string_ostream MangledNameStream(MangledName);
-      Mangler::getNameWithPrefix(MangledNameStream, Name, DL);
+  /// Adds an object file that was compiled elsewhere, e.g. on another thread.
+  void addObject(std::unique_ptr<MemoryBuffer> Obj) {
+    cantFail(J->addObjectFile(std::move(Obj)));
+  }
+
+  /// Makes Name available for redefinition. The memory backing the symbol is
+  /// not released, as ORC cannot free individual modules yet. Failing to
+  /// remove a symbol, e.g. one whose compilation failed, is reported rather
+  /// than fatal.
+  void removeSymbol(StringRef Name) {
+    if (auto Err = J->getMainJITDylib().remove({J->mangleAndIntern(Name)})) {
+      logAllUnhandledErrors(std::move(Err), errs(), "Error: ");
     }
-    return MangledName;
   }
 
-  JITSymbol findMangledSymbol(const std::string &Name) {
-#ifdef _WIN32
-    // The symbol lookup of ObjectLinkingLayer uses the SymbolRef::SF_Exported
-    // flag to decide whether a symbol will be visible or not, when we call
-    // IRCompileLayer::findSymbolIn with ExportedSymbolsOnly set to true.
-    //
-    // But for Windows COFF objects, this flag is currently never set.
-    // For a potential solution see: https://reviews.llvm.org/rL258665
-    // For now, we allow non-exported symbols on Windows as a workaround.
-    const bool ExportedSymbolsOnly = false;
-#else
-    const bool ExportedSymbolsOnly = true;
-#endif
-
-    // Search modules in reverse order: from last added to first added.
-    // This is the opposite of the usual search order for dlsym, but makes more
-    // sense in a REPL where we want to bind to the newest available definition.
-    for (auto H : make_range(ModuleKeys.rbegin(), ModuleKeys.rend()))
-      if (auto Sym = CompileLayer.findSymbolIn(H, Name, ExportedSymbolsOnly))
-        return Sym;
-
-    // If we can't find the symbol in the JIT, try looking in the host process.
-    if (auto SymAddr = RTDyldMemoryManager::getSymbolAddressInProcess(Name))
-      return JITSymbol(SymAddr, JITSymbolFlags::Exported);
-
-#ifdef _WIN32
-    // For Windows retry without "_" at beginning, as RTDyldMemoryManager uses
-    // GetProcAddress and standard libraries like msvcrt.dll use names
-    // with and without "_" (for example "_itoa" but "sin").
-    if (Name.length() > 2 && Name[0] == '_')
-      if (auto SymAddr =
-              RTDyldMemoryManager::getSymbolAddressInProcess(Name.substr(1)))
-        return JITSymbol(SymAddr, JITSymbolFlags::Exported);
-#endif
-
-    return nullptr;
+  /// Defines Name as a function of the host process, e.g. a runtime entry
+  /// point that is not exported from the executable.
+  void addSymbol(StringRef Name, void *Address) {
+    cantFail(J->getMainJITDylib().define(absoluteSymbols(
+        {{J->mangleAndIntern(Name),
+          JITEvaluatedSymbol(pointerToJITTargetAddress(Address),
+                             JITSymbolFlags::Exported | JITSymbolFlags::Callable)}})));
   }
 
-  ExecutionSession ES;
-  std::shared_ptr<SymbolResolver> Resolver;
+  Expected<JITEvaluatedSymbol> lookup(StringRef Name) {
+    return J->lookup(Name);
+  }
+
+  /// Object code linked into memory of its own rather than into the JIT.
+  /// The memory is released with the object, which ORC cannot do for
+  /// modules in a JITDylib, hence this is for code that runs once.
+  class TransientObject {
+  public:
+    TransientObject(ExecutionSession &ES, JITDylib &JD, char GlobalPrefix)
+        : Resolver(ES, JD), Dyld(MemMgr, Resolver), GlobalPrefix(GlobalPrefix) {}
+
+    /// Address of the unmangled Name, or 0 if it is not defined.
+    JITTargetAddress getAddress(StringRef Name) {
+      std::string Mangled = GlobalPrefix ? std::string(1, GlobalPrefix) : std::string();
+      Mangled += Name.str();
+      return Dyld.getSymbol(Mangled).getAddress();
+    }
+
+  private:
+    friend class KaleidoscopeJIT;
+
+    // Undefined symbols, which are mangled already, resolve against JD
+    class JITResolver : public LegacyJITSymbolResolver {
+    public:
+      JITResolver(ExecutionSession &ES, JITDylib &JD) : ES(ES), JD(JD) {}
+
+      JITSymbol findSymbol(const std::string &Name) override {
+        auto Sym = ES.lookup({&JD}, Name);
+        if (!Sym) {
+          return Sym.takeError();
+        }
+        return JITSymbol(Sym->getAddress(), Sym->getFlags());
+      }
+      JITSymbol findSymbolInLogicalDylib(const std::string &) override {
+        return nullptr;
+      }
+
+    private:
+      ExecutionSession &ES;
+      JITDylib &JD;
+    };
+
+    SectionMemoryManager MemMgr;
+    JITResolver Resolver;
+    std::unique_ptr<MemoryBuffer> Obj;
+    RuntimeDyld Dyld;
+    char GlobalPrefix;
+  };
+
+  /// Links Obj right away, see TransientObject. Fails e.g. if a symbol it
+  /// refers to cannot be resolved.
+  Expected<std::unique_ptr<TransientObject>> addTransientObject(std::unique_ptr<MemoryBuffer> Obj) {
+    auto Result = std::make_unique<TransientObject>(J->getExecutionSession(), J->getMainJITDylib(),
+                                                    J->getDataLayout().getGlobalPrefix());
+    auto File = object::ObjectFile::createObjectFile(Obj->getMemBufferRef());
+    if (!File) {
+      return File.takeError();
+    }
+    Result->Obj = std::move(Obj);
+    Result->Dyld.loadObject(**File);
+    Result->Dyld.finalizeWithMemoryManagerLocking();
+    if (Result->Dyld.hasError()) {
+      return make_error<StringError>(Result->Dyld.getErrorString(), inconvertibleErrorCode());
+    }
+    return Result;
+  }
+
+private:
+  JITTargetMachineBuilder JTMB;
   std::unique_ptr<TargetMachine> TM;
-  const DataLayout DL;
-  ObjLayerT ObjectLayer;
-  CompileLayerT CompileLayer;
-  std::vector<VModuleKey> ModuleKeys;
+  std::unique_ptr<LLLazyJIT> J;
 };
 
 } // end namespace orc
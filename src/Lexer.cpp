@@ -1,62 +1,72 @@
 #include "Lexer.h"
-#include <sstream>
+#include <charconv>
 
-int Lexer::getToken() {
+static int getKeywordOrIdentifier(std::string_view id) {
+  switch (id[0]) {
+    case 'd':
+      return id == "def" ? tok_def : tok_identifier;
+    case 'e':
+      if (id == "else") {
+        return tok_else;
+      }
+      return id == "extern" ? tok_extern : tok_identifier;
+    case 'f':
+      return id == "for" ? tok_for : tok_identifier;
+    case 'i':
+      if (id == "if") {
+        return tok_if;
+      }
+      return id == "in" ? tok_in : tok_identifier;
+    case 'p':
+      return id == "parfor" ? tok_parfor : tok_identifier;
+    case 't':
+      return id == "then" ? tok_then : tok_identifier;
+    case 'v':
+      return id == "var" ? tok_var : tok_identifier;
+    default:
+      return tok_identifier;
+  }
+}
+
+static double parseNumber(char const* first, char const* last) {
+  double value = 0.0;
+  std::from_chars(first, last, value);
+  return value;
+}
+
+int Lexer::getTokenFromStream() {
   while (isspace(lastChar)) {
-    in.get(lastChar);
+    advance();
   }
 
   if (isalpha(lastChar)) {
-    identifier.clear();
+    text.clear();
     do {
-      identifier += lastChar;
-      in.get(lastChar);
+      text += lastChar;
+      advance();
     } while (isalnum(lastChar));
 
-    if (identifier == "def") {
-      return tok_def;
-    }
-    if (identifier == "extern") {
-      return tok_extern;
-    }
-    if (identifier == "if") {
-      return tok_if;
-    }
-    if (identifier == "then") {
-      return tok_then;
-    }
-    if (identifier == "else") {
-      return tok_else;
-    }
-    if (identifier == "for") {
-      return tok_for;
-    }
-    if (identifier == "in") {
-      return tok_in;
-    }
-    if (identifier == "var") {
-      return tok_var;
-    }
-    return tok_identifier;
+    identifier = text;
+    return getKeywordOrIdentifier(identifier);
   }
 
   if (isdigit(lastChar) || lastChar == '.') {
-    std::stringstream value;
+    text.clear();
     do {
-      value << lastChar;
-      in.get(lastChar);
+      text += lastChar;
+      advance();
     } while (isdigit(lastChar) || lastChar == '.');
-    value >> numericValue;
+    numericValue = parseNumber(text.data(), text.data() + text.size());
     return tok_number;
   }
 
   if (lastChar == '#') {
     do {
-      in.get(lastChar);
+      advance();
     } while (lastChar != EOF && lastChar != '\n' && lastChar != '\r');
 
     if (lastChar != EOF) {
-      return getToken();
+      return getTokenFromStream();
     }
   }
 
@@ -65,6 +75,43 @@ int Lexer::getToken() {
   }
 
   int thisChar = lastChar;
-  in.get(lastChar);
+  advance();
   return thisChar;
 }
+
+int Lexer::getTokenFromBuffer() {
+  while (true) {
+    while (cur != end && isspace(static_cast<unsigned char>(*cur))) {
+      ++cur;
+    }
+    if (cur == end) {
+      return tok_eof;
+    }
+    if (*cur != '#') {
+      break;
+    }
+    while (cur != end && *cur != '\n' && *cur != '\r') {
+      ++cur;
+    }
+  }
+
+  char const* start = cur;
+  if (isalpha(static_cast<unsigned char>(*cur))) {
+    do {
+      ++cur;
+    } while (cur != end && isalnum(static_cast<unsigned char>(*cur)));
+
+    identifier = std::string_view(start, cur - start);
+    return getKeywordOrIdentifier(identifier);
+  }
+
+  if (isdigit(static_cast<unsigned char>(*cur)) || *cur == '.') {
+    do {
+      ++cur;
+    } while (cur != end && (isdigit(static_cast<unsigned char>(*cur)) || *cur == '.'));
+    numericValue = parseNumber(start, cur);
+    return tok_number;
+  }
+
+  return *cur++;
+}
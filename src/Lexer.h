@@ -2,9 +2,10 @@
 #define K_LEXER_H_
 
 #include <cctype>
+#include <cstdio>
 #include <string>
+#include <string_view>
 #include <istream>
-#include <unordered_map>
 
 enum Token {
   tok_eof = -1,
@@ -17,23 +18,54 @@ enum Token {
   tok_else = -8,
   tok_for = -9,
   tok_in = -10,
-  tok_var = -11
+  tok_var = -11,
+  tok_parfor = -12
 };
 
+/// Tokenizes either an input stream (character by character, e.g. for an
+/// interactive session) or a contiguous buffer that outlives the lexer
+/// (e.g. a memory-mapped file). In buffer mode identifiers are slices of the
+/// buffer and no copies are made.
 class Lexer {
 private:
-  std::string identifier;
-  double numericValue;
+  // Stream mode
+  std::istream* in = nullptr;
+  std::string text;
   char lastChar = ' ';
-  std::istream& in;
+
+  // Buffer mode
+  char const* cur = nullptr;
+  char const* end = nullptr;
+
+  std::string_view identifier;
+  double numericValue;
+  std::size_t numTokens = 0;
+
+  void advance() {
+    if (!in->get(lastChar)) {
+      lastChar = EOF;
+    }
+  }
+
+  int getTokenFromStream();
+  int getTokenFromBuffer();
 
 public:
   explicit Lexer(std::istream& in)
-    : in(in) {}
+    : in(&in) {}
+
+  explicit Lexer(std::string_view buffer)
+    : cur(buffer.data()), end(buffer.data() + buffer.size()) {}
 
-  int getToken();
+  int getToken() {
+    ++numTokens;
+    return in ? getTokenFromStream() : getTokenFromBuffer();
+  }
+  /// Number of tokens returned so far, including tok_eof.
+  std::size_t getNumTokens() const { return numTokens; }
   double getNumericValue() const { return numericValue; }
-  std::string getIdentifier() const { return identifier; }
+  /// Valid until the next call to getToken.
+  std::string_view getIdentifier() const { return identifier; }
 };
 
 #endif
@@ -0,0 +1,136 @@
+#include "Optimizer.h"
+
+#include "llvm/Analysis/CGSCCPassManager.h"
+#include "llvm/Transforms/IPO/DeadArgumentElimination.h"
+#include "llvm/Transforms/IPO/ElimAvailExtern.h"
+#include "llvm/Transforms/IPO/GlobalDCE.h"
+#include "llvm/Transforms/IPO/Inliner.h"
+#include "llvm/Transforms/IPO/SCCP.h"
+#include "llvm/Transforms/InstCombine/InstCombine.h"
+#include "llvm/Transforms/Scalar/GVN.h"
+#include "llvm/Transforms/Scalar/Reassociate.h"
+#include "llvm/Transforms/Scalar/SimplifyCFG.h"
+#include "llvm/Transforms/Scalar/TailRecursionElimination.h"
+#include "llvm/Transforms/Utils/Mem2Reg.h"
+
+using namespace llvm;
+
+Optimizer::Optimizer(OptLevel level, TargetMachine* tm)
+  : level(level), pb(tm, PipelineTuningOptions(), None, &instrumentation) {
+  registerInstrumentation();
+  buildPipeline();
+}
+
+void Optimizer::registerInstrumentation() {
+  // Pass managers and adaptors are reported as passes, too; only the passes
+  // they run are recorded
+  auto isContainer = [](StringRef name) {
+    return name.contains("PassManager") || name.contains("PassAdaptor");
+  };
+  instrumentation.registerBeforePassCallback([this, isContainer](StringRef name, Any) {
+    if (record && !isContainer(name)) {
+      runningPasses.emplace_back(name.str(), std::chrono::steady_clock::now());
+    }
+    return true;
+  });
+  auto finish = [this, isContainer](StringRef name) {
+    if (record && !isContainer(name) && !runningPasses.empty()) {
+      auto now = std::chrono::steady_clock::now();
+      record->passes[runningPasses.back().first] +=
+          std::chrono::duration<double>(now - runningPasses.back().second).count();
+      runningPasses.pop_back();
+    }
+  };
+  instrumentation.registerAfterPassCallback([finish](StringRef name, Any) { finish(name); });
+  instrumentation.registerAfterPassInvalidatedCallback([finish](StringRef name) { finish(name); });
+}
+
+static std::uint64_t countInstructions(Module& module) {
+  std::uint64_t count = 0;
+  for (Function& f : module) {
+    count += f.getInstructionCount();
+  }
+  return count;
+}
+
+void Optimizer::setInterprocedural(bool enabled) {
+  if (enabled != interprocedural) {
+    interprocedural = enabled;
+    buildPipeline();
+  }
+}
+
+void Optimizer::setLevel(OptLevel newLevel) {
+  if (newLevel != level) {
+    level = newLevel;
+    buildPipeline();
+  }
+}
+
+void Optimizer::buildPipeline() {
+  switch (level) {
+    case OptLevel::O0:
+      mpm = ModulePassManager();
+      break;
+    case OptLevel::O1: {
+      auto simplify = [] {
+        FunctionPassManager fpm;
+        fpm.addPass(PromotePass());
+        fpm.addPass(InstCombinePass());
+        fpm.addPass(ReassociatePass());
+        fpm.addPass(GVN());
+        fpm.addPass(SimplifyCFGPass());
+        fpm.addPass(TailCallElimPass());
+        return fpm;
+      };
+      mpm = ModulePassManager();
+      mpm.addPass(createModuleToFunctionPassAdaptor(simplify()));
+      if (interprocedural) {
+        // Imported callees are simplified above, inlined bottom-up and
+        // stripped afterwards, see CodeGen::emitImport
+        mpm.addPass(IPSCCPPass());
+        mpm.addPass(createModuleToPostOrderCGSCCPassAdaptor(InlinerPass()));
+        mpm.addPass(DeadArgumentEliminationPass());
+        mpm.addPass(createModuleToFunctionPassAdaptor(simplify()));
+        mpm.addPass(EliminateAvailableExternallyPass());
+        mpm.addPass(GlobalDCEPass());
+      }
+      break;
+    }
+    case OptLevel::O2:
+      mpm = pb.buildPerModuleDefaultPipeline(PassBuilder::OptimizationLevel::O2);
+      break;
+    case OptLevel::O3:
+      mpm = pb.buildPerModuleDefaultPipeline(PassBuilder::OptimizationLevel::O3);
+      break;
+  }
+}
+
+void Optimizer::run(Module& module, CompileRecord* record) {
+  if (record) {
+    record->instructionsBefore += countInstructions(module);
+  }
+  if (level != OptLevel::O0) {
+    PhaseTimer timer(record, Phase::Optimize);
+    this->record = record;
+
+    // Analysis results refer to the IR they were computed on, hence the
+    // analysis managers only live as long as a single run.
+    LoopAnalysisManager lam;
+    FunctionAnalysisManager fam;
+    CGSCCAnalysisManager cgam;
+    ModuleAnalysisManager mam;
+    pb.registerModuleAnalyses(mam);
+    pb.registerCGSCCAnalyses(cgam);
+    pb.registerFunctionAnalyses(fam);
+    pb.registerLoopAnalyses(lam);
+    pb.crossRegisterProxies(lam, fam, cgam, mam);
+
+    mpm.run(module, mam);
+    this->record = nullptr;
+    runningPasses.clear();
+  }
+  if (record) {
+    record->instructionsAfter += countInstructions(module);
+  }
+}
@@ -0,0 +1,58 @@
+#ifndef K_OPTIMIZER_H_
+#define K_OPTIMIZER_H_
+
+#include <chrono>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "llvm/IR/Module.h"
+#include "llvm/IR/PassInstrumentation.h"
+#include "llvm/IR/PassManager.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Target/TargetMachine.h"
+
+#include "CompileStats.h"
+
+enum class OptLevel {
+  O0, // no passes, lowest compile latency
+  O1, // mem2reg, instcombine, reassociate, GVN, simplifycfg and tailcallelim
+      // per function, plus inlining, IPSCCP and dead argument elimination if
+      // interprocedural
+  O2, // default module pipeline, includes inlining and vectorization
+  O3
+};
+
+/// Runs an optimization pipeline of the new pass manager on whole modules.
+class Optimizer {
+private:
+  OptLevel level;
+  bool interprocedural = false;
+  // Times passes into record during run, see PhaseTimer
+  llvm::PassInstrumentationCallbacks instrumentation;
+  CompileRecord* record = nullptr;
+  std::vector<std::pair<std::string, std::chrono::steady_clock::time_point>> runningPasses;
+  llvm::PassBuilder pb;
+  llvm::ModulePassManager mpm;
+
+  void buildPipeline();
+  void registerInstrumentation();
+
+public:
+  /// The target machine is optional and only used for cost modelling.
+  explicit Optimizer(OptLevel level = OptLevel::O1, llvm::TargetMachine* tm = nullptr);
+
+  OptLevel getLevel() const { return level; }
+  void setLevel(OptLevel newLevel);
+
+  /// Adds module-level passes to O1 that work across the functions of a
+  /// module, above all inlining. O2 and O3 run them anyway.
+  bool isInterprocedural() const { return interprocedural; }
+  void setInterprocedural(bool enabled);
+
+  /// Adds the optimization time, the time per pass and the number of
+  /// instructions before and after to record unless it is nullptr.
+  void run(llvm::Module& module, CompileRecord* record = nullptr);
+};
+
+#endif
@@ -0,0 +1,179 @@
+#include "ParallelRuntime.h"
+#include <algorithm>
+
+namespace {
+// Set while the thread executes chunks of a loop
+thread_local bool insideLoop = false;
+}
+
+ParallelRuntime::ParallelRuntime()
+  : numThreads(std::max(1u, std::thread::hardware_concurrency())) {}
+
+ParallelRuntime::~ParallelRuntime() {
+  stopWorkers();
+}
+
+ParallelRuntime& ParallelRuntime::get() {
+  static ParallelRuntime runtime;
+  return runtime;
+}
+
+void ParallelRuntime::setNumThreads(unsigned threads) {
+  std::lock_guard<std::mutex> loopLock(loopMutex);
+  stopWorkers();
+  numThreads = std::max(1u, threads);
+}
+
+void ParallelRuntime::startWorkers() {
+  queues.clear();
+  for (unsigned i = 0; i < numThreads; ++i) {
+    queues.push_back(std::make_unique<Queue>());
+  }
+  stopping = false;
+  for (unsigned i = 1; i < numThreads; ++i) {
+    workers.emplace_back([this, i] { work(i); });
+  }
+}
+
+void ParallelRuntime::stopWorkers() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+  wakeUp.notify_all();
+  for (auto& worker : workers) {
+    worker.join();
+  }
+  workers.clear();
+}
+
+void ParallelRuntime::work(unsigned index) {
+  insideLoop = true;
+  unsigned long seen = 0;
+  while (true) {
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      wakeUp.wait(lock, [&] { return stopping || (open && generation != seen); });
+      if (stopping) {
+        return;
+      }
+      seen = generation;
+      ++active;
+    }
+    participate(index);
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (--active == 0) {
+        finished.notify_all();
+      }
+    }
+  }
+}
+
+bool ParallelRuntime::pop(unsigned index, Range& range) {
+  Queue& queue = *queues[index];
+  std::lock_guard<std::mutex> lock(queue.mutex);
+  if (queue.ranges.empty()) {
+    return false;
+  }
+  range = queue.ranges.back();
+  queue.ranges.pop_back();
+  return true;
+}
+
+bool ParallelRuntime::steal(unsigned index, Range& range) {
+  for (unsigned i = 1; i < queues.size(); ++i) {
+    Queue& victim = *queues[(index + i) % queues.size()];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if (!victim.ranges.empty()) {
+      range = victim.ranges.front();
+      victim.ranges.pop_front();
+      return true;
+    }
+  }
+  return false;
+}
+
+void ParallelRuntime::participate(unsigned index) {
+  Range range;
+  while (pop(index, range) || steal(index, range)) {
+    // Leaves the upper halves to thieves
+    while (range.end - range.begin > 1) {
+      std::int64_t mid = range.begin + (range.end - range.begin) / 2;
+      Queue& queue = *queues[index];
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      queue.ranges.push_back({mid, range.end});
+      range.end = mid;
+    }
+    runChunk(range.begin);
+  }
+}
+
+void ParallelRuntime::runChunk(std::int64_t chunk) {
+  std::int64_t begin = chunk * chunkSize;
+  std::int64_t end = std::min(begin + chunkSize, count);
+  partials[chunk] = fn(env, begin, end);
+}
+
+double ParallelRuntime::run(ChunkFunction chunkFn, double const* chunkEnv,
+                            std::int64_t iterations, Reduction reduction) {
+  double result = getIdentity(reduction);
+  if (iterations <= 0) {
+    return result;
+  }
+  std::int64_t size = getChunkSize(iterations);
+  std::int64_t numChunks = (iterations + size - 1) / size;
+
+  if (insideLoop || numThreads == 1 || numChunks == 1) {
+    // Same chunks as below, such that the result is identical
+    for (std::int64_t begin = 0; begin < iterations; begin += size) {
+      result = combine(reduction, result, chunkFn(chunkEnv, begin, std::min(begin + size, iterations)));
+    }
+    return result;
+  }
+
+  std::lock_guard<std::mutex> loopLock(loopMutex);
+  if (workers.empty()) {
+    startWorkers();
+  }
+  fn = chunkFn;
+  env = chunkEnv;
+  count = iterations;
+  chunkSize = size;
+  partials.assign(numChunks, 0.0);
+  for (unsigned i = 0; i < numThreads; ++i) {
+    std::int64_t begin = numChunks * i / numThreads;
+    std::int64_t end = numChunks * (i + 1) / numThreads;
+    if (begin < end) {
+      queues[i]->ranges.push_back({begin, end});
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    open = true;
+    ++generation;
+  }
+  wakeUp.notify_all();
+
+  insideLoop = true;
+  participate(0);
+  insideLoop = false;
+
+  // Workers that joined may still run their last chunk
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    open = false;
+    finished.wait(lock, [this] { return active == 0; });
+  }
+
+  for (double partial : partials) {
+    result = combine(reduction, result, partial);
+  }
+  return result;
+}
+
+extern "C" double kaleidoscope_parallel_for(ChunkFunction fn, double const* env,
+                                            std::int64_t count, std::int32_t reduction) {
+  return ParallelRuntime::get().run(fn, env, count, static_cast<Reduction>(reduction));
+}
@@ -0,0 +1,90 @@
+#ifndef K_PARALLELRUNTIME_H_
+#define K_PARALLELRUNTIME_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Reduction.h"
+
+/// Code emitted for a parallel loop: reduces iterations [begin, end) and
+/// reads the loop's captured variables from env.
+using ChunkFunction = double (*)(double const* env, std::int64_t begin, std::int64_t end);
+
+/// Work-stealing pool running the chunks of parallel loops (see
+/// getChunkSize). Every participant owns a deque of chunk ranges; it takes
+/// ranges from the back and splits them in half until a single chunk is left,
+/// while idle participants steal from the front of other deques. The thread
+/// starting a loop participates, and loops started from within a loop run
+/// sequentially on the current thread.
+class ParallelRuntime {
+private:
+  struct Range {
+    std::int64_t begin, end;
+  };
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Range> ranges;
+  };
+
+  // Threads beyond the caller; started on first use
+  std::vector<std::thread> workers;
+  unsigned numThreads;
+  std::vector<std::unique_ptr<Queue>> queues;
+
+  // Only a single loop runs at a time
+  std::mutex loopMutex;
+
+  // Guards the fields below
+  std::mutex mutex;
+  std::condition_variable wakeUp;
+  std::condition_variable finished;
+  unsigned long generation = 0;
+  unsigned active = 0;
+  bool open = false;
+  bool stopping = false;
+
+  // The current loop
+  ChunkFunction fn = nullptr;
+  double const* env = nullptr;
+  std::int64_t count = 0;
+  std::int64_t chunkSize = 1;
+  std::vector<double> partials;
+
+  ParallelRuntime();
+
+  void startWorkers();
+  void stopWorkers();
+  void work(unsigned index);
+  void participate(unsigned index);
+  bool pop(unsigned index, Range& range);
+  bool steal(unsigned index, Range& range);
+  void runChunk(std::int64_t chunk);
+
+public:
+  ~ParallelRuntime();
+
+  ParallelRuntime(ParallelRuntime const&) = delete;
+  ParallelRuntime& operator=(ParallelRuntime const&) = delete;
+
+  static ParallelRuntime& get();
+
+  /// Number of threads including the caller; defaults to the number of
+  /// hardware threads. With 1, loops run sequentially.
+  unsigned getNumThreads() const { return numThreads; }
+  void setNumThreads(unsigned threads);
+
+  /// Reduces fn over count iterations. The result does not depend on the
+  /// number of threads.
+  double run(ChunkFunction fn, double const* env, std::int64_t count, Reduction reduction);
+};
+
+/// Entry point called by parallel loops in generated code.
+extern "C" double kaleidoscope_parallel_for(ChunkFunction fn, double const* env,
+                                            std::int64_t count, std::int32_t reduction);
+
+#endif
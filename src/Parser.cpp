@@ -2,12 +2,12 @@
 #include <cctype>
 #include <iostream>
 
-std::unique_ptr<ExprAST> logError(char const* str) {
+ExprAST* logError(char const* str) {
   std::cerr << "Error: " << str << std::endl;
   return nullptr;
 }
 
-std::unique_ptr<PrototypeAST> logErrorP(char const* str) {
+PrototypeAST* logErrorP(char const* str) {
   logError(str);
   return nullptr;
 }
@@ -32,13 +32,13 @@ int Parser::getTokPrecedence() {
   return tokPrec->second;
 }
 
-std::unique_ptr<ExprAST> Parser::parseNumberExpr() {
-  auto result = std::make_unique<NumberExprAST>(lexer.getNumericValue());
+ExprAST* Parser::parseNumberExpr() {
+  auto result = arena->make<NumberExprAST>(lexer.getNumericValue());
   getNextToken();
-  return std::move(result);
+  return result;
 }
 
-std::unique_ptr<ExprAST> Parser::parseParenExpr() {
+ExprAST* Parser::parseParenExpr() {
   getNextToken(); // skip '('
   auto expr = parseExpression();
   if (!expr) {
@@ -52,24 +52,25 @@ std::unique_ptr<ExprAST> Parser::parseParenExpr() {
   return expr;
 }
 
-std::unique_ptr<ExprAST> Parser::parseIdentifierExpr() {
-  std::string identifier = lexer.getIdentifier();
+ExprAST* Parser::parseIdentifierExpr() {
+  Symbol identifier = symbols.intern(lexer.getIdentifier());
   
   getNextToken(); // skip identifier
 
   // Variable
   if (curTok != '(') {
-    return std::make_unique<VariableExprAST>(identifier);
+    return arena->make<VariableExprAST>(identifier);
   }
 
   // Function call
   getNextToken(); // skip '('
-  std::vector<std::unique_ptr<ExprAST>> args;
+  std::size_t firstArg = argStack.size();
   if (curTok != ')') {
     while (true) {
       if (auto arg = parseExpression()) {
-        args.push_back(std::move(arg));
+        argStack.push_back(arg);
       } else {
+        argStack.resize(firstArg);
         return nullptr;
       }
 
@@ -78,6 +79,7 @@ std::unique_ptr<ExprAST> Parser::parseIdentifierExpr() {
       }
 
       if (curTok != ',') {
+        argStack.resize(firstArg);
         return logError("Expected ')' or ',' in argument list");
       }
       getNextToken();
@@ -85,38 +87,66 @@ std::unique_ptr<ExprAST> Parser::parseIdentifierExpr() {
   }
   getNextToken(); // skip ')'
 
-  return std::make_unique<CallExprAST>(identifier, std::move(args));
+  return arena->make<CallExprAST>(identifier, popToArena(argStack, firstArg));
 }
 
-std::unique_ptr<ExprAST> Parser::parsePrimary() {
+ExprAST* Parser::parsePrimary() {
+  ExprAST* primary;
   switch (curTok) {
     default:
       return logError("Unknown token when expecting an expression");
     case tok_identifier:
-      return parseIdentifierExpr();
+      primary = parseIdentifierExpr();
+      break;
     case tok_number:
-      return parseNumberExpr();
+      primary = parseNumberExpr();
+      break;
     case '(':
-      return parseParenExpr();
+      primary = parseParenExpr();
+      break;
     case tok_if:
-      return parseIfExpr();
+      primary = parseIfExpr();
+      break;
     case tok_for:
-      return parseForExpr();
+      primary = parseForExpr();
+      break;
+    case tok_parfor:
+      primary = parseParForExpr();
+      break;
     case tok_var:
-      return parseVarExpr();
+      primary = parseVarExpr();
+      break;
+  }
+  while (primary && curTok == '[') {
+    primary = parseIndexExpr(primary);
   }
+  return primary;
 }
 
-std::unique_ptr<ExprAST> Parser::parseExpression() {
+/// indexexpr ::= primary '[' expression ']'
+ExprAST* Parser::parseIndexExpr(ExprAST* array) {
+  getNextToken(); // skip '['
+  auto index = parseExpression();
+  if (!index) {
+    return nullptr;
+  }
+  if (curTok != ']') {
+    return logError("expected ']'");
+  }
+  getNextToken(); // skip ']'
+  return arena->make<IndexExprAST>(array, index);
+}
+
+ExprAST* Parser::parseExpression() {
   auto lhs = parsePrimary();
   if (!lhs) {
     return nullptr;
   }
 
-  return parseBinOpRHS(0, std::move(lhs));
+  return parseBinOpRHS(0, lhs);
 }
 
-std::unique_ptr<ExprAST> Parser::parseBinOpRHS(int minPrec, std::unique_ptr<ExprAST> lhs) {
+ExprAST* Parser::parseBinOpRHS(int minPrec, ExprAST* lhs) {
   while (true) {
     int tokPrec = getTokPrecedence();
 
@@ -133,16 +163,16 @@ std::unique_ptr<ExprAST> Parser::parseBinOpRHS(int minPrec, std::unique_ptr<Expr
 
     int nextPrec = getTokPrecedence();
     if (tokPrec < nextPrec) {
-      rhs = parseBinOpRHS(tokPrec+1, std::move(rhs));
+      rhs = parseBinOpRHS(tokPrec+1, rhs);
       if (!rhs) {
         return nullptr;
       }
     }
-    lhs = std::make_unique<BinaryExprAST>(binOp, std::move(lhs), std::move(rhs));
+    lhs = arena->make<BinaryExprAST>(binOp, lhs, rhs);
   }
 }
 
-std::unique_ptr<ExprAST> Parser::parseIfExpr() {
+ExprAST* Parser::parseIfExpr() {
   getNextToken(); // skip if
 
   auto Cond = parseExpression();
@@ -170,17 +200,17 @@ std::unique_ptr<ExprAST> Parser::parseIfExpr() {
     return nullptr;
   }
 
-  return std::make_unique<IfExprAST>(std::move(Cond), std::move(Then), std::move(Else));
+  return arena->make<IfExprAST>(Cond, Then, Else);
 }
 
-std::unique_ptr<ExprAST> Parser::parseForExpr() {
+ExprAST* Parser::parseForExpr() {
   getNextToken(); // skip for
 
   if (curTok != tok_identifier) {
     return logError("expected identifier after for");
   }
 
-  std::string idName = lexer.getIdentifier();
+  Symbol idName = symbols.intern(lexer.getIdentifier());
   getNextToken(); // skip identifier
 
   if (curTok != '=') {
@@ -202,7 +232,7 @@ std::unique_ptr<ExprAST> Parser::parseForExpr() {
     return nullptr;
   }
 
-  std::unique_ptr<ExprAST> Step;
+  ExprAST* Step = nullptr;
   if (curTok == ',') {
     getNextToken();
     Step = parseExpression();
@@ -221,35 +251,111 @@ std::unique_ptr<ExprAST> Parser::parseForExpr() {
     return nullptr;
   }
 
-  return std::make_unique<ForExprAST>(idName, std::move(Start),
-                                              std::move(End),
-                                              std::move(Step),
-                                              std::move(Body));
+  return arena->make<ForExprAST>(idName, Start, End, Step, Body);
 }
 
-std::unique_ptr<ExprAST> Parser::parseVarExpr() {
+/// parforexpr ::= 'parfor' identifier '=' expr ',' expr
+///                ('reduce' ('+' | '*' | 'min' | 'max'))? 'in' expression
+ExprAST* Parser::parseParForExpr() {
+  getNextToken(); // skip parfor
+
+  if (curTok != tok_identifier) {
+    return logError("expected identifier after parfor");
+  }
+
+  Symbol idName = symbols.intern(lexer.getIdentifier());
+  getNextToken(); // skip identifier
+
+  if (curTok != '=') {
+    return logError("Expected '=' after parfor");
+  }
+  getNextToken(); // skip '='
+
+  auto Start = parseExpression();
+  if (!Start) {
+    return nullptr;
+  }
+  if (curTok != ',') {
+    return logError("Expected ',' after parfor start value");
+  }
+  getNextToken();
+
+  auto End = parseExpression();
+  if (!End) {
+    return nullptr;
+  }
+
+  Reduction reduction = Reduction::Sum;
+  if (curTok == tok_identifier && lexer.getIdentifier() == "reduce") {
+    getNextToken(); // skip reduce
+    if (curTok == '+') {
+      reduction = Reduction::Sum;
+    } else if (curTok == '*') {
+      reduction = Reduction::Product;
+    } else if (curTok == tok_identifier && lexer.getIdentifier() == "min") {
+      reduction = Reduction::Min;
+    } else if (curTok == tok_identifier && lexer.getIdentifier() == "max") {
+      reduction = Reduction::Max;
+    } else {
+      return logError("expected '+', '*', 'min' or 'max' after reduce");
+    }
+    getNextToken();
+  }
+
+  if (curTok != tok_in) {
+    return logError("expected 'in' after parfor");
+  }
+  getNextToken(); // skip in
+
+  auto Body = parseExpression();
+  if (!Body) {
+    return nullptr;
+  }
+
+  return arena->make<ParForExprAST>(idName, reduction, Start, End, Body);
+}
+
+ExprAST* Parser::parseVarExpr() {
   getNextToken(); // skip var
-  std::vector<std::pair<std::string, std::unique_ptr<ExprAST>>> varNames;
+  std::size_t firstVar = varStack.size();
+  std::size_t firstType = varTypeStack.size();
+  bool typed = false;
 
   if (curTok != tok_identifier) {
     return logError("expected identifier after var");
   }
 
   while (true) {
-    std::string name = lexer.getIdentifier();
+    Symbol name = symbols.intern(lexer.getIdentifier());
     getNextToken(); // skip identifier
 
-    std::unique_ptr<ExprAST> init;
+    std::optional<ValueType> type;
+    if (curTok == ':') {
+      getNextToken(); // skip ':'
+      ValueType annotation;
+      if (!parseType(annotation)) {
+        varStack.resize(firstVar);
+        varTypeStack.resize(firstType);
+        return nullptr;
+      }
+      type = annotation;
+      typed = true;
+    }
+
+    ExprAST* init = nullptr;
     if (curTok == '=') {
       getNextToken(); // skip '='
 
       init = parseExpression();
       if (!init) {
+        varStack.resize(firstVar);
+        varTypeStack.resize(firstType);
         return nullptr;
       }
     }
 
-    varNames.push_back(std::make_pair(name, std::move(init)));
+    varStack.push_back(std::make_pair(name, init));
+    varTypeStack.push_back(type);
 
     if (curTok != ',') {
       break;
@@ -257,9 +363,14 @@ std::unique_ptr<ExprAST> Parser::parseVarExpr() {
     getNextToken(); // skip ','
 
     if (curTok != tok_identifier) {
+      varStack.resize(firstVar);
+      varTypeStack.resize(firstType);
       return logError("expected identifier after var");
     }
   }
+  auto varNames = popToArena(varStack, firstVar);
+  auto varTypes = typed ? popToArena(varTypeStack, firstType) : Span<std::optional<ValueType>>();
+  varTypeStack.resize(firstType);
 
   if (curTok != tok_in) {
     return logError("Expected 'in' keyword after 'var'");
@@ -271,35 +382,72 @@ std::unique_ptr<ExprAST> Parser::parseVarExpr() {
     return nullptr;
   }
 
-  return std::make_unique<VarExprAST>(std::move(varNames), std::move(body));
+  return arena->make<VarExprAST>(varNames, body, varTypes);
 }
 
-std::unique_ptr<PrototypeAST> Parser::parsePrototype() {
+PrototypeAST* Parser::parsePrototype() {
   if (curTok != tok_identifier) {
     return logErrorP("Expected function name in prototype");
   }
 
-  std::string fnName = lexer.getIdentifier();
+  Symbol fnName = symbols.intern(lexer.getIdentifier());
   getNextToken();
 
   if (curTok != '(') {
     return logErrorP("Expected '(' in prototype");
   }
 
-  std::vector<std::string> argNames;
-  while (getNextToken() == tok_identifier) {
-    argNames.push_back(lexer.getIdentifier());
+  std::size_t firstArg = nameStack.size();
+  std::size_t firstType = typeStack.size();
+  bool typed = false;
+  getNextToken(); // skip '('
+  while (curTok == tok_identifier) {
+    nameStack.push_back(symbols.intern(lexer.getIdentifier()));
+    getNextToken();
+    ValueType type = ValueType::Double;
+    if (curTok == ':') {
+      getNextToken(); // skip ':'
+      if (!parseType(type)) {
+        nameStack.resize(firstArg);
+        typeStack.resize(firstType);
+        return nullptr;
+      }
+      typed = true;
+    }
+    typeStack.push_back(type);
   }
+  auto argNames = popToArena(nameStack, firstArg);
+  // Untyped prototypes need no storage for types
+  auto argTypes = typed ? popToArena(typeStack, firstType) : Span<ValueType>();
+  typeStack.resize(firstType);
   if (curTok != ')') {
     return logErrorP("Expected ')' in prototype");
   }
 
   getNextToken(); // skip ')'
 
-  return std::make_unique<PrototypeAST>(fnName, std::move(argNames));
+  ValueType returnType = ValueType::Double;
+  if (curTok == ':') {
+    getNextToken(); // skip ':'
+    if (!parseType(returnType)) {
+      return nullptr;
+    }
+  }
+
+  return arena->make<PrototypeAST>(fnName, argNames, argTypes, returnType);
 }
 
-std::unique_ptr<FunctionAST> Parser::parseDefinition() {
+/// type ::= 'double' | 'array' | 'i64' | 'bool' | 'f32'
+bool Parser::parseType(ValueType& type) {
+  if (curTok != tok_identifier || !findType(lexer.getIdentifier(), type)) {
+    logError("Expected a type after ':'");
+    return false;
+  }
+  getNextToken(); // skip type
+  return true;
+}
+
+FunctionAST* Parser::parseDefinition() {
   getNextToken();
   auto proto = parsePrototype();
   if (!proto) {
@@ -307,20 +455,30 @@ std::unique_ptr<FunctionAST> Parser::parseDefinition() {
   }
 
   if (auto e = parseExpression()) {
-    return std::make_unique<FunctionAST>(std::move(proto), std::move(e));
+    return arena->make<FunctionAST>(proto, e);
   }
   return nullptr;
 }
 
-std::unique_ptr<PrototypeAST> Parser::parseExtern() {
+PrototypeAST* Parser::parseExtern() {
   getNextToken();
   return parsePrototype();
 }
 
-std::unique_ptr<FunctionAST> Parser::parseTopLevelExpr() {
+void Parser::synchronize() {
+  while (curTok != tok_eof && curTok != tok_def && curTok != tok_extern) {
+    if (curTok == ';') {
+      getNextToken();
+      return;
+    }
+    getNextToken();
+  }
+}
+
+FunctionAST* Parser::parseTopLevelExpr() {
   if (auto e = parseExpression()) {
-    auto proto = std::make_unique<PrototypeAST>("", std::vector<std::string>());
-    return std::make_unique<FunctionAST>(std::move(proto), std::move(e));
+    auto proto = arena->make<PrototypeAST>(symbols.intern("__anon_expr"), Span<Symbol>());
+    return arena->make<FunctionAST>(proto, e);
   }
   return nullptr;
 }
@@ -1,8 +1,8 @@
 #ifndef K_PARSER_H_
 #define K_PARSER_H_
 
-#include <memory>
 #include <unordered_map>
+#include <vector>
 #include "Lexer.h"
 #include "AST.h"
 
@@ -11,32 +11,59 @@ class Parser {
 public:
   int curTok;
   Lexer& lexer;
+  Arena* arena;
+  SymbolTable& symbols;
+
+  // Scratch stacks for lists of unknown length, copied to the arena when done
+  std::vector<ExprAST*> argStack;
+  std::vector<Symbol> nameStack;
+  std::vector<ValueType> typeStack;
+  std::vector<std::optional<ValueType>> varTypeStack;
+  std::vector<std::pair<Symbol, ExprAST*>> varStack;
 
   int getTokPrecedence();
 
+  template<typename T>
+  Span<T> popToArena(std::vector<T>& stack, std::size_t first) {
+    auto result = arena->copy(stack.data() + first, stack.size() - first);
+    stack.resize(first);
+    return result;
+  }
+
 public:
   static const std::unordered_map<char, int> BinopPrecedence;
 
-  Parser(Lexer& lexer)
-    : lexer(lexer) {}
+  /// Nodes are allocated from arena, identifiers are interned into symbols.
+  Parser(Lexer& lexer, Arena& arena, SymbolTable& symbols)
+    : lexer(lexer), arena(&arena), symbols(symbols) {}
+
+  /// Nodes parsed from now on are allocated from arena.
+  void setArena(Arena& newArena) { arena = &newArena; }
 
   int getNextToken() {
     return curTok = lexer.getToken();
   }
 
-  std::unique_ptr<ExprAST> parseNumberExpr();
-  std::unique_ptr<ExprAST> parseParenExpr();
-  std::unique_ptr<ExprAST> parseIdentifierExpr();
-  std::unique_ptr<ExprAST> parsePrimary();
-  std::unique_ptr<ExprAST> parseExpression();
-  std::unique_ptr<ExprAST> parseBinOpRHS(int minPrec, std::unique_ptr<ExprAST> lhs);
-  std::unique_ptr<ExprAST> parseIfExpr();
-  std::unique_ptr<ExprAST> parseForExpr();
-  std::unique_ptr<ExprAST> parseVarExpr();
-  std::unique_ptr<PrototypeAST> parsePrototype();
-  std::unique_ptr<FunctionAST> parseDefinition();
-  std::unique_ptr<PrototypeAST> parseExtern();
-  std::unique_ptr<FunctionAST> parseTopLevelExpr();
+  ExprAST* parseNumberExpr();
+  ExprAST* parseParenExpr();
+  ExprAST* parseIdentifierExpr();
+  ExprAST* parsePrimary();
+  ExprAST* parseIndexExpr(ExprAST* array);
+  ExprAST* parseExpression();
+  ExprAST* parseBinOpRHS(int minPrec, ExprAST* lhs);
+  ExprAST* parseIfExpr();
+  ExprAST* parseForExpr();
+  ExprAST* parseParForExpr();
+  ExprAST* parseVarExpr();
+  bool parseType(ValueType& type);
+  PrototypeAST* parsePrototype();
+  FunctionAST* parseDefinition();
+  PrototypeAST* parseExtern();
+  FunctionAST* parseTopLevelExpr();
+
+  /// Error recovery: skips the rest of a malformed item up to and including
+  /// the next ";", or up to the next "def" or "extern".
+  void synchronize();
 };
 
 #endif
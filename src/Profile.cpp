@@ -0,0 +1,87 @@
+#include "Profile.h"
+
+#include <algorithm>
+#include <string>
+#include <tuple>
+
+Profile::Counter* Profile::getCounter(Symbol function, SiteKind kind, unsigned index) {
+  std::lock_guard<std::mutex> lock(mutex);
+  Counter*& counter = sites[Site{function, kind, index}];
+  if (!counter) {
+    counter = &counters.emplace_back(0);
+    if (kind == SiteKind::Entry) {
+      functions.push_back(function);
+    }
+  }
+  return counter;
+}
+
+std::uint64_t Profile::load(Site const& site) const {
+  auto it = sites.find(site);
+  return it != sites.end() ? it->second->load(std::memory_order_relaxed) : 0;
+}
+
+std::uint64_t Profile::getCount(Symbol function, SiteKind kind, unsigned index) const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return load(Site{function, kind, index});
+}
+
+std::vector<Symbol> Profile::getFunctions() const {
+  std::lock_guard<std::mutex> lock(mutex);
+  return functions;
+}
+
+void Profile::report(std::ostream& os, std::size_t count) const {
+  std::lock_guard<std::mutex> lock(mutex);
+  // (count, function, index, second count), hottest first and by name for
+  // equal counts, such that reports are stable
+  using Row = std::tuple<std::uint64_t, std::string, unsigned, std::uint64_t>;
+  std::vector<Row> calls, branches, loops;
+  for (auto const& site : sites) {
+    Site const& key = site.first;
+    std::uint64_t n = load(key);
+    switch (key.kind) {
+      case SiteKind::Entry:
+        calls.emplace_back(n, key.function.string(), 0, 0);
+        break;
+      case SiteKind::Then: {
+        std::uint64_t otherwise = load(Site{key.function, SiteKind::Else, key.index});
+        branches.emplace_back(n + otherwise, key.function.string(), key.index, n);
+        break;
+      }
+      case SiteKind::LoopEntry: {
+        std::uint64_t iterations = load(Site{key.function, SiteKind::LoopIteration, key.index});
+        loops.emplace_back(iterations, key.function.string(), key.index, n);
+        break;
+      }
+      default:
+        break;
+    }
+  }
+  auto sortRows = [count](std::vector<Row>& rows) {
+    std::sort(rows.begin(), rows.end(), [](Row const& a, Row const& b) {
+      return std::get<0>(a) != std::get<0>(b) ? std::get<0>(a) > std::get<0>(b)
+                                              : std::tie(std::get<1>(a), std::get<2>(a)) <
+                                                    std::tie(std::get<1>(b), std::get<2>(b));
+    });
+    rows.resize(std::min(rows.size(), count));
+  };
+  sortRows(calls);
+  sortRows(branches);
+  sortRows(loops);
+
+  os << "Hottest functions:\n";
+  for (auto const& row : calls) {
+    os << "  " << std::get<1>(row) << ": " << std::get<0>(row) << " calls\n";
+  }
+  os << "Hottest branches:\n";
+  for (auto const& row : branches) {
+    os << "  " << std::get<1>(row) << " if #" << std::get<2>(row) << ": " << std::get<3>(row) << " then, "
+       << std::get<0>(row) - std::get<3>(row) << " else\n";
+  }
+  os << "Hottest loops:\n";
+  for (auto const& row : loops) {
+    os << "  " << std::get<1>(row) << " for #" << std::get<2>(row) << ": " << std::get<0>(row)
+       << " iterations in " << std::get<3>(row) << " runs\n";
+  }
+}
@@ -0,0 +1,72 @@
+#ifndef K_PROFILE_H_
+#define K_PROFILE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+
+#include "Symbol.h"
+
+/// Instrumented points of a definition. The n-th if or for of a definition,
+/// in the order of code generation, is the site with index n of that kind.
+enum class SiteKind {
+  Entry,         // function entry
+  Then,          // branches of if
+  Else,
+  LoopEntry,     // for, before the first iteration
+  LoopIteration  // for, at the end of every iteration
+};
+
+/// Execution counts of instrumented code, see CodeGen::setInstrumentation.
+/// Counters never move, hence compiled code increments them through their
+/// absolute address. Increments are relaxed loads and stores, which may lose
+/// counts under contention but cost no more than a plain increment.
+class Profile {
+public:
+  using Counter = std::atomic<std::uint64_t>;
+
+private:
+  struct Site {
+    Symbol function;
+    SiteKind kind;
+    unsigned index;
+
+    bool operator==(Site const& other) const {
+      return function == other.function && kind == other.kind && index == other.index;
+    }
+  };
+  struct SiteHash {
+    std::size_t operator()(Site const& site) const {
+      return std::hash<Symbol>()(site.function) * 31 + static_cast<std::size_t>(site.kind) * 7 + site.index;
+    }
+  };
+
+  mutable std::mutex mutex;
+  std::deque<Counter> counters;
+  std::unordered_map<Site, Counter*, SiteHash> sites;
+  std::vector<Symbol> functions;
+
+  std::uint64_t load(Site const& site) const;
+
+public:
+  /// Returns the counter of a site, creating it on first use. A definition
+  /// that is emitted several times, e.g. as an import for inlining, counts
+  /// into the same counters. Thread-safe, e.g. for background compilers.
+  Counter* getCounter(Symbol function, SiteKind kind, unsigned index = 0);
+
+  std::uint64_t getCount(Symbol function, SiteKind kind, unsigned index = 0) const;
+
+  /// Instrumented functions in the order they were first compiled.
+  std::vector<Symbol> getFunctions() const;
+
+  /// Lists the count most frequently called functions, taken branches and
+  /// executed loops.
+  void report(std::ostream& os, std::size_t count) const;
+};
+
+#endif
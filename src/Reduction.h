@@ -0,0 +1,45 @@
+#ifndef K_REDUCTION_H_
+#define K_REDUCTION_H_
+
+#include <cmath>
+#include <cstdint>
+#include <limits>
+
+/// Operator that combines the values of the iterations of a parallel loop.
+enum class Reduction {
+  Sum,
+  Product,
+  Min,   // fmin, i.e. NaNs are ignored
+  Max    // fmax
+};
+
+inline double getIdentity(Reduction reduction) {
+  switch (reduction) {
+    case Reduction::Sum: return 0.0;
+    case Reduction::Product: return 1.0;
+    case Reduction::Min: return std::numeric_limits<double>::infinity();
+    case Reduction::Max: return -std::numeric_limits<double>::infinity();
+  }
+  return 0.0;
+}
+
+inline double combine(Reduction reduction, double lhs, double rhs) {
+  switch (reduction) {
+    case Reduction::Sum: return lhs + rhs;
+    case Reduction::Product: return lhs * rhs;
+    case Reduction::Min: return std::fmin(lhs, rhs);
+    case Reduction::Max: return std::fmax(lhs, rhs);
+  }
+  return lhs;
+}
+
+/// Iterations of a parallel loop are reduced in chunks of this many
+/// iterations, and the partial results are combined in order. The chunking
+/// only depends on the iteration count, hence the result does not depend on
+/// the number of threads or on scheduling.
+inline std::int64_t getChunkSize(std::int64_t count) {
+  constexpr std::int64_t maxChunks = 4096;
+  return count > maxChunks ? count / maxChunks : 1;
+}
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef K_SYMBOL_H_
+#define K_SYMBOL_H_
+
+#include <cstring>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+
+#include "Arena.h"
+
+/// Handle of an interned identifier. Two symbols from the same SymbolTable
+/// are equal iff their names are equal.
+class Symbol {
+private:
+  std::string_view const* name = nullptr;
+
+  friend class SymbolTable;
+  explicit Symbol(std::string_view const* name)
+    : name(name) {}
+
+public:
+  Symbol() = default;
+
+  std::string_view str() const { return *name; }
+  std::string string() const { return std::string(*name); }
+
+  bool operator==(Symbol other) const { return name == other.name; }
+  bool operator!=(Symbol other) const { return name != other.name; }
+
+  friend struct std::hash<Symbol>;
+};
+
+namespace std {
+template<>
+struct hash<Symbol> {
+  std::size_t operator()(Symbol symbol) const {
+    return std::hash<std::string_view const*>()(symbol.name);
+  }
+};
+}
+
+inline std::ostream& operator<<(std::ostream& os, Symbol symbol) {
+  return os << symbol.str();
+}
+
+/// Session-wide table of identifiers; symbols stay valid as long as the table.
+class SymbolTable {
+private:
+  Arena storage;
+  std::unordered_set<std::string_view> symbols;
+
+public:
+  Symbol intern(std::string_view name) {
+    auto it = symbols.find(name);
+    if (it == symbols.end()) {
+      char* data = static_cast<char*>(storage.allocate(name.size(), 1));
+      std::memcpy(data, name.data(), name.size());
+      it = symbols.emplace(data, name.size()).first;
+    }
+    return Symbol(&*it);
+  }
+
+  std::size_t size() const { return symbols.size(); }
+};
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef K_THREADPOOL_H_
+#define K_THREADPOOL_H_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// Fixed set of worker threads executing tasks in FIFO order. Tasks receive
+/// the index of the worker they run on, such that per-worker state can be
+/// used without locking.
+class ThreadPool {
+public:
+  using Task = std::function<void(std::size_t worker)>;
+
+private:
+  std::vector<std::thread> workers;
+  std::deque<Task> tasks;
+  std::mutex mutex;
+  std::condition_variable wakeUp;
+  bool stopping = false;
+
+  void work(std::size_t worker);
+
+public:
+  explicit ThreadPool(std::size_t numThreads);
+  /// Finishes all queued tasks.
+  ~ThreadPool();
+
+  ThreadPool(ThreadPool const&) = delete;
+  ThreadPool& operator=(ThreadPool const&) = delete;
+
+  std::size_t size() const { return workers.size(); }
+
+  void enqueue(Task task);
+};
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef K_TYPES_H_
+#define K_TYPES_H_
+
+#include <string_view>
+
+/// Types of values. Parameters, results and variables without annotation are
+/// doubles; see Parser::parseType for the syntax of annotations. Comparisons
+/// yield bools. Numeric values convert implicitly as in C, e.g. when they
+/// are assigned or passed, and arithmetic on mixed types is carried out in
+/// the wider type (bool < i64 < f32 < double).
+enum class ValueType {
+  Double,
+  Array,  // pointer to an Array, see ArrayRuntime.h
+  I64,
+  Bool,
+  F32
+};
+
+/// Name of the type in annotations.
+inline std::string_view getTypeName(ValueType type) {
+  switch (type) {
+    case ValueType::Double: return "double";
+    case ValueType::Array: return "array";
+    case ValueType::I64: return "i64";
+    case ValueType::Bool: return "bool";
+    case ValueType::F32: return "f32";
+  }
+  return "";
+}
+
+/// Returns false if name is not a type.
+inline bool findType(std::string_view name, ValueType& type) {
+  for (ValueType candidate : {ValueType::Double, ValueType::Array, ValueType::I64,
+                              ValueType::Bool, ValueType::F32}) {
+    if (getTypeName(candidate) == name) {
+      type = candidate;
+      return true;
+    }
+  }
+  return false;
+}
+
+#endif
@@ -1,82 +1,297 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <iostream>
-#include <sstream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "AotCompiler.h"
+#include "AstReader.h"
+#include "Driver.h"
 #include "Lexer.h"
 #include "Parser.h"
-#include "visitor/PrettyPrinter.h"
-#include "visitor/CodeGen.h"
+#include "visitor/AstWriter.h"
 
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
 #include "llvm/Support/TargetSelect.h"
 
-static void HandleDefinition(Parser& parser) {
-  if (parser.parseDefinition()) {
-    fprintf(stderr, "Parsed a function definition.\n");
-  } else {
-    // Skip token for error recovery.
-    parser.getNextToken();
+// Scripts are memory-mapped and lexed in place.
+static std::unique_ptr<llvm::MemoryBuffer> openScript(char const* path) {
+  auto buffer = llvm::MemoryBuffer::getFile(path);
+  if (!buffer) {
+    std::cerr << "Error: could not open " << path << ": "
+              << buffer.getError().message() << std::endl;
+    return nullptr;
   }
+  return std::move(*buffer);
 }
 
-static void HandleExtern(Parser& parser) {
-  if (parser.parseExtern()) {
-    fprintf(stderr, "Parsed an extern\n");
-  } else {
-    // Skip token for error recovery.
-    parser.getNextToken();
+static std::string_view contents(llvm::MemoryBuffer const& buffer) {
+  return std::string_view(buffer.getBufferStart(), buffer.getBufferSize());
+}
+
+// Compiles the scripts into a single object file or into a static library
+// with one member per script.
+static int compileAheadOfTime(std::vector<char const*> const& scripts, OptLevel optLevel,
+                              bool fastMath, bool integerLoops, bool constantFolding,
+                              std::string const& output, char const* header) {
+  if (scripts.empty() || output.empty()) {
+    std::cerr << "Error: -c requires scripts and -o=<file>" << std::endl;
+    return 1;
+  }
+  bool archive = llvm::StringRef(output).endswith(".a");
+  AotCompiler compiler(optLevel);
+  compiler.setFastMath(fastMath);
+  compiler.setIntegerLoops(integerLoops);
+  compiler.setConstantFolding(constantFolding);
+  for (char const* script : scripts) {
+    auto file = openScript(script);
+    if (!file) {
+      return 1;
+    }
+    Lexer lexer(contents(*file));
+    compiler.addSource(lexer);
+    if (archive) {
+      compiler.finishObject(llvm::sys::path::stem(script).str() + ".o");
+    }
+  }
+  if (!archive) {
+    compiler.finishObject(llvm::sys::path::filename(output).str());
   }
+  if (!compiler.succeeded()) {
+    return 1;
+  }
+  bool ok = archive ? compiler.writeArchive(output) : compiler.writeObject(output);
+  if (ok && header) {
+    ok = compiler.writeHeader(header);
+  }
+  return ok ? 0 : 1;
 }
 
-static void HandleTopLevelExpression(Parser& parser) {
-  // Evaluate a top-level expression into an anonymous function.
-  if (parser.parseTopLevelExpr()) {
-    fprintf(stderr, "Parsed a top-level expr\n");
-  } else {
-    // Skip token for error recovery.
+// Parses the scripts into a single binary AST, which loads without lexing
+// or parsing, see Driver::loadAst.
+static int writeAst(std::vector<char const*> const& scripts, char const* output) {
+  SymbolTable symbols;
+  Arena arena;
+  std::string ast;
+  AstWriter writer(ast);
+  bool ok = true;
+  for (char const* script : scripts) {
+    auto file = openScript(script);
+    if (!file) {
+      return 1;
+    }
+    Lexer lexer(contents(*file));
+    Parser parser(lexer, arena, symbols);
     parser.getNextToken();
+    while (parser.curTok != tok_eof) {
+      arena.reset();
+      if (parser.curTok == ';') {
+        parser.getNextToken();
+      } else if (parser.curTok == tok_def) {
+        if (auto definition = parser.parseDefinition()) {
+          writer.writeDefinition(*definition);
+        } else {
+          parser.synchronize();
+          ok = false;
+        }
+      } else if (parser.curTok == tok_extern) {
+        if (auto declaration = parser.parseExtern()) {
+          writer.writeExtern(*declaration);
+        } else {
+          parser.synchronize();
+          ok = false;
+        }
+      } else {
+        if (auto expression = parser.parseTopLevelExpr()) {
+          writer.writeTopLevelExpr(*expression);
+        } else {
+          parser.synchronize();
+          ok = false;
+        }
+      }
+    }
   }
+  if (!ok) {
+    return 1;
+  }
+  std::ofstream out(output, std::ios::binary);
+  out.write(ast.data(), ast.size());
+  if (!out) {
+    std::cerr << "Error: could not write " << output << std::endl;
+    return 1;
+  }
+  return 0;
 }
 
-/// top ::= definition | external | expression | ';'
-static void MainLoop(Parser& parser) {
-  while (true) {
-    fprintf(stderr, "ready> ");
-    switch (parser.curTok) {
-    case tok_eof:
-      return;
-    case ';': // ignore top-level semicolons.
-      parser.getNextToken();
-      break;
-    case tok_def:
-      HandleDefinition(parser);
-      break;
-    case tok_extern:
-      HandleExtern(parser);
-      break;
-    default:
-      HandleTopLevelExpression(parser);
-      break;
+int main(int argc, char** argv) {
+  llvm::InitializeNativeTarget();
+  llvm::InitializeNativeTargetAsmPrinter();
+  llvm::InitializeNativeTargetAsmParser();
+
+  // usage: kaleidoscope [-O0|-O1|-O2|-O3] [-fast-math] [-no-int-loops]
+  //                     [-ipo] [-no-fold] [-no-hash-cons] [-eager] [-cache-dir=<dir>]
+  //                     [-tier-up=<calls>]
+  //                     [-compile-threads=<n>] [-parallel-threads=<n>]
+  //                     [-stats=<file.json|file.csv>] [-profile] [-pgo=<calls>]
+  //                     [script...]
+  //        kaleidoscope -c [-O0|-O1|-O2|-O3] [-fast-math] [-no-int-loops]
+  //                     [-no-fold] -o=<file.o|file.a>
+  //                     [-header=<file.h>] script...
+  //        kaleidoscope -emit-ast=<file> script...
+  // A single script may also be a binary AST written by -emit-ast.
+  OptLevel optLevel = OptLevel::O1;
+  bool fastMath = false;
+  bool integerLoops = true;
+  bool interprocedural = false;
+  bool constantFolding = true;
+  bool hashConsing = true;
+  bool lazy = true;
+  char const* cacheDirectory = nullptr;
+  unsigned long tierUpThreshold = 0;
+  unsigned compileThreads = 0;
+  unsigned parallelThreads = 0;
+  char const* statsFile = nullptr;
+  bool profiling = false;
+  unsigned long pgoThreshold = 0;
+  bool compileOnly = false;
+  std::string output;
+  char const* header = nullptr;
+  char const* astFile = nullptr;
+  std::vector<char const*> scripts;
+  for (int i = 1; i < argc; ++i) {
+    if (std::strlen(argv[i]) == 3 && argv[i][0] == '-' && argv[i][1] == 'O' &&
+        argv[i][2] >= '0' && argv[i][2] <= '3') {
+      optLevel = static_cast<OptLevel>(argv[i][2] - '0');
+    } else if (std::strcmp(argv[i], "-fast-math") == 0) {
+      fastMath = true;
+    } else if (std::strcmp(argv[i], "-no-int-loops") == 0) {
+      integerLoops = false;
+    } else if (std::strcmp(argv[i], "-ipo") == 0) {
+      interprocedural = true;
+    } else if (std::strcmp(argv[i], "-no-fold") == 0) {
+      constantFolding = false;
+    } else if (std::strcmp(argv[i], "-no-hash-cons") == 0) {
+      hashConsing = false;
+    } else if (std::strcmp(argv[i], "-eager") == 0) {
+      lazy = false;
+    } else if (std::strncmp(argv[i], "-cache-dir=", 11) == 0) {
+      cacheDirectory = argv[i] + 11;
+    } else if (std::strcmp(argv[i], "-c") == 0) {
+      compileOnly = true;
+    } else if (std::strncmp(argv[i], "-o=", 3) == 0) {
+      output = argv[i] + 3;
+    } else if (std::strncmp(argv[i], "-header=", 8) == 0) {
+      header = argv[i] + 8;
+    } else if (std::strncmp(argv[i], "-emit-ast=", 10) == 0) {
+      astFile = argv[i] + 10;
+    } else if (std::strncmp(argv[i], "-tier-up=", 9) == 0) {
+      tierUpThreshold = std::strtoul(argv[i] + 9, nullptr, 10);
+    } else if (std::strncmp(argv[i], "-compile-threads=", 17) == 0) {
+      compileThreads = std::strtoul(argv[i] + 17, nullptr, 10);
+    } else if (std::strncmp(argv[i], "-parallel-threads=", 18) == 0) {
+      parallelThreads = std::strtoul(argv[i] + 18, nullptr, 10);
+    } else if (std::strncmp(argv[i], "-stats=", 7) == 0) {
+      statsFile = argv[i] + 7;
+    } else if (std::strcmp(argv[i], "-profile") == 0) {
+      profiling = true;
+    } else if (std::strncmp(argv[i], "-pgo=", 5) == 0) {
+      pgoThreshold = std::strtoul(argv[i] + 5, nullptr, 10);
+    } else {
+      scripts.push_back(argv[i]);
     }
   }
-}
 
-int main() {
-  //InitializeNativeTarget();
-  //InitializeNativeTargetAsmPrinter();
-  //InitializeNativeTargetAsmParser();
+  if (compileOnly) {
+    return compileAheadOfTime(scripts, optLevel, fastMath, integerLoops, constantFolding, output, header);
+  }
+  if (astFile) {
+    return writeAst(scripts, astFile);
+  }
 
-  std::string code("def test(x y z) x+y*5.0-z*z*z * test(x,y,z);");
-  //std::string code("def test(x) if x < 5 then (1+2+x)*(x+(1+2)) else x+x;");
-  //std::string code("def test(n) var x=5,y=6 in x*n+y*n;");
-  //std::string code("def text(x y) x + y;");
-  std::stringstream codeStream(code);
-  Lexer lexer(codeStream);
-  Parser parser(lexer);
-  parser.getNextToken();
-  auto ast = parser.parseDefinition();
-  md::visit(PrettyPrinter(), *ast);
+  // A single script is lexed in place and stdin alone is read as a stream.
+  // Several scripts, or "-" for stdin, are read concurrently, e.g. from
+  // pipes, and every item runs as soon as it is complete.
+  std::unique_ptr<llvm::MemoryBuffer> file;
+  std::unique_ptr<Lexer> lexer;
+  std::vector<std::unique_ptr<std::ifstream>> streams;
+  ItemReader reader;
+  if (scripts.size() == 1 && std::strcmp(scripts.front(), "-") != 0) {
+    file = openScript(scripts.front());
+    if (!file) {
+      return 1;
+    }
+    if (!AstReader::isAst(contents(*file))) {
+      lexer = std::make_unique<Lexer>(contents(*file));
+    }
+  } else if (scripts.empty()) {
+    lexer = std::make_unique<Lexer>(std::cin);
+  } else {
+    if (std::count_if(scripts.begin(), scripts.end(),
+                      [](char const* script) { return std::strcmp(script, "-") == 0; }) > 1) {
+      std::cerr << "Error: stdin can only be read once" << std::endl;
+      return 1;
+    }
+    for (char const* script : scripts) {
+      if (std::strcmp(script, "-") != 0) {
+        streams.push_back(std::make_unique<std::ifstream>(script));
+        if (!*streams.back()) {
+          std::cerr << "Error: could not open " << script << std::endl;
+          return 1;
+        }
+      }
+    }
+    auto stream = streams.begin();
+    for (char const* script : scripts) {
+      reader.addStream(std::strcmp(script, "-") == 0 ? std::cin : **stream++);
+    }
+  }
 
-  CodeGen cg;
-  Value* v = md::visit(cg, *ast);
-  v->print(llvm::errs());
+  Driver driver(std::cerr, optLevel);
+  driver.setFastMath(fastMath);
+  driver.setIntegerLoops(integerLoops);
+  driver.setInterprocedural(interprocedural);
+  driver.setConstantFolding(constantFolding);
+  driver.setHashConsing(hashConsing);
+  driver.setLazyCompilation(lazy);
+  if (cacheDirectory) {
+    driver.setCacheDirectory(cacheDirectory);
+  }
+  driver.setTierUpThreshold(tierUpThreshold);
+  driver.setCompileThreads(compileThreads);
+  if (parallelThreads > 0) {
+    driver.setParallelThreads(parallelThreads);
+  }
+  driver.setStatistics(statsFile != nullptr);
+  driver.setProfiling(profiling);
+  driver.setProfileGuidedThreshold(pgoThreshold);
+  if (lexer) {
+    driver.mainLoop(*lexer);
+  } else if (file) {
+    driver.loadAst(contents(*file));
+  } else {
+    driver.mainLoop(reader);
+  }
+
+  if (profiling) {
+    driver.getProfile()->report(std::cerr, 10);
+  }
+  if (statsFile) {
+    driver.waitForCompilation();
+    std::ofstream stats(statsFile);
+    if (llvm::StringRef(statsFile).endswith(".csv")) {
+      driver.getStatistics()->writeCSV(stats);
+    } else {
+      driver.getStatistics()->writeJSON(stats);
+    }
+    if (!stats) {
+      std::cerr << "Error: could not write " << statsFile << std::endl;
+      return 1;
+    }
+  }
 
   return 0;
 }
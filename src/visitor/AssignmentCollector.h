@@ -0,0 +1,65 @@
+#ifndef K_VISITOR_ASSIGNMENTCOLLECTOR_H_
+#define K_VISITOR_ASSIGNMENTCOLLECTOR_H_
+
+#include <unordered_set>
+
+#include "visitor/Visit.h"
+#include "AST.h"
+
+/// Collects the names of all variables that are assigned to in a tree.
+class AssignmentCollector {
+private:
+  std::unordered_set<Symbol>& assigned;
+
+public:
+  explicit AssignmentCollector(std::unordered_set<Symbol>& assigned)
+    : assigned(assigned) {}
+
+  void operator()(ExprAST&) {}
+  void operator()(NumberExprAST&) {}
+  void operator()(VariableExprAST&) {}
+  void operator()(BinaryExprAST& node) {
+    if (node.getOp() == '=' && node.getLHS().getKind() == ExprKind::Variable) {
+      assigned.insert(static_cast<VariableExprAST&>(node.getLHS()).getName());
+    }
+    ast::visit(*this, node.getLHS());
+    ast::visit(*this, node.getRHS());
+  }
+  void operator()(CallExprAST& node) {
+    for (auto arg : node.getArgs()) {
+      ast::visit(*this, *arg);
+    }
+  }
+  void operator()(IndexExprAST& node) {
+    ast::visit(*this, node.getArray());
+    ast::visit(*this, node.getIndex());
+  }
+  void operator()(IfExprAST& node) {
+    ast::visit(*this, node.getCond());
+    ast::visit(*this, node.getThen());
+    ast::visit(*this, node.getElse());
+  }
+  void operator()(ForExprAST& node) {
+    ast::visit(*this, node.getStart());
+    ast::visit(*this, node.getEnd());
+    if (node.getStep()) {
+      ast::visit(*this, node.getStep()->get());
+    }
+    ast::visit(*this, node.getBody());
+  }
+  void operator()(ParForExprAST& node) {
+    ast::visit(*this, node.getStart());
+    ast::visit(*this, node.getEnd());
+    ast::visit(*this, node.getBody());
+  }
+  void operator()(VarExprAST& node) {
+    for (auto& entry : node.getVarNames()) {
+      if (entry.second) {
+        ast::visit(*this, *entry.second);
+      }
+    }
+    ast::visit(*this, node.getBody());
+  }
+};
+
+#endif
@@ -0,0 +1,169 @@
+#ifndef K_VISITOR_AST_WRITER_H_
+#define K_VISITOR_AST_WRITER_H_
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+
+#include "visitor/Visit.h"
+#include "AST.h"
+#include "AstFormat.h"
+
+/// Appends the binary encoding of items to a buffer, see AstFormat.h. One
+/// writer writes one file, as symbols are numbered per file.
+class AstWriter {
+private:
+  std::string& out;
+  std::unordered_map<Symbol, std::uint64_t> symbolIds;
+
+  void write(std::uint8_t byte) { out.push_back(static_cast<char>(byte)); }
+  void write(AstTag tag) { write(static_cast<std::uint8_t>(tag)); }
+  void write(ValueType type) { write(static_cast<std::uint8_t>(type)); }
+  void writeVarint(std::uint64_t value) {
+    for (; value >= 0x80; value >>= 7) {
+      write(static_cast<std::uint8_t>(value | 0x80));
+    }
+    write(static_cast<std::uint8_t>(value));
+  }
+  void write(double value) {
+    char bytes[sizeof(value)];
+    std::memcpy(bytes, &value, sizeof(value));
+    out.append(bytes, sizeof(value));
+  }
+  void write(Symbol symbol) {
+    auto id = symbolIds.find(symbol);
+    if (id != symbolIds.end()) {
+      writeVarint(id->second + 1);
+      return;
+    }
+    symbolIds.emplace(symbol, symbolIds.size());
+    writeVarint(0);
+    writeVarint(symbol.str().size());
+    out.append(symbol.str());
+  }
+  void writeOptional(ExprAST* node) {
+    if (node) {
+      ast::visit(*this, *node);
+    } else {
+      write(AstTag::None);
+    }
+  }
+
+public:
+  /// Starts a file with the header.
+  explicit AstWriter(std::string& out)
+    : out(out) {
+    out.append(astformat::magic);
+    writeVarint(astformat::version);
+  }
+
+  void writeDefinition(FunctionAST& node) {
+    write(static_cast<std::uint8_t>(AstItem::Definition));
+    ast::visit(*this, node);
+  }
+  void writeExtern(PrototypeAST& node) {
+    write(static_cast<std::uint8_t>(AstItem::Extern));
+    ast::visit(*this, node);
+  }
+  /// The prototype is implied, see Parser::parseTopLevelExpr.
+  void writeTopLevelExpr(FunctionAST& node) {
+    write(static_cast<std::uint8_t>(AstItem::TopLevelExpr));
+    ast::visit(*this, node.getBody());
+  }
+
+  void operator()(ExprAST&) {}
+
+  void operator()(NumberExprAST& node) {
+    double number = node.getNumber();
+    // Below 2^53 every integer is exact; -0 must stay a double
+    if (!std::signbit(number) && number < 9007199254740992.0 && number == std::floor(number)) {
+      write(AstTag::Integer);
+      writeVarint(static_cast<std::uint64_t>(number));
+    } else {
+      write(AstTag::Number);
+      write(number);
+    }
+  }
+  void operator()(VariableExprAST& node) {
+    write(AstTag::Variable);
+    write(node.getName());
+  }
+  void operator()(BinaryExprAST& node) {
+    write(AstTag::Binary);
+    write(static_cast<std::uint8_t>(node.getOp()));
+    ast::visit(*this, node.getLHS());
+    ast::visit(*this, node.getRHS());
+  }
+  void operator()(CallExprAST& node) {
+    write(AstTag::Call);
+    write(node.getCallee());
+    writeVarint(node.getArgs().size());
+    for (auto arg : node.getArgs()) {
+      ast::visit(*this, *arg);
+    }
+  }
+  void operator()(IndexExprAST& node) {
+    write(AstTag::Index);
+    ast::visit(*this, node.getArray());
+    ast::visit(*this, node.getIndex());
+  }
+  void operator()(IfExprAST& node) {
+    write(AstTag::If);
+    ast::visit(*this, node.getCond());
+    ast::visit(*this, node.getThen());
+    ast::visit(*this, node.getElse());
+  }
+  void operator()(ForExprAST& node) {
+    write(AstTag::For);
+    write(node.getVarName());
+    ast::visit(*this, node.getStart());
+    ast::visit(*this, node.getEnd());
+    writeOptional(node.getStep() ? &node.getStep()->get() : nullptr);
+    ast::visit(*this, node.getBody());
+  }
+  void operator()(ParForExprAST& node) {
+    write(AstTag::ParFor);
+    write(node.getVarName());
+    write(static_cast<std::uint8_t>(node.getReduction()));
+    ast::visit(*this, node.getStart());
+    ast::visit(*this, node.getEnd());
+    ast::visit(*this, node.getBody());
+  }
+  void operator()(VarExprAST& node) {
+    write(AstTag::Var);
+    writeVarint(node.getVarNames().size());
+    write(static_cast<std::uint8_t>(node.hasVarTypes()));
+    for (std::size_t i = 0; i < node.getVarNames().size(); ++i) {
+      write(node.getVarNames()[i].first);
+      if (node.hasVarTypes()) {
+        auto type = node.getVarType(i);
+        write(static_cast<std::uint8_t>(type ? static_cast<int>(*type) + 1 : 0));
+      }
+      writeOptional(node.getVarNames()[i].second);
+    }
+    ast::visit(*this, node.getBody());
+  }
+  void operator()(PrototypeAST& node) {
+    write(node.getName());
+    writeVarint(node.getArgs().size());
+    bool typed = !node.isScalar();
+    for (Symbol arg : node.getArgs()) {
+      write(arg);
+    }
+    write(static_cast<std::uint8_t>(typed));
+    if (typed) {
+      for (std::size_t i = 0; i < node.getArgs().size(); ++i) {
+        write(node.getArgType(i));
+      }
+      write(node.getReturnType());
+    }
+  }
+  void operator()(FunctionAST& node) {
+    ast::visit(*this, node.getPrototype());
+    ast::visit(*this, node.getBody());
+  }
+};
+
+#endif
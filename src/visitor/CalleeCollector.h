@@ -0,0 +1,70 @@
+#ifndef K_VISITOR_CALLEECOLLECTOR_H_
+#define K_VISITOR_CALLEECOLLECTOR_H_
+
+#include <algorithm>
+#include <vector>
+
+#include "visitor/Visit.h"
+#include "AST.h"
+
+/// Collects the distinct names of all functions called in a tree.
+class CalleeCollector {
+private:
+  std::vector<Symbol> callees;
+
+public:
+  std::vector<Symbol> const& getCallees() const { return callees; }
+
+  void operator()(ExprAST&) {}
+
+  void operator()(NumberExprAST&) {}
+  void operator()(VariableExprAST&) {}
+  void operator()(BinaryExprAST& node) {
+    ast::visit(*this, node.getLHS());
+    ast::visit(*this, node.getRHS());
+  }
+  void operator()(CallExprAST& node) {
+    if (std::find(callees.begin(), callees.end(), node.getCallee()) == callees.end()) {
+      callees.push_back(node.getCallee());
+    }
+    for (auto arg : node.getArgs()) {
+      ast::visit(*this, *arg);
+    }
+  }
+  void operator()(IndexExprAST& node) {
+    ast::visit(*this, node.getArray());
+    ast::visit(*this, node.getIndex());
+  }
+  void operator()(IfExprAST& node) {
+    ast::visit(*this, node.getCond());
+    ast::visit(*this, node.getThen());
+    ast::visit(*this, node.getElse());
+  }
+  void operator()(ForExprAST& node) {
+    ast::visit(*this, node.getStart());
+    ast::visit(*this, node.getEnd());
+    if (node.getStep()) {
+      ast::visit(*this, node.getStep()->get());
+    }
+    ast::visit(*this, node.getBody());
+  }
+  void operator()(ParForExprAST& node) {
+    ast::visit(*this, node.getStart());
+    ast::visit(*this, node.getEnd());
+    ast::visit(*this, node.getBody());
+  }
+  void operator()(VarExprAST& node) {
+    for (auto& entry : node.getVarNames()) {
+      if (entry.second) {
+        ast::visit(*this, *entry.second);
+      }
+    }
+    ast::visit(*this, node.getBody());
+  }
+  void operator()(PrototypeAST&) {}
+  void operator()(FunctionAST& node) {
+    ast::visit(*this, node.getBody());
+  }
+};
+
+#endif
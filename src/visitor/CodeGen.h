@@ -1,35 +1,99 @@
 #ifndef K_VISITOR_CODEGEN_H_
 #define K_VISITOR_CODEGEN_H_
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
 #include <unordered_map>
+#include <unordered_set>
 #include <stack>
+#include <vector>
 
 #include "llvm/ADT/APFloat.h"
+#include "llvm/ExecutionEngine/Orc/ThreadSafeModule.h"
 #include "llvm/IR/Constants.h"
+#include "llvm/IR/DataLayout.h"
 #include "llvm/IR/Function.h"
 #include "llvm/IR/IRBuilder.h"
-#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/Intrinsics.h"
 #include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/MDBuilder.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Verifier.h"
-#include "llvm/Transforms/InstCombine/InstCombine.h"
-#include "llvm/Transforms/Scalar.h"
-#include "llvm/Transforms/Scalar/GVN.h"
-#include "llvm/Transforms/Utils.h"
 
-#include <md/visit.hpp>
+#include "visitor/AssignmentCollector.h"
+#include "visitor/TailCallCollector.h"
+#include "visitor/Visit.h"
 #include "AST.h"
+#include "Builtins.h"
+#include "Optimizer.h"
+#include "Profile.h"
+#include "Types.h"
 
 using namespace llvm;
 
+/// Argument names and types of a function.
+struct Signature {
+  std::vector<Symbol> args;
+  std::vector<ValueType> argTypes;
+  ValueType returnType = ValueType::Double;
+};
+
 class CodeGen {
 private:
-  LLVMContext context;
-  IRBuilder<> builder;
+  // Every module gets a context of its own, such that modules can be
+  // compiled independently of each other (e.g. lazily by the JIT).
+  std::unique_ptr<LLVMContext> context;
+  std::unique_ptr<IRBuilder<>> builder;
+  DataLayout dataLayout;
   std::unique_ptr<Module> module;
-  std::unique_ptr<legacy::FunctionPassManager> fpm;
-
-  std::unordered_map<std::string, AllocaInst*> namedValues;
+  Optimizer optimizer;
+  bool fastMath = false;
+  bool integerLoops = true;
+
+  std::unordered_map<Symbol, AllocaInst*> namedValues;
+  // Loop variables that count in i64, see setIntegerLoops. They read as
+  // doubles, except as array indices.
+  std::unordered_set<AllocaInst*> countingVariables;
+  // Signatures of every prototype seen so far, such that functions living
+  // in modules already handed to the JIT can be re-declared.
+  std::unordered_map<Symbol, Signature> functionProtos;
+
+  // Indexing array[index] is in bounds for as long as both variables are
+  // bound to these allocas, see ParForExprAST
+  struct InBounds {
+    AllocaInst* array;
+    AllocaInst* index;
+    Value* intIndex;
+  };
+  std::vector<InBounds> inBounds;
+
+  // Calls in tail position of the current function. Self calls among them
+  // store their arguments to argAllocas and branch to recurseBB.
+  std::unordered_set<CallExprAST const*> tailCalls;
+  std::vector<AllocaInst*> argAllocas;
+  BasicBlock* recurseBB = nullptr;
+
+  // See setInstrumentation and setFeedback. Sites are numbered per
+  // definition in the order they are emitted.
+  Profile* instrumentation = nullptr;
+  Profile const* feedback = nullptr;
+  Symbol currentDefinition;
+  unsigned ifSites = 0;
+  unsigned loopSites = 0;
+
+  // Values of pure nodes emitted so far, see setSharing. An entry is valid in
+  // its block until the generation changes, i.e. until the next store, call
+  // or rebinding of a variable.
+  struct SharedValue {
+    Value* value;
+    BasicBlock* block;
+    unsigned generation;
+  };
+  bool sharing = false;
+  std::unordered_map<ExprAST const*, SharedValue> shared;
+  unsigned generation = 0;
 
   Value* logError(char const* str) {
     std::cerr << "Error: " << str << std::endl;
@@ -41,89 +105,775 @@ private:
     return nullptr;
   }
 
-  AllocaInst* CreateEntryBlockAlloca(Function* f, std::string const& varName) {
+  static StringRef name(Symbol symbol) {
+    auto str = symbol.str();
+    return StringRef(str.data(), str.size());
+  }
+
+  AllocaInst* CreateEntryBlockAlloca(Function* f, StringRef varName, Type* type = nullptr) {
     IRBuilder<> tmp(&f->getEntryBlock(), f->getEntryBlock().begin());
-    return tmp.CreateAlloca(Type::getDoubleTy(context), 0, varName);
+    return tmp.CreateAlloca(type ? type : Type::getDoubleTy(*context), 0, varName);
+  }
+
+  // Increments the counter at its absolute address, see Profile
+  void emitCounter(SiteKind kind, unsigned index) {
+    Type* countTy = Type::getInt64Ty(*context);
+    auto address = reinterpret_cast<std::uintptr_t>(instrumentation->getCounter(currentDefinition, kind, index));
+    Value* counter = builder->CreateIntToPtr(ConstantInt::get(countTy, address),
+                                             PointerType::getUnqual(countTy), "counter");
+    LoadInst* count = builder->CreateLoad(counter, "count");
+    count->setAtomic(AtomicOrdering::Monotonic);
+    count->setAlignment(Align(8));
+    StoreInst* store = builder->CreateStore(builder->CreateAdd(count, ConstantInt::get(countTy, 1)), counter);
+    store->setAtomic(AtomicOrdering::Monotonic);
+    store->setAlignment(Align(8));
+  }
+
+  Value* findShared(ExprAST const& node) {
+    auto it = sharing ? shared.find(&node) : shared.end();
+    if (it == shared.end() || it->second.block != builder->GetInsertBlock() ||
+        it->second.generation != generation) {
+      return nullptr;
+    }
+    return it->second.value;
+  }
+
+  // Constants are free to emit again
+  Value* share(ExprAST const& node, Value* value) {
+    if (sharing && value && isa<Instruction>(value)) {
+      shared[&node] = {value, builder->GetInsertBlock(), generation};
+    }
+    return value;
+  }
+
+  void invalidateShared() { ++generation; }
+
+  // Branch weights must fit into 32 bits
+  MDNode* getBranchWeights(std::uint64_t taken, std::uint64_t notTaken) {
+    std::uint64_t scale = std::max(taken, notTaken) / UINT32_MAX + 1;
+    return MDBuilder(*context).createBranchWeights(static_cast<std::uint32_t>(taken / scale),
+                                                   static_cast<std::uint32_t>(notTaken / scale));
+  }
+
+  // Arrays are passed as pointers to {double* data, i64 length}, see Array
+  StructType* getArrayTy() {
+    return StructType::get(*context, {Type::getDoublePtrTy(*context), Type::getInt64Ty(*context)});
+  }
+
+  Type* getType(ValueType type) {
+    switch (type) {
+      case ValueType::Double: return Type::getDoubleTy(*context);
+      case ValueType::Array: return PointerType::getUnqual(getArrayTy());
+      case ValueType::I64: return Type::getInt64Ty(*context);
+      case ValueType::Bool: return Type::getInt1Ty(*context);
+      case ValueType::F32: return Type::getFloatTy(*context);
+    }
+    return nullptr;
+  }
+
+  // Type of arithmetic on a and b, see ValueType; nullptr for arrays
+  Type* promote(Type* a, Type* b) {
+    if (a->isPointerTy() || b->isPointerTy()) {
+      return nullptr;
+    }
+    if (a->isDoubleTy() || b->isDoubleTy()) {
+      return Type::getDoubleTy(*context);
+    }
+    if (a->isFloatTy() || b->isFloatTy()) {
+      return Type::getFloatTy(*context);
+    }
+    return Type::getInt64Ty(*context);
+  }
+
+  // True iff v is nonzero; NaN is false
+  Value* emitCondition(Value* v) {
+    Type* type = v->getType();
+    if (type->isIntegerTy(1)) {
+      return v;
+    }
+    if (type->isIntegerTy()) {
+      return builder->CreateICmpNE(v, ConstantInt::get(type, 0), "cond");
+    }
+    if (type->isFloatingPointTy()) {
+      return builder->CreateFCmpONE(v, ConstantFP::get(type, 0.0), "cond");
+    }
+    return logError("Conditions must be numbers");
+  }
+
+  // Implicit conversion between numeric types as in C
+  Value* convert(Value* v, Type* to) {
+    Type* from = v->getType();
+    if (from == to) {
+      return v;
+    }
+    if (from->isPointerTy() || to->isPointerTy()) {
+      return logError("Arrays do not convert to other types");
+    }
+    if (to->isIntegerTy(1)) {
+      return emitCondition(v);
+    }
+    if (to->isIntegerTy()) {
+      return from->isIntegerTy() ? builder->CreateZExt(v, to) : builder->CreateFPToSI(v, to);
+    }
+    if (from->isIntegerTy(1)) {
+      return builder->CreateUIToFP(v, to);
+    }
+    if (from->isIntegerTy()) {
+      return builder->CreateSIToFP(v, to);
+    }
+    return builder->CreateFPCast(v, to);
+  }
+
+  // Numbers written in the source; computed ones stay doubles, so that
+  // folding does not change the type of an operation
+  static NumberExprAST* asLiteral(ExprAST& node) {
+    if (node.getKind() != ExprKind::Number || !static_cast<NumberExprAST&>(node).isLiteral()) {
+      return nullptr;
+    }
+    return &static_cast<NumberExprAST&>(node);
+  }
+
+  // Literal integers n with |n| < 2^53, which doubles represent exactly
+  static bool isExactInteger(ExprAST& node, std::int64_t& value) {
+    auto literal = asLiteral(node);
+    if (!literal) {
+      return false;
+    }
+    double number = literal->getNumber();
+    // -0 differs from 0, e.g. in copysign
+    if (number != std::trunc(number) || std::abs(number) >= 9007199254740992.0 ||
+        (number == 0.0 && std::signbit(number))) {
+      return false;
+    }
+    value = static_cast<std::int64_t>(number);
+    return true;
+  }
+
+  // Literals take the type of the other operand of a binary operator if they
+  // are exact in it, e.g. i + 1 stays an integer. In f32 arithmetic they are
+  // rounded to f32.
+  Value* emitOperand(ExprAST& node, Type* other) {
+    std::int64_t value;
+    if (other->isIntegerTy(64) && isExactInteger(node, value)) {
+      return ConstantInt::get(other, value, true);
+    }
+    if (other->isFloatTy() && asLiteral(node)) {
+      return ConstantFP::get(other, asLiteral(node)->getNumber());
+    }
+    return ast::visit(*this, node);
+  }
+
+  // Indices read counting variables as they are, see countingVariables
+  Value* emitIndex(ExprAST& node) {
+    if (node.getKind() == ExprKind::Variable) {
+      Symbol varName = static_cast<VariableExprAST&>(node).getName();
+      AllocaInst* v = namedValues[varName];
+      if (v && countingVariables.count(v)) {
+        return builder->CreateLoad(v->getAllocatedType(), v, name(varName));
+      }
+    }
+    return emitOperand(node, Type::getInt64Ty(*context));
+  }
+
+  // "for i = a, cond, b" with integers a and b counts exactly in i64, unless
+  // i is assigned in the loop
+  bool isIntegerLoop(ForExprAST& node) {
+    std::int64_t value;
+    if (!integerLoops || !isExactInteger(node.getStart(), value) ||
+        (node.getStep() && !isExactInteger(node.getStep()->get(), value))) {
+      return false;
+    }
+    std::unordered_set<Symbol> assigned;
+    ast::visit(AssignmentCollector(assigned), node.getEnd());
+    ast::visit(AssignmentCollector(assigned), node.getBody());
+    return assigned.count(node.getVarName()) == 0;
+  }
+
+  bool isArray(Value* v) {
+    return v->getType() == getType(ValueType::Array);
+  }
+
+  // Whether f only takes and returns doubles
+  static bool isScalar(Function* f) {
+    for (auto& arg : f->args()) {
+      if (!arg.getType()->isDoubleTy()) {
+        return false;
+      }
+    }
+    return f->getReturnType()->isDoubleTy();
+  }
+
+  FunctionType* getFunctionType(Signature const& signature) {
+    std::vector<Type*> params;
+    for (ValueType type : signature.argTypes) {
+      params.push_back(getType(type));
+    }
+    return FunctionType::get(getType(signature.returnType), params, false);
+  }
+
+  // Loads the element at index, or NaN with a call to
+  // kaleidoscope_bounds_error if the index is out of bounds. Stores value
+  // instead if it is not nullptr. Indices other than i64 are converted to
+  // double first and truncated.
+  Value* emitElementAccess(Value* array, Value* index, Value* value) {
+    Type* doubleTy = Type::getDoubleTy(*context);
+    Type* indexTy = Type::getInt64Ty(*context);
+    Value* data = builder->CreateLoad(Type::getDoublePtrTy(*context),
+                                      builder->CreateStructGEP(getArrayTy(), array, 0), "data");
+    Value* length = builder->CreateLoad(indexTy, builder->CreateStructGEP(getArrayTy(), array, 1), "length");
+    Value* inRange;
+    if (index->getType() == indexTy) {
+      // Negative indices wrap around to large unsigned ones
+      inRange = builder->CreateICmpULT(index, length, "inbounds");
+    } else {
+      index = convert(index, doubleTy);
+      // Ordered comparisons, hence NaN is out of bounds
+      inRange = builder->CreateAnd(
+          builder->CreateFCmpOGE(index, ConstantFP::get(doubleTy, 0.0)),
+          builder->CreateFCmpOLT(index, builder->CreateSIToFP(length, doubleTy)), "inbounds");
+      index = builder->CreateFPToSI(index, indexTy);
+    }
+
+    Function* f = builder->GetInsertBlock()->getParent();
+    BasicBlock* AccessBB = BasicBlock::Create(*context, "access", f);
+    BasicBlock* ErrorBB = BasicBlock::Create(*context, "outofbounds", f);
+    BasicBlock* MergeBB = BasicBlock::Create(*context, "accesscont", f);
+    MDBuilder weights(*context);
+    builder->CreateCondBr(inRange, AccessBB, ErrorBB, weights.createBranchWeights(1 << 20, 1));
+
+    builder->SetInsertPoint(ErrorBB);
+    FunctionCallee error = module->getOrInsertFunction("kaleidoscope_bounds_error", Type::getVoidTy(*context));
+    builder->CreateCall(error);
+    builder->CreateBr(MergeBB);
+
+    builder->SetInsertPoint(AccessBB);
+    Value* element = builder->CreateInBoundsGEP(doubleTy, data, index);
+    Value* result = value;
+    if (value) {
+      builder->CreateStore(value, element);
+      invalidateShared();
+    } else {
+      result = builder->CreateLoad(doubleTy, element, "element");
+    }
+    builder->CreateBr(MergeBB);
+
+    builder->SetInsertPoint(MergeBB);
+    if (value) {
+      return value;
+    }
+    PHINode* phi = builder->CreatePHI(doubleTy, 2, "elementtmp");
+    phi->addIncoming(result, AccessBB);
+    phi->addIncoming(ConstantFP::getNaN(doubleTy), ErrorBB);
+    return phi;
+  }
+
+  // Returns the integer index of array[index] if it is known to be in bounds
+  Value* findInBounds(IndexExprAST& node) {
+    if (node.getArray().getKind() != ExprKind::Variable || node.getIndex().getKind() != ExprKind::Variable) {
+      return nullptr;
+    }
+    AllocaInst* array = namedValues[static_cast<VariableExprAST&>(node.getArray()).getName()];
+    AllocaInst* index = namedValues[static_cast<VariableExprAST&>(node.getIndex()).getName()];
+    for (auto const& range : inBounds) {
+      if (range.array == array && range.index == index) {
+        return range.intIndex;
+      }
+    }
+    return nullptr;
+  }
+
+  // Calls in tail position return right away, which lets the callee reuse
+  // the frame. Self calls jump back to the start of the function instead,
+  // which turns recursion into a loop. Code after the call is unreachable,
+  // hence it continues in a fresh block with an undefined result.
+  Value* emitTailCall(Function* callee, std::vector<Value*> const& args) {
+    Function* f = builder->GetInsertBlock()->getParent();
+    invalidateShared();
+    if (callee == f && recurseBB) {
+      for (std::size_t i = 0; i < args.size(); ++i) {
+        builder->CreateStore(args[i], argAllocas[i]);
+      }
+      builder->CreateBr(recurseBB);
+    } else {
+      CallInst* call = builder->CreateCall(callee, args, "calltmp");
+      // Guaranteed if the signatures match, as the arguments fit the frame
+      call->setTailCallKind(callee->getFunctionType() == f->getFunctionType() ? CallInst::TCK_MustTail
+                                                                               : CallInst::TCK_Tail);
+      Value* result = convert(call, f->getReturnType());
+      if (!result) {
+        return nullptr;
+      }
+      builder->CreateRet(result);
+    }
+    builder->SetInsertPoint(BasicBlock::Create(*context, "aftertail", f));
+    return UndefValue::get(f->getReturnType());
+  }
+
+  // Collects a such that the bound of "parfor i = 0, bound" is len(a) or the
+  // fmin of such bounds
+  static void collectLengths(ExprAST& bound, std::vector<Symbol>& arrays) {
+    if (bound.getKind() != ExprKind::Call) {
+      return;
+    }
+    auto& call = static_cast<CallExprAST&>(bound);
+    auto builtin = findBuiltin(call.getCallee().str());
+    if (builtin && builtin->builtin == Builtin::Length &&
+        call.getArgs()[0]->getKind() == ExprKind::Variable) {
+      arrays.push_back(static_cast<VariableExprAST*>(call.getArgs()[0])->getName());
+    } else if (builtin && builtin->builtin == Builtin::Fmin) {
+      collectLengths(*call.getArgs()[0], arrays);
+      collectLengths(*call.getArgs()[1], arrays);
+    }
+  }
+
+  void initializeModule() {
+    context = std::make_unique<LLVMContext>();
+    builder = std::make_unique<IRBuilder<>>(*context);
+    applyFastMath();
+    module = std::make_unique<Module>("my cool jit", *context);
+    module->setDataLayout(dataLayout);
+  }
+
+  // The builder attaches these flags to every floating-point operation
+  void applyFastMath() {
+    FastMathFlags fmf;
+    if (fastMath) {
+      fmf.setFast();
+    }
+    builder->setFastMathFlags(fmf);
+  }
+
+  static Intrinsic::ID getIntrinsic(Builtin builtin) {
+    switch (builtin) {
+      case Builtin::Sqrt: return Intrinsic::sqrt;
+      case Builtin::Sin: return Intrinsic::sin;
+      case Builtin::Cos: return Intrinsic::cos;
+      case Builtin::Exp: return Intrinsic::exp;
+      case Builtin::Exp2: return Intrinsic::exp2;
+      case Builtin::Log: return Intrinsic::log;
+      case Builtin::Log2: return Intrinsic::log2;
+      case Builtin::Log10: return Intrinsic::log10;
+      case Builtin::Fabs: return Intrinsic::fabs;
+      case Builtin::Floor: return Intrinsic::floor;
+      case Builtin::Ceil: return Intrinsic::ceil;
+      case Builtin::Trunc: return Intrinsic::trunc;
+      case Builtin::Round: return Intrinsic::round;
+      case Builtin::Pow: return Intrinsic::pow;
+      case Builtin::Fma: return Intrinsic::fma;
+      case Builtin::Fmin: return Intrinsic::minnum;
+      case Builtin::Fmax: return Intrinsic::maxnum;
+      case Builtin::Copysign: return Intrinsic::copysign;
+      case Builtin::Array:
+      case Builtin::Length:
+        break;
+    }
+    return Intrinsic::not_intrinsic;
+  }
+
+  Function* declareFunction(Symbol fnName, Signature const& signature) {
+    FunctionType* ft = getFunctionType(signature);
+    Function* f = Function::Create(ft, Function::ExternalLinkage, name(fnName), module.get());
+    // Bools are passed as in C
+    for (auto& arg : f->args()) {
+      if (arg.getType()->isIntegerTy(1)) {
+        arg.addAttr(Attribute::ZExt);
+      }
+    }
+    if (f->getReturnType()->isIntegerTy(1)) {
+      f->addAttribute(AttributeList::ReturnIndex, Attribute::ZExt);
+    }
+
+    assert(f->arg_size() == signature.args.size());
+    auto it = signature.args.begin();
+    for (auto& arg : f->args()) {
+      arg.setName(name(*it++));
+    }
+
+    return f;
   }
 
 public:
-  CodeGen()
-    : builder(context),
-      module(std::make_unique<Module>("my cool jit", context)),
-      fpm(std::make_unique<legacy::FunctionPassManager>(module.get()))
+  explicit CodeGen(DataLayout const& dataLayout = DataLayout(""),
+                   OptLevel optLevel = OptLevel::O1,
+                   TargetMachine* tm = nullptr)
+    : dataLayout(dataLayout), optimizer(optLevel, tm)
   {
-    fpm->add(createPromoteMemoryToRegisterPass());
-    fpm->add(createInstructionCombiningPass());
-    fpm->add(createReassociatePass());
-    fpm->add(createGVNPass());
-    fpm->add(createCFGSimplificationPass());
-    fpm->doInitialization();
+    initializeModule();
+  }
+
+  OptLevel getOptLevel() const { return optimizer.getLevel(); }
+
+  /// The module currently being generated.
+  Module const& getModule() const { return *module; }
+  void setOptLevel(OptLevel level) { optimizer.setLevel(level); }
+  /// With fast-math, all fast-math flags are set on floating-point
+  /// operations, which allows reassociation, FMA contraction and
+  /// vectorization of reductions at the price of IEEE semantics.
+  bool isFastMath() const { return fastMath; }
+  void setFastMath(bool enabled) {
+    fastMath = enabled;
+    applyFastMath();
+  }
+
+  /// Loops "for i = a, cond, b" with integer constants a and b, where i is
+  /// not assigned, count in i64 rather than double. Everywhere but in array
+  /// indices i is converted to a double, hence arithmetic on it is the same
+  /// as without. Enabled by default.
+  bool isIntegerLoops() const { return integerLoops; }
+  void setIntegerLoops(bool enabled) { integerLoops = enabled; }
+
+  /// With sharing, a pure node that occurs several times in a tree, see
+  /// HashConser, is emitted once per block, as long as no store, call or
+  /// rebinding of a variable comes in between. Disabled by default.
+  bool isSharing() const { return sharing; }
+  void setSharing(bool enabled) { sharing = enabled; }
+
+  /// With a profile, every definition counts how often it is called, how
+  /// often each branch of an if is taken and how often each for loop is
+  /// entered and iterated. Parallel loops, including their bodies, are not
+  /// instrumented.
+  Profile* getInstrumentation() const { return instrumentation; }
+  void setInstrumentation(Profile* profile) { instrumentation = profile; }
+
+  /// Annotates definitions with the counts of profile, as entry counts and
+  /// branch weights, which guide inlining, block placement and unrolling.
+  /// The definitions must be the same as when the profile was collected.
+  Profile const* getFeedback() const { return feedback; }
+  void setFeedback(Profile const* profile) { feedback = profile; }
+
+  bool isInterprocedural() const { return optimizer.isInterprocedural(); }
+  void setInterprocedural(bool enabled) { optimizer.setInterprocedural(enabled); }
+
+  /// Optimizes the current module, hands it over together with its context
+  /// (e.g. to the JIT) and starts a fresh one. Callers are expected to do so
+  /// after every top-level definition, such that a module only ever holds a
+  /// single function.
+  /// Statistics of the optimization are added to record unless it is
+  /// nullptr, see Optimizer::run.
+  orc::ThreadSafeModule takeModule(CompileRecord* record = nullptr) {
+    return takeModule(optimizer, record);
+  }
+  /// Same as above, with a pipeline other than the one of the opt level.
+  orc::ThreadSafeModule takeModule(Optimizer& pipeline, CompileRecord* record = nullptr) {
+    pipeline.run(*module, record);
+    orc::ThreadSafeModule result(std::move(module), std::move(context));
+    initializeModule();
+    return result;
+  }
+
+  /// Looks up a function in the current module. Functions emitted into a
+  /// module that was already taken are re-declared from their prototype.
+  Function* getFunction(Symbol fnName) {
+    if (Function* f = module->getFunction(name(fnName))) {
+      return f;
+    }
+    auto proto = functionProtos.find(fnName);
+    if (proto != functionProtos.end()) {
+      return declareFunction(fnName, proto->second);
+    }
+    return nullptr;
+  }
+
+  static Signature getSignature(PrototypeAST& node) {
+    Signature signature;
+    auto const& args = node.getArgs();
+    signature.args.assign(args.begin(), args.end());
+    for (std::size_t i = 0; i < args.size(); ++i) {
+      signature.argTypes.push_back(node.getArgType(i));
+    }
+    signature.returnType = node.getReturnType();
+    return signature;
+  }
+
+  /// Makes a prototype known without declaring it in the current module.
+  void addPrototype(PrototypeAST& node) {
+    functionProtos[node.getName()] = getSignature(node);
+  }
+  void addPrototype(Symbol fnName, Signature signature) {
+    functionProtos[fnName] = std::move(signature);
+  }
+  /// Forgets a prototype, e.g. of a definition that failed to compile.
+  void removePrototype(Symbol fnName) {
+    functionProtos.erase(fnName);
+  }
+
+  /// Whether node has the same signature as the known prototype of the same
+  /// name, if there is one. Reports the mismatch otherwise.
+  bool checkPrototype(PrototypeAST& node) {
+    Signature const* known = findPrototype(node.getName());
+    if (!known) {
+      return true;
+    }
+    Signature signature = getSignature(node);
+    if (known->argTypes.size() != signature.argTypes.size()) {
+      logError("Function redefined with a different number of arguments");
+      return false;
+    }
+    if (known->argTypes != signature.argTypes || known->returnType != signature.returnType) {
+      logError("Function redefined with different types");
+      return false;
+    }
+    return true;
+  }
+
+  /// Signature of a known prototype or nullptr.
+  Signature const* findPrototype(Symbol fnName) const {
+    auto proto = functionProtos.find(fnName);
+    return proto != functionProtos.end() ? &proto->second : nullptr;
+  }
+
+  /// Emits "double <name>.argv(double const* args)", which calls the function
+  /// with its arguments read from an array. Only for functions of doubles.
+  Function* emitArgvWrapper(Symbol fnName) {
+    Function* callee = getFunction(fnName);
+    if (!callee) {
+      return logErrorF("Unknown function referenced");
+    }
+    if (!isScalar(callee)) {
+      return logErrorF("Only functions of doubles can be called through an argument array");
+    }
+
+    FunctionType* ft = FunctionType::get(Type::getDoubleTy(*context),
+                                         {Type::getDoublePtrTy(*context)}, false);
+    Function* f = Function::Create(ft, Function::ExternalLinkage, name(fnName) + ".argv", module.get());
+    Argument* argv = f->arg_begin();
+    argv->setName("args");
+
+    BasicBlock* bb = BasicBlock::Create(*context, "entry", f);
+    builder->SetInsertPoint(bb);
+
+    std::vector<Value*> args;
+    for (unsigned i = 0; i < callee->arg_size(); ++i) {
+      args.push_back(builder->CreateLoad(builder->CreateConstGEP1_32(Type::getDoubleTy(*context), argv, i)));
+    }
+    builder->CreateRet(builder->CreateCall(callee, args, "calltmp"));
+    llvm::verifyFunction(*f, &llvm::errs());
+    return f;
+  }
+
+  /// Emits a function that is defined in another module, such that calls to
+  /// it can be inlined. The body is available_externally, i.e. it is dropped
+  /// after optimization and remaining calls go to the original definition.
+  Function* emitImport(FunctionAST& node) {
+    Function* f = (*this)(node);
+    if (f) {
+      f->setLinkage(Function::AvailableExternallyLinkage);
+    }
+    return f;
+  }
+
+  /// Emits "void <name>.batch(double const* const* columns, double* out,
+  /// i64 n)", which calls the function for each of the n tuples of arguments
+  /// columns[0][i], columns[1][i], ... If the function is defined in the
+  /// current module, it is made internal such that it is inlined into the loop
+  /// and does not clash with the definition already in the JIT.
+  Function* emitBatchWrapper(Symbol fnName) {
+    Function* callee = getFunction(fnName);
+    if (!callee) {
+      return logErrorF("Unknown function referenced");
+    }
+    if (!isScalar(callee)) {
+      return logErrorF("Only functions of doubles can be evaluated in batches");
+    }
+    if (!callee->empty()) {
+      callee->setLinkage(Function::InternalLinkage);
+    }
+
+    Type* doubleTy = Type::getDoubleTy(*context);
+    Type* doublePtrTy = Type::getDoublePtrTy(*context);
+    Type* indexTy = Type::getInt64Ty(*context);
+    FunctionType* ft = FunctionType::get(Type::getVoidTy(*context),
+                                         {PointerType::getUnqual(doublePtrTy), doublePtrTy, indexTy}, false);
+    Function* f = Function::Create(ft, Function::ExternalLinkage, name(fnName) + ".batch", module.get());
+    auto arg = f->arg_begin();
+    Argument* columns = arg++;
+    columns->setName("columns");
+    Argument* out = arg++;
+    out->setName("out");
+    // Lets the vectorizer skip run-time alias checks against the inputs
+    out->addAttr(Attribute::NoAlias);
+    Argument* n = arg;
+    n->setName("n");
+
+    BasicBlock* entryBB = BasicBlock::Create(*context, "entry", f);
+    BasicBlock* loopBB = BasicBlock::Create(*context, "loop", f);
+    BasicBlock* afterBB = BasicBlock::Create(*context, "afterloop", f);
+
+    builder->SetInsertPoint(entryBB);
+    std::vector<Value*> columnPtrs;
+    for (unsigned k = 0; k < callee->arg_size(); ++k) {
+      Value* column = builder->CreateConstInBoundsGEP1_64(doublePtrTy, columns, k);
+      columnPtrs.push_back(builder->CreateLoad(doublePtrTy, column, "column"));
+    }
+    Value* zero = ConstantInt::get(indexTy, 0);
+    builder->CreateCondBr(builder->CreateICmpSGT(n, zero), loopBB, afterBB);
+
+    builder->SetInsertPoint(loopBB);
+    PHINode* i = builder->CreatePHI(indexTy, 2, "i");
+    i->addIncoming(zero, entryBB);
+    std::vector<Value*> args;
+    for (Value* column : columnPtrs) {
+      args.push_back(builder->CreateLoad(doubleTy, builder->CreateInBoundsGEP(doubleTy, column, i)));
+    }
+    Value* result = builder->CreateCall(callee, args, "calltmp");
+    builder->CreateStore(result, builder->CreateInBoundsGEP(doubleTy, out, i));
+    Value* next = builder->CreateAdd(i, ConstantInt::get(indexTy, 1), "nexti", true, true);
+    i->addIncoming(next, loopBB);
+    builder->CreateCondBr(builder->CreateICmpSLT(next, n), loopBB, afterBB);
+
+    builder->SetInsertPoint(afterBB);
+    builder->CreateRetVoid();
+    llvm::verifyFunction(*f, &llvm::errs());
+    return f;
   }
 
   Value* operator()(ExprAST& node) { return nullptr; }
 
   Value* operator()(NumberExprAST& node) {
-    return ConstantFP::get(context, APFloat(node.getNumber()));
+    return ConstantFP::get(*context, APFloat(node.getNumber()));
   }
 
   Value* operator()(VariableExprAST& node) {
-    Value* v = namedValues[node.getName()];
+    if (Value* v = findShared(node)) {
+      return v;
+    }
+    AllocaInst* v = namedValues[node.getName()];
     if (!v) {
       return logError("Unknown variable name");
     }
-    return builder.CreateLoad(v, node.getName());
+    Value* value = builder->CreateLoad(v->getAllocatedType(), v, name(node.getName()));
+    if (countingVariables.count(v)) {
+      value = builder->CreateSIToFP(value, Type::getDoubleTy(*context), name(node.getName()));
+    }
+    return share(node, value);
   }
 
   Value* operator()(BinaryExprAST& node) {
     if (node.getOp() == '=') {
-      VariableExprAST* lhsE = dynamic_cast<VariableExprAST*>(&node.getLHS());
-      if (!lhsE) {
-        return logError("destination of '=' must be a variable");
-        return nullptr;
+      if (node.getLHS().getKind() == ExprKind::Index) {
+        return emitStore(static_cast<IndexExprAST&>(node.getLHS()), node.getRHS());
+      }
+      if (node.getLHS().getKind() != ExprKind::Variable) {
+        return logError("destination of '=' must be a variable or an array element");
       }
-      Value* rhs = md::visit(*this, node.getRHS());
+      auto lhsE = static_cast<VariableExprAST*>(&node.getLHS());
+      Value* rhs = ast::visit(*this, node.getRHS());
       if (!rhs) {
         return nullptr;
       }
-      Value* variable = namedValues[lhsE->getName()];
+      AllocaInst* variable = namedValues[lhsE->getName()];
       if (!variable) {
         return logError("Unknown variable name");
       }
+      rhs = convert(rhs, variable->getAllocatedType());
+      if (!rhs) {
+        return nullptr;
+      }
 
-      builder.CreateStore(rhs, variable);
+      builder->CreateStore(rhs, variable);
+      invalidateShared();
       return rhs;
     }
+    if (Value* v = findShared(node)) {
+      return v;
+    }
 
-    Value* lhs = md::visit(*this, node.getLHS());
-    Value* rhs = md::visit(*this, node.getRHS());
+    // Literals need no evaluation, hence the order does not matter
+    Value* lhs;
+    Value* rhs;
+    if (node.getLHS().getKind() == ExprKind::Number && node.getRHS().getKind() != ExprKind::Number) {
+      rhs = ast::visit(*this, node.getRHS());
+      lhs = rhs ? emitOperand(node.getLHS(), rhs->getType()) : nullptr;
+    } else {
+      lhs = ast::visit(*this, node.getLHS());
+      rhs = lhs ? emitOperand(node.getRHS(), lhs->getType()) : nullptr;
+    }
 
     if (!lhs || !rhs) {
       return nullptr;
     }
+    Type* type = promote(lhs->getType(), rhs->getType());
+    if (!type) {
+      return logError("Operands of binary operators must be numbers");
+    }
+    lhs = convert(lhs, type);
+    rhs = convert(rhs, type);
+    bool integer = type->isIntegerTy();
 
     Value* v = nullptr;
     switch (node.getOp()) {
       case '+':
-        v = builder.CreateFAdd(lhs, rhs, "addtmp");
+        v = integer ? builder->CreateAdd(lhs, rhs, "addtmp") : builder->CreateFAdd(lhs, rhs, "addtmp");
         break;
       case '-':
-        v = builder.CreateFSub(lhs, rhs, "subtmp");
+        v = integer ? builder->CreateSub(lhs, rhs, "subtmp") : builder->CreateFSub(lhs, rhs, "subtmp");
         break;
       case '*':
-        v = builder.CreateFMul(lhs, rhs, "multmp");
+        v = integer ? builder->CreateMul(lhs, rhs, "multmp") : builder->CreateFMul(lhs, rhs, "multmp");
         break;
       case '<':
-        v = builder.CreateFCmpULT(lhs, rhs, "cmptmp");
-        v = builder.CreateUIToFP(v, Type::getDoubleTy(context), "booltmp");
+        // A bool, which converts to 0 or 1 where a number is needed
+        v = integer ? builder->CreateICmpSLT(lhs, rhs, "cmptmp") : builder->CreateFCmpULT(lhs, rhs, "cmptmp");
         break;
       default:
         v = logError("Unknown operator");
         break;
     }
-    return v;
+    return share(node, v);
   }
   Value* operator()(CallExprAST& node) {
-    Function* calleeF = module->getFunction(node.getCallee());
+    if (auto builtin = findBuiltin(node.getCallee().str())) {
+      if (builtin->arity != node.getArgs().size()) {
+        return logError("Incorrect number of arguments passed");
+      }
+      // Every array() is a new array
+      if (builtin->builtin != Builtin::Array) {
+        if (Value* v = findShared(node)) {
+          return v;
+        }
+      }
+      std::vector<Value*> args;
+      for (auto& arg : node.getArgs()) {
+        args.push_back(ast::visit(*this, *arg));
+        if (!args.back()) {
+          return nullptr;
+        }
+        if (isArray(args.back()) != (builtin->builtin == Builtin::Length)) {
+          return logError("Argument does not match the parameter type of the builtin");
+        }
+      }
+      if (builtin->builtin == Builtin::Array) {
+        FunctionCallee create = module->getOrInsertFunction(
+            "kaleidoscope_array_new", getType(ValueType::Array), Type::getInt64Ty(*context));
+        // Truncates; negative lengths and NaN yield an empty array. Lengths are
+        // clamped to 2^62 to keep the conversion defined, the runtime then
+        // fails to allocate.
+        Value* length = builder->CreateFPToSI(
+            builder->CreateMinNum(
+                builder->CreateMaxNum(convert(args[0], Type::getDoubleTy(*context)),
+                                      ConstantFP::get(*context, APFloat(0.0))),
+                ConstantFP::get(*context, APFloat(0x1p62))),
+            Type::getInt64Ty(*context));
+        return builder->CreateCall(create, {length}, "array");
+      }
+      if (builtin->builtin == Builtin::Length) {
+        return share(node, builder->CreateLoad(Type::getInt64Ty(*context),
+                                               builder->CreateStructGEP(getArrayTy(), args[0], 1), "length"));
+      }
+      // In single precision iff all arguments are f32
+      Type* type = Type::getFloatTy(*context);
+      for (Value* arg : args) {
+        if (!arg->getType()->isFloatTy()) {
+          type = Type::getDoubleTy(*context);
+        }
+      }
+      for (Value*& arg : args) {
+        arg = convert(arg, type);
+      }
+      return share(node, builder->CreateIntrinsic(getIntrinsic(builtin->builtin), {type}, args, nullptr, "calltmp"));
+    }
+
+    Function* calleeF = getFunction(node.getCallee());
     if (!calleeF) {
       return logError("Unknown function referenced");
     }
@@ -132,53 +882,150 @@ public:
     }
     std::vector<Value*> args;
     for (auto& arg : node.getArgs()) {
-      args.push_back(md::visit(*this, *arg));
-      if (!args.back()) {
+      Value* v = ast::visit(*this, *arg);
+      if (!v) {
         return nullptr;
       }
+      Type* paramTy = calleeF->getFunctionType()->getParamType(args.size());
+      if (isArray(v) != paramTy->isPointerTy()) {
+        return logError("Argument does not match the parameter type");
+      }
+      args.push_back(convert(v, paramTy));
+    }
+    if (tailCalls.count(&node)) {
+      return emitTailCall(calleeF, args);
     }
-    return builder.CreateCall(calleeF, args, "calltmp");
+    // The callee may write to arrays
+    invalidateShared();
+    return builder->CreateCall(calleeF, args, "calltmp");
+  }
+  Value* operator()(IndexExprAST& node) {
+    if (Value* v = findShared(node)) {
+      return v;
+    }
+    if (Value* intIndex = findInBounds(node)) {
+      Value* array = (*this)(static_cast<VariableExprAST&>(node.getArray()));
+      Value* data = builder->CreateLoad(Type::getDoublePtrTy(*context),
+                                        builder->CreateStructGEP(getArrayTy(), array, 0), "data");
+      return share(node, builder->CreateLoad(Type::getDoubleTy(*context),
+                                             builder->CreateInBoundsGEP(Type::getDoubleTy(*context), data, intIndex),
+                                             "element"));
+    }
+    Value* array = ast::visit(*this, node.getArray());
+    if (!array) {
+      return nullptr;
+    }
+    Value* index = emitIndex(node.getIndex());
+    if (!index) {
+      return nullptr;
+    }
+    if (!isArray(array) || isArray(index)) {
+      return logError("Only arrays can be indexed, and only by numbers");
+    }
+    return share(node, emitElementAccess(array, index, nullptr));
+  }
+  // array[index] = value; the value is evaluated last
+  Value* emitStore(IndexExprAST& node, ExprAST& valueNode) {
+    if (Value* intIndex = findInBounds(node)) {
+      Value* value = ast::visit(*this, valueNode);
+      if (!value) {
+        return nullptr;
+      }
+      if (isArray(value)) {
+        return logError("Array elements are doubles");
+      }
+      value = convert(value, Type::getDoubleTy(*context));
+      Value* array = (*this)(static_cast<VariableExprAST&>(node.getArray()));
+      Value* data = builder->CreateLoad(Type::getDoublePtrTy(*context),
+                                        builder->CreateStructGEP(getArrayTy(), array, 0), "data");
+      builder->CreateStore(value, builder->CreateInBoundsGEP(Type::getDoubleTy(*context), data, intIndex));
+      invalidateShared();
+      return value;
+    }
+    Value* array = ast::visit(*this, node.getArray());
+    if (!array) {
+      return nullptr;
+    }
+    Value* index = emitIndex(node.getIndex());
+    if (!index) {
+      return nullptr;
+    }
+    Value* value = ast::visit(*this, valueNode);
+    if (!value) {
+      return nullptr;
+    }
+    if (!isArray(array) || isArray(index) || isArray(value)) {
+      return logError("Only arrays can be indexed, and only by numbers; elements are doubles");
+    }
+    return emitElementAccess(array, index, convert(value, Type::getDoubleTy(*context)));
   }
   Value* operator()(IfExprAST& node) {
-    Value* Cond = md::visit(*this, node.getCond());
+    Value* Cond = ast::visit(*this, node.getCond());
     if (!Cond) {
       return nullptr;
     }
 
-    Cond = builder.CreateFCmpONE(Cond, ConstantFP::get(context, APFloat(0.0)), "ifcond");
+    Cond = emitCondition(Cond);
+    if (!Cond) {
+      return nullptr;
+    }
 
-    Function* f = builder.GetInsertBlock()->getParent();
+    Function* f = builder->GetInsertBlock()->getParent();
 
-    BasicBlock* ThenBB = BasicBlock::Create(context, "then", f);
-    BasicBlock* ElseBB = BasicBlock::Create(context, "else");
-    BasicBlock* MergeBB = BasicBlock::Create(context, "ifcont");
+    BasicBlock* ThenBB = BasicBlock::Create(*context, "then", f);
+    BasicBlock* ElseBB = BasicBlock::Create(*context, "else");
+    BasicBlock* MergeBB = BasicBlock::Create(*context, "ifcont");
 
-    builder.CreateCondBr(Cond, ThenBB, ElseBB);
+    unsigned site = ifSites++;
+    BranchInst* br = builder->CreateCondBr(Cond, ThenBB, ElseBB);
+    if (feedback) {
+      br->setMetadata(LLVMContext::MD_prof,
+                      getBranchWeights(feedback->getCount(currentDefinition, SiteKind::Then, site),
+                                       feedback->getCount(currentDefinition, SiteKind::Else, site)));
+    }
 
-    builder.SetInsertPoint(ThenBB);
+    builder->SetInsertPoint(ThenBB);
+    if (instrumentation) {
+      emitCounter(SiteKind::Then, site);
+    }
 
-    Value* Then = md::visit(*this, node.getThen());
+    Value* Then = ast::visit(*this, node.getThen());
     if (!Then) {
       return nullptr;
     }
-
-    builder.CreateBr(MergeBB);
-    ThenBB = builder.GetInsertBlock();
+    ThenBB = builder->GetInsertBlock();
 
     f->getBasicBlockList().push_back(ElseBB);
-    builder.SetInsertPoint(ElseBB);
+    builder->SetInsertPoint(ElseBB);
+    if (instrumentation) {
+      emitCounter(SiteKind::Else, site);
+    }
 
-    Value* Else = md::visit(*this, node.getElse());
+    Value* Else = ast::visit(*this, node.getElse());
     if (!Else) {
       return nullptr;
     }
-
-    builder.CreateBr(MergeBB);
-    ElseBB = builder.GetInsertBlock();
+    ElseBB = builder->GetInsertBlock();
+
+    // Branches of different numeric types are converted at the end of each
+    // branch, before they merge
+    Type* type = Then->getType();
+    if (Else->getType() != type) {
+      type = promote(Then->getType(), Else->getType());
+      if (!type) {
+        return logError("Both branches of if must have the same type");
+      }
+    }
+    builder->SetInsertPoint(ThenBB);
+    Then = convert(Then, type);
+    builder->CreateBr(MergeBB);
+    builder->SetInsertPoint(ElseBB);
+    Else = convert(Else, type);
+    builder->CreateBr(MergeBB);
 
     f->getBasicBlockList().push_back(MergeBB);
-    builder.SetInsertPoint(MergeBB);
-    PHINode* phi = builder.CreatePHI(Type::getDoubleTy(context), 2, "iftmp");
+    builder->SetInsertPoint(MergeBB);
+    PHINode* phi = builder->CreatePHI(type, 2, "iftmp");
 
     phi->addIncoming(Then, ThenBB);
     phi->addIncoming(Else, ElseBB);
@@ -186,62 +1033,93 @@ public:
     return phi;
   }
   Value* operator()(ForExprAST& node) {
-    Function* f = builder.GetInsertBlock()->getParent();
+    Function* f = builder->GetInsertBlock()->getParent();
 
-    AllocaInst* Alloca = CreateEntryBlockAlloca(f, node.getVarName());
-
-    Value* Start = md::visit(*this, node.getStart());
+    // Counts in i64 if the start is an integer, too, e.g. len(a) or a literal
+    bool integer = isIntegerLoop(node);
+    Value* Start = integer ? emitOperand(node.getStart(), Type::getInt64Ty(*context))
+                           : ast::visit(*this, node.getStart());
     if (!Start) {
       return nullptr;
     }
+    if (isArray(Start)) {
+      return logError("Loop variables must be numbers");
+    }
+    integer = integer && Start->getType()->isIntegerTy(64);
+    Type* VarTy = integer ? Type::getInt64Ty(*context) : Type::getDoubleTy(*context);
+    Start = convert(Start, VarTy);
 
-    builder.CreateStore(Start, Alloca);
+    AllocaInst* Alloca = CreateEntryBlockAlloca(f, name(node.getVarName()), VarTy);
+    builder->CreateStore(Start, Alloca);
 
-    BasicBlock* PreheaderBB = builder.GetInsertBlock();
-    BasicBlock* LoopBB = BasicBlock::Create(context, "loop", f);
+    unsigned site = loopSites++;
+    if (instrumentation) {
+      emitCounter(SiteKind::LoopEntry, site);
+    }
 
-    builder.CreateBr(LoopBB);
+    BasicBlock* PreheaderBB = builder->GetInsertBlock();
+    BasicBlock* LoopBB = BasicBlock::Create(*context, "loop", f);
 
-    builder.SetInsertPoint(LoopBB);
+    builder->CreateBr(LoopBB);
 
-    PHINode* Variable = builder.CreatePHI(Type::getDoubleTy(context), 2, node.getVarName());
+    builder->SetInsertPoint(LoopBB);
+
+    PHINode* Variable = builder->CreatePHI(VarTy, 2, name(node.getVarName()));
     Variable->addIncoming(Start, PreheaderBB);
 
     AllocaInst* OldVal = namedValues[node.getVarName()];
     namedValues[node.getVarName()] = Alloca;
+    if (integer) {
+      countingVariables.insert(Alloca);
+    }
+    invalidateShared();
 
-    Value* Body = md::visit(*this, node.getBody());
+    Value* Body = ast::visit(*this, node.getBody());
     if (!Body) {
       return nullptr;
     }
 
     Value* Step = nullptr;
     if (node.getStep()) {
-      Step = md::visit(*this, node.getStep()->get());
+      Step = emitOperand(node.getStep()->get(), VarTy);
       if (!Step) {
         return nullptr;
       }
     } else {
-      Step = ConstantFP::get(context, APFloat(1.0));
+      Step = integer ? ConstantInt::get(VarTy, 1) : ConstantFP::get(*context, APFloat(1.0));
     }
 
-    Value* End = md::visit(*this, node.getEnd());
+    Value* End = ast::visit(*this, node.getEnd());
     if (!End) {
       return nullptr;
     }
+    if (isArray(Step) || isArray(End)) {
+      return logError("Loop steps and conditions must be numbers");
+    }
+    Step = convert(Step, VarTy);
 
-    Value* CurVar = builder.CreateLoad(Alloca);
-    Value* NextVar = builder.CreateFAdd(CurVar, Step, "nextvar");
-    builder.CreateStore(NextVar, Alloca);
+    Value* CurVar = builder->CreateLoad(Alloca);
+    Value* NextVar = integer ? builder->CreateAdd(CurVar, Step, "nextvar", false, true)
+                             : builder->CreateFAdd(CurVar, Step, "nextvar");
+    builder->CreateStore(NextVar, Alloca);
 
-    End = builder.CreateFCmpONE(End, ConstantFP::get(context, APFloat(0.0)), "loopcond");
+    End = emitCondition(End);
+    if (instrumentation) {
+      emitCounter(SiteKind::LoopIteration, site);
+    }
 
-    BasicBlock* LoopEndBB = builder.GetInsertBlock();
-    BasicBlock* AfterBB = BasicBlock::Create(context, "afterloop", f);
+    BasicBlock* LoopEndBB = builder->GetInsertBlock();
+    BasicBlock* AfterBB = BasicBlock::Create(*context, "afterloop", f);
 
-    builder.CreateCondBr(End, LoopBB, AfterBB);
+    BranchInst* br = builder->CreateCondBr(End, LoopBB, AfterBB);
+    if (feedback) {
+      // Every entry leaves the loop once, all other iterations branch back
+      std::uint64_t entries = feedback->getCount(currentDefinition, SiteKind::LoopEntry, site);
+      std::uint64_t iterations = feedback->getCount(currentDefinition, SiteKind::LoopIteration, site);
+      br->setMetadata(LLVMContext::MD_prof, getBranchWeights(iterations - std::min(entries, iterations), entries));
+    }
 
-    builder.SetInsertPoint(AfterBB);
+    builder->SetInsertPoint(AfterBB);
 
     Variable->addIncoming(NextVar, LoopEndBB);
 
@@ -250,35 +1128,237 @@ public:
     } else {
       namedValues.erase(node.getVarName());
     }
+    invalidateShared();
+
+    return Constant::getNullValue(Type::getDoubleTy(*context));
+  }
+  /// The body is outlined into "double <f>.parfor(double const* env, i64
+  /// begin, i64 end)", which reduces iterations [begin, end). env holds the
+  /// start value and the values of all variables in scope, which the chunk
+  /// copies into fresh allocas before every iteration. The runtime calls the
+  /// chunk function from multiple threads.
+  Value* operator()(ParForExprAST& node) {
+    Type* doubleTy = Type::getDoubleTy(*context);
+    Type* doublePtrTy = Type::getDoublePtrTy(*context);
+    Type* indexTy = Type::getInt64Ty(*context);
+    Function* f = builder->GetInsertBlock()->getParent();
+
+    Value* Start = ast::visit(*this, node.getStart());
+    if (!Start) {
+      return nullptr;
+    }
+    Value* End = ast::visit(*this, node.getEnd());
+    if (!End) {
+      return nullptr;
+    }
+    if (isArray(Start) || isArray(End)) {
+      return logError("Loop bounds must be numbers");
+    }
+    Start = convert(Start, doubleTy);
+    End = convert(End, doubleTy);
+
+    // i = s + k exactly for an integer s, hence i is an i64 unless the body
+    // assigns to it. "parfor i = s, len(a)" with s >= 0 then only indexes
+    // a[i] in bounds, unless the body assigns to a.
+    std::int64_t intStart = 0;
+    std::unordered_set<Symbol> assigned;
+    ast::visit(AssignmentCollector(assigned), node.getBody());
+    bool integerStart = isExactInteger(node.getStart(), intStart) && assigned.count(node.getVarName()) == 0;
+    bool integerVar = integerStart && integerLoops;
+    std::vector<Symbol> inBoundsArrays;
+    if (integerStart && intStart >= 0) {
+      collectLengths(node.getEnd(), inBoundsArrays);
+      inBoundsArrays.erase(std::remove_if(inBoundsArrays.begin(), inBoundsArrays.end(),
+                                          [&](Symbol a) { return assigned.count(a) > 0; }),
+                           inBoundsArrays.end());
+    }
+
+    // count = min(max(ceil(end - start), 0), 2^62); false for NaN. The clamp keeps
+    // the conversion defined for huge or infinite ranges.
+    Value* Iterations = builder->CreateIntrinsic(Intrinsic::ceil, {doubleTy},
+                                                 {builder->CreateFSub(End, Start)}, nullptr, "iterations");
+    Value* Positive = builder->CreateFCmpOGT(Iterations, ConstantFP::get(doubleTy, 0.0));
+    Iterations = builder->CreateMinNum(Iterations, ConstantFP::get(doubleTy, 0x1p62));
+    Value* Count = builder->CreateSelect(Positive, builder->CreateFPToSI(Iterations, indexTy),
+                                         ConstantInt::get(indexTy, 0), "count");
+
+    std::vector<std::pair<Symbol, AllocaInst*>> captures;
+    for (auto& entry : namedValues) {
+      if (entry.second) {
+        captures.push_back(entry);
+      }
+    }
+
+    Value* Env;
+    {
+      IRBuilder<> tmp(&f->getEntryBlock(), f->getEntryBlock().begin());
+      Env = tmp.CreateAlloca(doubleTy, ConstantInt::get(Type::getInt32Ty(*context), captures.size() + 1), "env");
+    }
+    // Every slot holds 8 bytes, which fit a double or a pointer
+    auto envSlot = [&](Value* env, std::size_t i, Type* type) {
+      return builder->CreateBitCast(builder->CreateConstInBoundsGEP1_64(doubleTy, env, i),
+                                    PointerType::getUnqual(type));
+    };
+    builder->CreateStore(Start, builder->CreateConstInBoundsGEP1_64(doubleTy, Env, 0));
+    for (std::size_t i = 0; i < captures.size(); ++i) {
+      Type* type = captures[i].second->getAllocatedType();
+      builder->CreateStore(builder->CreateLoad(type, captures[i].second), envSlot(Env, i + 1, type));
+    }
+
+    FunctionType* chunkTy = FunctionType::get(doubleTy, {doublePtrTy, indexTy, indexTy}, false);
+    Function* chunk = Function::Create(chunkTy, Function::InternalLinkage, f->getName() + ".parfor", module.get());
+    auto arg = chunk->arg_begin();
+    Argument* ChunkEnv = arg++;
+    ChunkEnv->setName("env");
+    ChunkEnv->addAttr(Attribute::NoAlias);
+    ChunkEnv->addAttr(Attribute::ReadOnly);
+    Argument* Begin = arg++;
+    Begin->setName("begin");
+    Argument* ChunkEnd = arg;
+    ChunkEnd->setName("end");
+
+    BasicBlock* CallerBB = builder->GetInsertBlock();
+    invalidateShared();
+    auto OldValues = std::move(namedValues);
+    namedValues.clear();
+    auto OldInBounds = std::move(inBounds);
+    inBounds.clear();
+
+    BasicBlock* EntryBB = BasicBlock::Create(*context, "entry", chunk);
+    BasicBlock* LoopBB = BasicBlock::Create(*context, "loop", chunk);
+    BasicBlock* AfterBB = BasicBlock::Create(*context, "afterloop", chunk);
+    builder->SetInsertPoint(EntryBB);
+    Value* ChunkStart = builder->CreateLoad(doubleTy, ChunkEnv, "start");
+    Value* Identity = ConstantFP::get(doubleTy, getIdentity(node.getReduction()));
+    builder->CreateCondBr(builder->CreateICmpSLT(Begin, ChunkEnd), LoopBB, AfterBB);
+
+    builder->SetInsertPoint(LoopBB);
+    PHINode* K = builder->CreatePHI(indexTy, 2, "k");
+    K->addIncoming(Begin, EntryBB);
+    PHINode* Acc = builder->CreatePHI(doubleTy, 2, "acc");
+    Acc->addIncoming(Identity, EntryBB);
+    for (std::size_t i = 0; i < captures.size(); ++i) {
+      Type* type = captures[i].second->getAllocatedType();
+      AllocaInst* Alloca = CreateEntryBlockAlloca(chunk, name(captures[i].first), type);
+      Value* Captured = builder->CreateLoad(type, envSlot(ChunkEnv, i + 1, type));
+      builder->CreateStore(Captured, Alloca);
+      namedValues[captures[i].first] = Alloca;
+      if (countingVariables.count(captures[i].second)) {
+        countingVariables.insert(Alloca);
+      }
+    }
+    Value* intIndex = nullptr;
+    if (integerStart) {
+      intIndex = builder->CreateAdd(ConstantInt::get(indexTy, intStart), K, "index", false, true);
+    }
+    AllocaInst* Variable = CreateEntryBlockAlloca(chunk, name(node.getVarName()), integerVar ? indexTy : doubleTy);
+    builder->CreateStore(integerVar ? intIndex : builder->CreateFAdd(ChunkStart, builder->CreateSIToFP(K, doubleTy)),
+                         Variable);
+    namedValues[node.getVarName()] = Variable;
+    if (integerVar) {
+      countingVariables.insert(Variable);
+    }
+    if (!inBoundsArrays.empty()) {
+      for (Symbol array : inBoundsArrays) {
+        if (namedValues[array] && namedValues[array]->getAllocatedType() == getType(ValueType::Array)) {
+          inBounds.push_back({namedValues[array], Variable, intIndex});
+        }
+      }
+    }
+
+    // Counters are not atomic increments, hence would lose counts when hit by
+    // all threads at once. Sites are numbered as with instrumentation.
+    Profile* OldInstrumentation = instrumentation;
+    Profile const* OldFeedback = feedback;
+    instrumentation = nullptr;
+    feedback = nullptr;
+    Value* Body = ast::visit(*this, node.getBody());
+    instrumentation = OldInstrumentation;
+    feedback = OldFeedback;
+    if (Body && isArray(Body)) {
+      Body = logError("Bodies of parallel loops must be numbers");
+    } else if (Body) {
+      Body = convert(Body, doubleTy);
+    }
+    if (!Body) {
+      chunk->eraseFromParent();
+      namedValues = std::move(OldValues);
+      inBounds = std::move(OldInBounds);
+      builder->SetInsertPoint(CallerBB);
+      invalidateShared();
+      return nullptr;
+    }
 
-    return Constant::getNullValue(Type::getDoubleTy(context));
+    Value* NextAcc;
+    switch (node.getReduction()) {
+      case Reduction::Sum: NextAcc = builder->CreateFAdd(Acc, Body); break;
+      case Reduction::Product: NextAcc = builder->CreateFMul(Acc, Body); break;
+      case Reduction::Min: NextAcc = builder->CreateMinNum(Acc, Body); break;
+      case Reduction::Max: NextAcc = builder->CreateMaxNum(Acc, Body); break;
+    }
+    Value* NextK = builder->CreateAdd(K, ConstantInt::get(indexTy, 1), "nextk", true, true);
+    BasicBlock* LoopEndBB = builder->GetInsertBlock();
+    K->addIncoming(NextK, LoopEndBB);
+    Acc->addIncoming(NextAcc, LoopEndBB);
+    builder->CreateCondBr(builder->CreateICmpSLT(NextK, ChunkEnd), LoopBB, AfterBB);
+
+    builder->SetInsertPoint(AfterBB);
+    PHINode* Result = builder->CreatePHI(doubleTy, 2, "result");
+    Result->addIncoming(Identity, EntryBB);
+    Result->addIncoming(NextAcc, LoopEndBB);
+    builder->CreateRet(Result);
+    llvm::verifyFunction(*chunk, &llvm::errs());
+
+    namedValues = std::move(OldValues);
+    inBounds = std::move(OldInBounds);
+    builder->SetInsertPoint(CallerBB);
+    // The body may write to arrays
+    invalidateShared();
+
+    FunctionCallee Runtime = module->getOrInsertFunction(
+        "kaleidoscope_parallel_for", doubleTy, PointerType::getUnqual(chunkTy), doublePtrTy, indexTy,
+        Type::getInt32Ty(*context));
+    return builder->CreateCall(Runtime, {chunk, Env, Count,
+                                         ConstantInt::get(Type::getInt32Ty(*context),
+                                                          static_cast<int>(node.getReduction()))},
+                               "parfor");
   }
   Value* operator()(VarExprAST& node) {
     std::vector<AllocaInst*> OldBindings;
 
-    Function* f = builder.GetInsertBlock()->getParent();
+    Function* f = builder->GetInsertBlock()->getParent();
 
-    for (auto& entry : node.getVarNames()) {
-      std::string const& VarName = entry.first;
-      ExprAST* Init = entry.second.get();
+    for (std::size_t i = 0; i < node.getVarNames().size(); ++i) {
+      Symbol VarName = node.getVarNames()[i].first;
+      ExprAST* Init = node.getVarNames()[i].second;
+      auto VarType = node.getVarType(i);
 
       Value* InitVal;
       if (Init) {
-        InitVal = md::visit(*this, *Init);
+        InitVal = ast::visit(*this, *Init);
         if (!InitVal) {
           return nullptr;
         }
+      } else if (VarType == ValueType::Array) {
+        return logError("Arrays must be initialized");
       } else {
-        InitVal = ConstantFP::get(context, APFloat(0.0));
+        InitVal = ConstantFP::get(*context, APFloat(0.0));
+      }
+      // Variables without a type are doubles, unless they hold an array
+      Type* type = VarType ? getType(*VarType) : isArray(InitVal) ? InitVal->getType() : Type::getDoubleTy(*context);
+      InitVal = convert(InitVal, type);
+      if (!InitVal) {
+        return nullptr;
       }
 
-      AllocaInst* Alloca = CreateEntryBlockAlloca(f, VarName);
-      builder.CreateStore(InitVal, Alloca);
+      AllocaInst* Alloca = CreateEntryBlockAlloca(f, name(VarName), type);
+      builder->CreateStore(InitVal, Alloca);
       OldBindings.push_back(namedValues[VarName]);
       namedValues[VarName] = Alloca;
+      invalidateShared();
     }
 
-    Value* BodyVal = md::visit(*this, node.getBody());
+    Value* BodyVal = ast::visit(*this, node.getBody());
     if (!BodyVal) {
       return nullptr;
     }
@@ -287,55 +1367,103 @@ public:
     for (auto& entry : node.getVarNames()) {
       namedValues[entry.first] = *it++;
     }
+    invalidateShared();
 
     return BodyVal;
   }
   Function* operator()(PrototypeAST& node) {
-    auto const& args = node.getArgs();
-    std::vector<Type*> doubles(args.size(), Type::getDoubleTy(context));
-    FunctionType* ft = FunctionType::get(Type::getDoubleTy(context), doubles, false);
-    Function* f = Function::Create(ft, Function::ExternalLinkage, node.getName(), module.get());
-
-    assert(f->arg_size() == args.size());
-    auto it = args.begin();
-    for (auto& arg : f->args()) {
-      arg.setName(*it++);
+    if (!checkPrototype(node)) {
+      return nullptr;
     }
-
-    return f;
+    addPrototype(node);
+    return declareFunction(node.getName(), functionProtos[node.getName()]);
   }
   Function* operator()(FunctionAST& node) {
-    Function* f = module->getFunction(node.getPrototype().getName());
-
-    if (!f) {
-      f = static_cast<Function*>(md::visit(*this, node.getPrototype()));
+    auto const& args = node.getPrototype().getArgs();
+    if (findBuiltin(node.getPrototype().getName().str())) {
+      return logErrorF("Builtins cannot be redefined");
     }
-    if (!f) {
+    // Other modules may call the function with the known signature already
+    if (!checkPrototype(node.getPrototype())) {
       return nullptr;
     }
+    // The prototype is only recorded once the body has been generated, such
+    // that nothing refers to a function that failed
+    Signature signature = getSignature(node.getPrototype());
+    Function* f = module->getFunction(name(node.getPrototype().getName()));
+    if (!f) {
+      f = declareFunction(node.getPrototype().getName(), signature);
+    }
     if (!f->empty()) {
       return logErrorF("Function cannot be redefined");
     }
-    BasicBlock* bb = BasicBlock::Create(context, "entry", f);
-    builder.SetInsertPoint(bb);
+    if (f->arg_size() != args.size()) {
+      return logErrorF("Function redefined with a different number of arguments");
+    }
+    if (f->getFunctionType() != getFunctionType(signature)) {
+      return logErrorF("Function redefined with different types");
+    }
+    BasicBlock* bb = BasicBlock::Create(*context, "entry", f);
+    builder->SetInsertPoint(bb);
 
     namedValues.clear();
+    countingVariables.clear();
+    shared.clear();
+    auto argName = args.begin();
+    inBounds.clear();
+    argAllocas.clear();
     for (auto& arg : f->args()) {
-      AllocaInst* Alloca = CreateEntryBlockAlloca(f, arg.getName());
-      builder.CreateStore(&arg, Alloca);
-      namedValues[arg.getName()] = Alloca;
+      AllocaInst* Alloca = CreateEntryBlockAlloca(f, arg.getName(), arg.getType());
+      builder->CreateStore(&arg, Alloca);
+      namedValues[*argName++] = Alloca;
+      argAllocas.push_back(Alloca);
+    }
+
+    currentDefinition = node.getPrototype().getName();
+    ifSites = 0;
+    loopSites = 0;
+    if (feedback) {
+      f->setEntryCount(Function::ProfileCount(feedback->getCount(currentDefinition, SiteKind::Entry),
+                                              Function::PCT_Real));
+    }
+
+    tailCalls.clear();
+    ast::visit(TailCallCollector(tailCalls), node.getBody());
+    recurseBB = nullptr;
+    for (CallExprAST const* call : tailCalls) {
+      if (call->getCallee() == node.getPrototype().getName()) {
+        recurseBB = BasicBlock::Create(*context, "tailrecurse", f);
+        builder->CreateBr(recurseBB);
+        builder->SetInsertPoint(recurseBB);
+        break;
+      }
+    }
+    // Self tail calls branch to recurseBB, hence count as calls, too
+    if (instrumentation) {
+      emitCounter(SiteKind::Entry, 0);
     }
 
-    Value* retVal = md::visit(*this, node.getBody());
+    Value* retVal = ast::visit(*this, node.getBody());
+    if (retVal && isArray(retVal) != f->getReturnType()->isPointerTy()) {
+      retVal = logError("Function body does not match the return type");
+    } else if (retVal) {
+      retVal = convert(retVal, f->getReturnType());
+    }
     if (retVal) {
-      builder.CreateRet(retVal);
-      llvm::verifyFunction(*f, &llvm::errs());
-      fpm->run(*f);
-      return f;
+      builder->CreateRet(retVal);
+      if (!llvm::verifyFunction(*f, &llvm::errs())) {
+        functionProtos[node.getPrototype().getName()] = std::move(signature);
+        return f;
+      }
     }
 
-    f->eraseFromParent();
-    return f;
+    // Other functions of this module might refer to f already
+    if (f->use_empty()) {
+      f->eraseFromParent();
+    } else {
+      f->deleteBody();
+    }
+    return nullptr;
   }
 };
 
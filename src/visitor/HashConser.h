@@ -0,0 +1,235 @@
+#ifndef K_VISITOR_HASH_CONSER_H_
+#define K_VISITOR_HASH_CONSER_H_
+
+#include <cstdint>
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <unordered_set>
+#include <vector>
+
+#include "visitor/Visit.h"
+#include "Arena.h"
+#include "AST.h"
+#include "Builtins.h"
+
+/// Copies trees into an arena such that structurally equal pure subtrees are
+/// a single node, shared within and across all trees copied by the same
+/// conser. Pure are numbers, variables, operators other than '=', element
+/// reads and calls of builtins other than array. Sharing a variable does not
+/// share its binding, which is resolved wherever the node is used, hence the
+/// copy means the same as the original. The result is a DAG: visitors that
+/// key on nodes must not assume a node occurs only once, and trees must not
+/// be rewritten in place afterwards (e.g. by Simplifier).
+/// Each operator() returns the copy of the visited node.
+class HashConser {
+private:
+  // Children are canonical already, hence nodes are compared shallowly
+  struct Hash {
+    std::size_t operator()(ExprAST const* node) const;
+  };
+  struct Equal {
+    bool operator()(ExprAST const* a, ExprAST const* b) const;
+  };
+
+  Arena& arena;
+  std::unordered_set<ExprAST*, Hash, Equal> nodes;
+  std::size_t numShared = 0;
+  std::size_t numCopied = 0;
+
+  static std::uint64_t bits(double number) {
+    std::uint64_t result;
+    std::memcpy(&result, &number, sizeof(result));
+    return result;
+  }
+  static std::size_t mix(std::size_t seed, std::size_t value) {
+    return seed ^ (value + 0x9e3779b97f4a7c15 + (seed << 6) + (seed >> 2));
+  }
+
+  // Returns the node equal to probe, a temporary, or a copy of probe.
+  template<typename Node>
+  ExprAST* intern(Node& probe) {
+    auto it = nodes.find(&probe);
+    if (it != nodes.end()) {
+      ++numShared;
+      return *it;
+    }
+    return *nodes.insert(copy(probe)).first;
+  }
+
+  template<typename Node>
+  ExprAST* copy(Node const& node) {
+    ++numCopied;
+    return arena.make<Node>(node);
+  }
+
+  static bool isPure(CallExprAST const& node) {
+    auto builtin = findBuiltin(node.getCallee().str());
+    return builtin && builtin->builtin != Builtin::Array;
+  }
+
+public:
+  explicit HashConser(Arena& arena)
+    : arena(arena) {}
+
+  /// Nodes that were found in the conser rather than copied.
+  std::size_t getNumShared() const { return numShared; }
+  /// Nodes that were copied to the arena, i.e. the size of all copies.
+  std::size_t getNumCopied() const { return numCopied; }
+
+  ExprAST* operator()(ExprAST& node) { return &node; }
+
+  ExprAST* operator()(NumberExprAST& node) { return intern(node); }
+
+  ExprAST* operator()(VariableExprAST& node) { return intern(node); }
+
+  ExprAST* operator()(BinaryExprAST& node) {
+    BinaryExprAST probe(node.getOp(), ast::visit(*this, node.getLHS()), ast::visit(*this, node.getRHS()));
+    return node.getOp() == '=' ? copy(probe) : intern(probe);
+  }
+
+  ExprAST* operator()(CallExprAST& node) {
+    std::vector<ExprAST*> args;
+    for (auto arg : node.getArgs()) {
+      args.push_back(ast::visit(*this, *arg));
+    }
+    if (isPure(node)) {
+      // The probe points to the vector, the copy to the arena
+      CallExprAST probe(node.getCallee(), Span<ExprAST*>(args.data(), args.size()));
+      auto it = nodes.find(&probe);
+      if (it != nodes.end()) {
+        ++numShared;
+        return *it;
+      }
+      return *nodes.insert(copy(CallExprAST(node.getCallee(), arena.copy(args.data(), args.size())))).first;
+    }
+    return copy(CallExprAST(node.getCallee(), arena.copy(args.data(), args.size())));
+  }
+
+  ExprAST* operator()(IndexExprAST& node) {
+    IndexExprAST probe(ast::visit(*this, node.getArray()), ast::visit(*this, node.getIndex()));
+    return intern(probe);
+  }
+
+  ExprAST* operator()(IfExprAST& node) {
+    return copy(IfExprAST(ast::visit(*this, node.getCond()), ast::visit(*this, node.getThen()),
+                          ast::visit(*this, node.getElse())));
+  }
+
+  ExprAST* operator()(ForExprAST& node) {
+    ExprAST* start = ast::visit(*this, node.getStart());
+    ExprAST* end = ast::visit(*this, node.getEnd());
+    ExprAST* step = node.getStep() ? ast::visit(*this, node.getStep()->get()) : nullptr;
+    return copy(ForExprAST(node.getVarName(), start, end, step, ast::visit(*this, node.getBody())));
+  }
+
+  ExprAST* operator()(ParForExprAST& node) {
+    ExprAST* start = ast::visit(*this, node.getStart());
+    ExprAST* end = ast::visit(*this, node.getEnd());
+    return copy(ParForExprAST(node.getVarName(), node.getReduction(), start, end,
+                              ast::visit(*this, node.getBody())));
+  }
+
+  ExprAST* operator()(VarExprAST& node) {
+    auto varNames = arena.copy(node.getVarNames().begin(), node.getVarNames().size());
+    for (auto& entry : varNames) {
+      if (entry.second) {
+        entry.second = ast::visit(*this, *entry.second);
+      }
+    }
+    Span<std::optional<ValueType>> varTypes;
+    if (node.hasVarTypes()) {
+      varTypes = arena.makeSpan<std::optional<ValueType>>(varNames.size());
+      for (std::size_t i = 0; i < varNames.size(); ++i) {
+        varTypes[i] = node.getVarType(i);
+      }
+    }
+    return copy(VarExprAST(varNames, ast::visit(*this, node.getBody()), varTypes));
+  }
+
+  PrototypeAST* operator()(PrototypeAST& node) {
+    auto args = arena.copy(node.getArgs().begin(), node.getArgs().size());
+    Span<ValueType> argTypes;
+    if (!node.isScalar()) {
+      argTypes = arena.makeSpan<ValueType>(args.size());
+      for (std::size_t i = 0; i < args.size(); ++i) {
+        argTypes[i] = node.getArgType(i);
+      }
+    }
+    return arena.make<PrototypeAST>(node.getName(), args, argTypes, node.getReturnType());
+  }
+
+  FunctionAST* operator()(FunctionAST& node) {
+    return arena.make<FunctionAST>(ast::visit(*this, node.getPrototype()), ast::visit(*this, node.getBody()));
+  }
+};
+
+inline std::size_t HashConser::Hash::operator()(ExprAST const* node) const {
+  std::size_t seed = static_cast<std::size_t>(node->getKind());
+  switch (node->getKind()) {
+    case ExprKind::Number: {
+      auto number = static_cast<NumberExprAST const*>(node);
+      seed = mix(seed, static_cast<std::size_t>(number->isLiteral()));
+      return mix(seed, std::hash<std::uint64_t>()(bits(number->getNumber())));
+    }
+    case ExprKind::Variable:
+      return mix(seed, std::hash<Symbol>()(static_cast<VariableExprAST const*>(node)->getName()));
+    case ExprKind::Binary: {
+      auto binary = const_cast<BinaryExprAST*>(static_cast<BinaryExprAST const*>(node));
+      seed = mix(seed, static_cast<std::size_t>(binary->getOp()));
+      seed = mix(seed, std::hash<ExprAST*>()(&binary->getLHS()));
+      return mix(seed, std::hash<ExprAST*>()(&binary->getRHS()));
+    }
+    case ExprKind::Call: {
+      auto call = static_cast<CallExprAST const*>(node);
+      seed = mix(seed, std::hash<Symbol>()(call->getCallee()));
+      for (ExprAST* arg : call->getArgs()) {
+        seed = mix(seed, std::hash<ExprAST*>()(arg));
+      }
+      return seed;
+    }
+    case ExprKind::Index: {
+      auto index = const_cast<IndexExprAST*>(static_cast<IndexExprAST const*>(node));
+      seed = mix(seed, std::hash<ExprAST*>()(&index->getArray()));
+      return mix(seed, std::hash<ExprAST*>()(&index->getIndex()));
+    }
+    default:
+      return seed;
+  }
+}
+
+inline bool HashConser::Equal::operator()(ExprAST const* a, ExprAST const* b) const {
+  if (a->getKind() != b->getKind()) {
+    return false;
+  }
+  switch (a->getKind()) {
+    case ExprKind::Number: {
+      auto x = static_cast<NumberExprAST const*>(a);
+      auto y = static_cast<NumberExprAST const*>(b);
+      // Literals and computed numbers may be emitted with different types
+      return bits(x->getNumber()) == bits(y->getNumber()) && x->isLiteral() == y->isLiteral();
+    }
+    case ExprKind::Variable:
+      return static_cast<VariableExprAST const*>(a)->getName() == static_cast<VariableExprAST const*>(b)->getName();
+    case ExprKind::Binary: {
+      auto x = const_cast<BinaryExprAST*>(static_cast<BinaryExprAST const*>(a));
+      auto y = const_cast<BinaryExprAST*>(static_cast<BinaryExprAST const*>(b));
+      return x->getOp() == y->getOp() && &x->getLHS() == &y->getLHS() && &x->getRHS() == &y->getRHS();
+    }
+    case ExprKind::Call: {
+      auto x = static_cast<CallExprAST const*>(a);
+      auto y = static_cast<CallExprAST const*>(b);
+      return x->getCallee() == y->getCallee() && x->getArgs().size() == y->getArgs().size() &&
+             std::equal(x->getArgs().begin(), x->getArgs().end(), y->getArgs().begin());
+    }
+    case ExprKind::Index: {
+      auto x = const_cast<IndexExprAST*>(static_cast<IndexExprAST const*>(a));
+      auto y = const_cast<IndexExprAST*>(static_cast<IndexExprAST const*>(b));
+      return &x->getArray() == &y->getArray() && &x->getIndex() == &y->getIndex();
+    }
+    default:
+      return a == b;
+  }
+}
+
+#endif
@@ -0,0 +1,136 @@
+#ifndef K_VISITOR_HASHER_H_
+#define K_VISITOR_HASHER_H_
+
+#include <cstdint>
+#include <string>
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/MD5.h"
+
+#include "visitor/Visit.h"
+#include "AST.h"
+
+/// Computes a digest of a tree that is stable across runs, i.e. two trees
+/// have the same digest iff they were parsed from equivalent source.
+class Hasher {
+private:
+  llvm::MD5 md5;
+
+  void update(std::uint8_t tag) { md5.update(llvm::ArrayRef<std::uint8_t>(tag)); }
+  void update(std::uint64_t value) {
+    md5.update(llvm::ArrayRef<std::uint8_t>(reinterpret_cast<std::uint8_t const*>(&value), sizeof(value)));
+  }
+  void update(double value) {
+    md5.update(llvm::ArrayRef<std::uint8_t>(reinterpret_cast<std::uint8_t const*>(&value), sizeof(value)));
+  }
+  void update(Symbol symbol) {
+    // Length-prefixed, such that (ab, c) and (a, bc) differ
+    update(static_cast<std::uint64_t>(symbol.str().size()));
+    md5.update(llvm::StringRef(symbol.str().data(), symbol.str().size()));
+  }
+  void update(ExprKind kind) { update(static_cast<std::uint8_t>(kind)); }
+
+public:
+  /// Adds arbitrary data such as compiler options to the digest.
+  void addString(llvm::StringRef str) {
+    update(static_cast<std::uint64_t>(str.size()));
+    md5.update(str);
+  }
+
+  /// Finishes hashing; the hasher must not be used afterwards.
+  std::string digest() {
+    llvm::MD5::MD5Result result;
+    md5.final(result);
+    llvm::SmallString<32> hex;
+    llvm::MD5::stringifyResult(result, hex);
+    return hex.str().str();
+  }
+
+  void operator()(ExprAST&) {}
+
+  void operator()(NumberExprAST& node) {
+    update(node.getKind());
+    update(node.getNumber());
+    update(static_cast<std::uint8_t>(node.isLiteral()));
+  }
+  void operator()(VariableExprAST& node) {
+    update(node.getKind());
+    update(node.getName());
+  }
+  void operator()(BinaryExprAST& node) {
+    update(node.getKind());
+    update(static_cast<std::uint8_t>(node.getOp()));
+    ast::visit(*this, node.getLHS());
+    ast::visit(*this, node.getRHS());
+  }
+  void operator()(CallExprAST& node) {
+    update(node.getKind());
+    update(node.getCallee());
+    update(static_cast<std::uint64_t>(node.getArgs().size()));
+    for (auto arg : node.getArgs()) {
+      ast::visit(*this, *arg);
+    }
+  }
+  void operator()(IndexExprAST& node) {
+    update(node.getKind());
+    ast::visit(*this, node.getArray());
+    ast::visit(*this, node.getIndex());
+  }
+  void operator()(IfExprAST& node) {
+    update(node.getKind());
+    ast::visit(*this, node.getCond());
+    ast::visit(*this, node.getThen());
+    ast::visit(*this, node.getElse());
+  }
+  void operator()(ForExprAST& node) {
+    update(node.getKind());
+    update(node.getVarName());
+    ast::visit(*this, node.getStart());
+    ast::visit(*this, node.getEnd());
+    update(static_cast<std::uint8_t>(node.getStep().has_value()));
+    if (node.getStep()) {
+      ast::visit(*this, node.getStep()->get());
+    }
+    ast::visit(*this, node.getBody());
+  }
+  void operator()(ParForExprAST& node) {
+    update(node.getKind());
+    update(node.getVarName());
+    update(static_cast<std::uint8_t>(node.getReduction()));
+    ast::visit(*this, node.getStart());
+    ast::visit(*this, node.getEnd());
+    ast::visit(*this, node.getBody());
+  }
+  void operator()(VarExprAST& node) {
+    update(node.getKind());
+    update(static_cast<std::uint64_t>(node.getVarNames().size()));
+    for (std::size_t i = 0; i < node.getVarNames().size(); ++i) {
+      auto& entry = node.getVarNames()[i];
+      update(entry.first);
+      auto type = node.getVarType(i);
+      update(static_cast<std::uint8_t>(type ? static_cast<int>(*type) + 1 : 0));
+      update(static_cast<std::uint8_t>(entry.second != nullptr));
+      if (entry.second) {
+        ast::visit(*this, *entry.second);
+      }
+    }
+    ast::visit(*this, node.getBody());
+  }
+  void operator()(PrototypeAST& node) {
+    update(node.getName());
+    update(static_cast<std::uint64_t>(node.getArgs().size()));
+    for (std::size_t i = 0; i < node.getArgs().size(); ++i) {
+      update(node.getArgs()[i]);
+      update(static_cast<std::uint8_t>(node.getArgType(i)));
+    }
+    update(static_cast<std::uint8_t>(node.getReturnType()));
+  }
+  void operator()(FunctionAST& node) {
+    ast::visit(*this, node.getPrototype());
+    ast::visit(*this, node.getBody());
+  }
+};
+
+#endif
@@ -0,0 +1,346 @@
+#ifndef K_VISITOR_INTERPRETER_H_
+#define K_VISITOR_INTERPRETER_H_
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "visitor/Visit.h"
+#include "AST.h"
+#include "Builtins.h"
+
+/// Native code entry point taking the arguments as an array.
+using NativeFunction = double (*)(double const*);
+
+struct TieredFunction {
+  FunctionAST* ast;   // nullptr for externs
+  std::size_t arity;
+  bool scalar = true; // false if any argument or the result is not a double
+  unsigned long calls = 0;
+  NativeFunction native = nullptr;
+};
+
+/// Tree-walking interpreter (tier 0). Every interpreted call counts towards
+/// the callee's threshold; once exceeded, the callee is compiled and all
+/// further calls go to native code. Only doubles are supported, see
+/// canInterpret.
+class Interpreter {
+private:
+  // Finds values other than doubles, i.e. indexing, array builtins, calls
+  // of functions taking or returning other types and annotated variables.
+  // Comparisons yield bools in compiled code, but as they convert to 0 and 1
+  // the interpreter may treat them as doubles.
+  class TypeFinder {
+  private:
+    std::unordered_map<Symbol, TieredFunction> const& functions;
+
+  public:
+    bool found = false;
+
+    explicit TypeFinder(std::unordered_map<Symbol, TieredFunction> const& functions)
+      : functions(functions) {}
+
+    void operator()(ExprAST&) {}
+    void operator()(NumberExprAST&) {}
+    void operator()(VariableExprAST&) {}
+    void operator()(BinaryExprAST& node) {
+      ast::visit(*this, node.getLHS());
+      ast::visit(*this, node.getRHS());
+    }
+    void operator()(CallExprAST& node) {
+      auto fn = functions.find(node.getCallee());
+      auto builtin = findBuiltin(node.getCallee().str());
+      if (fn != functions.end() ? !fn->second.scalar : builtin && isArrayBuiltin(builtin->builtin)) {
+        found = true;
+      }
+      for (auto arg : node.getArgs()) {
+        ast::visit(*this, *arg);
+      }
+    }
+    void operator()(IndexExprAST&) { found = true; }
+    void operator()(IfExprAST& node) {
+      ast::visit(*this, node.getCond());
+      ast::visit(*this, node.getThen());
+      ast::visit(*this, node.getElse());
+    }
+    void operator()(ForExprAST& node) {
+      ast::visit(*this, node.getStart());
+      ast::visit(*this, node.getEnd());
+      if (node.getStep()) {
+        ast::visit(*this, node.getStep()->get());
+      }
+      ast::visit(*this, node.getBody());
+    }
+    void operator()(ParForExprAST& node) {
+      ast::visit(*this, node.getStart());
+      ast::visit(*this, node.getEnd());
+      ast::visit(*this, node.getBody());
+    }
+    void operator()(VarExprAST& node) {
+      for (std::size_t i = 0; i < node.getVarNames().size(); ++i) {
+        auto type = node.getVarType(i);
+        if (type && *type != ValueType::Double) {
+          found = true;
+        }
+        if (auto init = node.getVarNames()[i].second) {
+          ast::visit(*this, *init);
+        }
+      }
+      ast::visit(*this, node.getBody());
+    }
+  };
+
+  std::unordered_map<Symbol, TieredFunction>& functions;
+  std::function<NativeFunction(Symbol)> compile;
+  unsigned long threshold;
+
+  // Variables of all active frames; a frame starts at frameBase
+  std::vector<std::pair<Symbol, double>> variables;
+  std::size_t frameBase = 0;
+  std::vector<double> args;
+  bool failed = false;
+
+  double logError(char const* str) {
+    std::cerr << "Error: " << str << std::endl;
+    failed = true;
+    return 0.0;
+  }
+
+  double* lookup(Symbol name) {
+    for (std::size_t i = variables.size(); i > frameBase; --i) {
+      if (variables[i-1].first == name) {
+        return &variables[i-1].second;
+      }
+    }
+    return nullptr;
+  }
+
+  // Matches the FCmpONE against 0.0 emitted by CodeGen
+  static bool isTrue(double value) {
+    return value < 0.0 || value > 0.0;
+  }
+
+  // Callees without definition or extern
+  double callBuiltin(CallExprAST& node) {
+    auto builtin = findBuiltin(node.getCallee().str());
+    if (!builtin) {
+      return logError("Unknown function referenced");
+    }
+    if (isArrayBuiltin(builtin->builtin)) {
+      return logError("Only doubles are supported by the interpreter");
+    }
+    if (builtin->arity != node.getArgs().size()) {
+      return logError("Incorrect number of arguments passed");
+    }
+    std::size_t first = args.size();
+    for (auto arg : node.getArgs()) {
+      double value = ast::visit(*this, *arg);
+      args.push_back(value);
+    }
+    double result = evaluateBuiltin(builtin->builtin, args.data() + first);
+    args.resize(first);
+    return result;
+  }
+
+public:
+  Interpreter(std::unordered_map<Symbol, TieredFunction>& functions,
+              std::function<NativeFunction(Symbol)> compile,
+              unsigned long threshold)
+    : functions(functions), compile(std::move(compile)), threshold(threshold) {}
+
+  void setThreshold(unsigned long calls) { threshold = calls; }
+
+  /// Whether node only uses doubles; functions that do not must be compiled.
+  bool canInterpret(FunctionAST& node) const {
+    if (!node.getPrototype().isScalar()) {
+      return false;
+    }
+    TypeFinder finder(functions);
+    ast::visit(finder, node.getBody());
+    return !finder.found;
+  }
+
+  /// Evaluates the body of an anonymous function. Returns false on error.
+  bool evaluate(FunctionAST& node, double& result) {
+    failed = false;
+    variables.clear();
+    frameBase = 0;
+    args.clear();
+    result = ast::visit(*this, node.getBody());
+    return !failed;
+  }
+
+  double operator()(ExprAST&) { return 0.0; }
+
+  double operator()(NumberExprAST& node) {
+    return node.getNumber();
+  }
+
+  double operator()(VariableExprAST& node) {
+    double* v = lookup(node.getName());
+    if (!v) {
+      return logError("Unknown variable name");
+    }
+    return *v;
+  }
+
+  double operator()(BinaryExprAST& node) {
+    if (node.getOp() == '=') {
+      if (node.getLHS().getKind() != ExprKind::Variable) {
+        return logError("destination of '=' must be a variable");
+      }
+      auto lhsE = static_cast<VariableExprAST*>(&node.getLHS());
+      double rhs = ast::visit(*this, node.getRHS());
+      double* variable = lookup(lhsE->getName());
+      if (!variable) {
+        return logError("Unknown variable name");
+      }
+      *variable = rhs;
+      return rhs;
+    }
+
+    double lhs = ast::visit(*this, node.getLHS());
+    double rhs = ast::visit(*this, node.getRHS());
+
+    switch (node.getOp()) {
+      case '+':
+        return lhs + rhs;
+      case '-':
+        return lhs - rhs;
+      case '*':
+        return lhs * rhs;
+      case '<':
+        // unordered or less than
+        return !(lhs >= rhs) ? 1.0 : 0.0;
+      default:
+        return logError("Unknown operator");
+    }
+  }
+
+  double operator()(CallExprAST& node) {
+    auto it = functions.find(node.getCallee());
+    if (it == functions.end()) {
+      return callBuiltin(node);
+    }
+    TieredFunction& fn = it->second;
+    if (fn.arity != node.getArgs().size()) {
+      return logError("Incorrect number of arguments passed");
+    }
+    if (!fn.scalar) {
+      return logError("Only doubles are supported by the interpreter");
+    }
+
+    std::size_t first = args.size();
+    for (auto arg : node.getArgs()) {
+      double value = ast::visit(*this, *arg);
+      args.push_back(value);
+    }
+
+    if (!fn.native && (!fn.ast || ++fn.calls > threshold)) {
+      fn.native = compile(node.getCallee());
+      if (!fn.native) {
+        // Retry after another round of calls only
+        fn.calls = 0;
+      }
+    }
+
+    double result = 0.0;
+    if (fn.native) {
+      result = fn.native(args.data() + first);
+    } else if (!fn.ast) {
+      result = logError("Could not resolve extern");
+    } else {
+      std::size_t oldFrameBase = frameBase;
+      frameBase = variables.size();
+      auto params = fn.ast->getPrototype().getArgs();
+      for (std::size_t i = 0; i < params.size(); ++i) {
+        variables.emplace_back(params[i], args[first + i]);
+      }
+      result = ast::visit(*this, fn.ast->getBody());
+      variables.resize(frameBase);
+      frameBase = oldFrameBase;
+    }
+    args.resize(first);
+    return result;
+  }
+
+  double operator()(IndexExprAST&) {
+    return logError("Only doubles are supported by the interpreter");
+  }
+
+  double operator()(IfExprAST& node) {
+    if (isTrue(ast::visit(*this, node.getCond()))) {
+      return ast::visit(*this, node.getThen());
+    }
+    return ast::visit(*this, node.getElse());
+  }
+
+  double operator()(ForExprAST& node) {
+    double start = ast::visit(*this, node.getStart());
+    std::size_t slot = variables.size();
+    variables.emplace_back(node.getVarName(), start);
+
+    // Same order of evaluation as the loop emitted by CodeGen
+    while (!failed) {
+      ast::visit(*this, node.getBody());
+      double step = node.getStep() ? ast::visit(*this, node.getStep()->get()) : 1.0;
+      double end = ast::visit(*this, node.getEnd());
+      variables[slot].second += step;
+      if (!isTrue(end)) {
+        break;
+      }
+    }
+
+    variables.resize(slot);
+    return 0.0;
+  }
+
+  double operator()(ParForExprAST& node) {
+    double start = ast::visit(*this, node.getStart());
+    double end = ast::visit(*this, node.getEnd());
+    double iterations = std::ceil(end - start);
+    std::int64_t count = iterations > 0.0 ? static_cast<std::int64_t>(iterations) : 0;
+
+    // Same chunking as the parallel runtime, such that both tiers round alike
+    Reduction reduction = node.getReduction();
+    std::int64_t chunkSize = getChunkSize(count);
+    std::vector<std::pair<Symbol, double>> captured(variables.begin() + frameBase, variables.end());
+    double result = getIdentity(reduction);
+    for (std::int64_t begin = 0; begin < count && !failed; begin += chunkSize) {
+      double partial = getIdentity(reduction);
+      for (std::int64_t k = begin; k < std::min(begin + chunkSize, count) && !failed; ++k) {
+        std::copy(captured.begin(), captured.end(), variables.begin() + frameBase);
+        variables.emplace_back(node.getVarName(), start + static_cast<double>(k));
+        partial = combine(reduction, partial, ast::visit(*this, node.getBody()));
+        variables.pop_back();
+      }
+      result = combine(reduction, result, partial);
+    }
+    std::copy(captured.begin(), captured.end(), variables.begin() + frameBase);
+    return result;
+  }
+
+  double operator()(VarExprAST& node) {
+    std::size_t first = variables.size();
+    for (auto& entry : node.getVarNames()) {
+      double init = entry.second ? ast::visit(*this, *entry.second) : 0.0;
+      variables.emplace_back(entry.first, init);
+    }
+
+    double body = ast::visit(*this, node.getBody());
+    variables.resize(first);
+    return body;
+  }
+
+  double operator()(PrototypeAST&) { return 0.0; }
+  double operator()(FunctionAST& node) {
+    return ast::visit(*this, node.getBody());
+  }
+};
+
+#endif
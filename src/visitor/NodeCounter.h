@@ -0,0 +1,70 @@
+#ifndef K_VISITOR_NODECOUNTER_H_
+#define K_VISITOR_NODECOUNTER_H_
+
+#include <cstddef>
+
+#include "visitor/Visit.h"
+#include "AST.h"
+
+/// Counts the expression nodes of a tree.
+class NodeCounter {
+private:
+  std::size_t count = 0;
+
+public:
+  std::size_t getCount() const { return count; }
+
+  void operator()(ExprAST&) { ++count; }
+  void operator()(BinaryExprAST& node) {
+    ++count;
+    ast::visit(*this, node.getLHS());
+    ast::visit(*this, node.getRHS());
+  }
+  void operator()(CallExprAST& node) {
+    ++count;
+    for (auto arg : node.getArgs()) {
+      ast::visit(*this, *arg);
+    }
+  }
+  void operator()(IndexExprAST& node) {
+    ++count;
+    ast::visit(*this, node.getArray());
+    ast::visit(*this, node.getIndex());
+  }
+  void operator()(IfExprAST& node) {
+    ++count;
+    ast::visit(*this, node.getCond());
+    ast::visit(*this, node.getThen());
+    ast::visit(*this, node.getElse());
+  }
+  void operator()(ForExprAST& node) {
+    ++count;
+    ast::visit(*this, node.getStart());
+    ast::visit(*this, node.getEnd());
+    if (node.getStep()) {
+      ast::visit(*this, node.getStep()->get());
+    }
+    ast::visit(*this, node.getBody());
+  }
+  void operator()(ParForExprAST& node) {
+    ++count;
+    ast::visit(*this, node.getStart());
+    ast::visit(*this, node.getEnd());
+    ast::visit(*this, node.getBody());
+  }
+  void operator()(VarExprAST& node) {
+    ++count;
+    for (auto& entry : node.getVarNames()) {
+      if (entry.second) {
+        ast::visit(*this, *entry.second);
+      }
+    }
+    ast::visit(*this, node.getBody());
+  }
+  void operator()(PrototypeAST&) {}
+  void operator()(FunctionAST& node) {
+    ast::visit(*this, node.getBody());
+  }
+};
+
+#endif
@@ -3,8 +3,9 @@
 
 #include <iostream>
 #include <sstream>
+#include <string>
 
-#include <md/visit.hpp>
+#include "visitor/Visit.h"
 #include "AST.h"
 
 class PrettyPrinter {
@@ -31,30 +32,37 @@ public:
   void operator()(BinaryExprAST& node) {
     print(node.getOp());
     ++level;
-    md::visit(*this, node.getLHS());
-    md::visit(*this, node.getRHS());
+    ast::visit(*this, node.getLHS());
+    ast::visit(*this, node.getRHS());
     --level;
   }
   void operator()(CallExprAST& node) {
-    print("call " + node.getCallee());
+    print("call " + node.getCallee().string());
     ++level;
     for (auto& arg : node.getArgs()) {
-      md::visit(*this, *arg);
+      ast::visit(*this, *arg);
     }
     --level;
   }
+  void operator()(IndexExprAST& node) {
+    print("index");
+    ++level;
+    ast::visit(*this, node.getArray());
+    ast::visit(*this, node.getIndex());
+    --level;
+  }
   void operator()(IfExprAST& node) {
     print("if");
     ++level;
-    md::visit(*this, node.getCond());
+    ast::visit(*this, node.getCond());
     --level;
     print("then");
     ++level;
-    md::visit(*this, node.getThen());
+    ast::visit(*this, node.getThen());
     --level;
     print("else");
     ++level;
-    md::visit(*this, node.getElse());
+    ast::visit(*this, node.getElse());
     --level;
   }
   void operator()(ForExprAST& node) {
@@ -62,22 +70,40 @@ public:
     ++level;
     print("start");
     ++level;
-    md::visit(*this, node.getStart());
+    ast::visit(*this, node.getStart());
     --level;
     print("end");
     ++level;
-    md::visit(*this, node.getEnd());
+    ast::visit(*this, node.getEnd());
     --level;
     if (node.getStep()) {
       print("step");
       ++level;
-      md::visit(*this, node.getStep()->get());
+      ast::visit(*this, node.getStep()->get());
       --level;
     }
     --level;
     print("in");
     ++level;
-    md::visit(*this, node.getBody());
+    ast::visit(*this, node.getBody());
+    --level;
+  }
+  void operator()(ParForExprAST& node) {
+    static char const* reductions[] = {"+", "*", "min", "max"};
+    print(std::string("parfor reduce ") + reductions[static_cast<int>(node.getReduction())]);
+    ++level;
+    print("start");
+    ++level;
+    ast::visit(*this, node.getStart());
+    --level;
+    print("end");
+    ++level;
+    ast::visit(*this, node.getEnd());
+    --level;
+    --level;
+    print("in");
+    ++level;
+    ast::visit(*this, node.getBody());
     --level;
   }
   void operator()(VarExprAST& node) {
@@ -86,16 +112,16 @@ public:
   void operator()(PrototypeAST& node) {
     std::stringstream ss;
     ss << "def " << node.getName() << " ( ";
-    for (auto& child : node.getArgs()) {
-      ss << child << " ";
+    for (std::size_t i = 0; i < node.getArgs().size(); ++i) {
+      ss << node.getArgs()[i] << ":" << getTypeName(node.getArgType(i)) << " ";
     }
-    ss << ")";
+    ss << "): " << getTypeName(node.getReturnType());
     print(ss.str());
   }
   void operator()(FunctionAST& node) {
-    md::visit(*this, node.getPrototype());
+    ast::visit(*this, node.getPrototype());
     ++level;
-    md::visit(*this, node.getBody());
+    ast::visit(*this, node.getBody());
     --level;
   }
 };
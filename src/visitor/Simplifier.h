@@ -0,0 +1,212 @@
+#ifndef K_VISITOR_SIMPLIFIER_H_
+#define K_VISITOR_SIMPLIFIER_H_
+
+#include <cmath>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "visitor/AssignmentCollector.h"
+#include "visitor/Visit.h"
+#include "Arena.h"
+#include "AST.h"
+
+/// Simplifies a tree in place before code generation:
+///  - binary operators with constant operands are evaluated,
+///  - x*1, 1*x, x-0 and x+(-0) become x,
+///  - ifs with a constant condition are replaced by the taken branch,
+///  - var bindings of constants that are never assigned are substituted.
+/// Every rewrite is exact in IEEE arithmetic, i.e. the result matches the
+/// unfolded code bit for bit. Hence x+0 is kept, as it turns -0 into +0, and
+/// numbers that replace other nodes are not literals, which CodeGen would
+/// convert to the type of an i64 or f32 operand.
+/// Each operator() returns the node that replaces the visited one; new nodes
+/// are allocated from the arena of the tree.
+class Simplifier {
+private:
+  Arena& arena;
+  // Variables that must not be substituted, as they are assigned somewhere
+  std::unordered_set<Symbol> assigned;
+  // Variables in scope; the value is nullptr unless the variable is constant
+  std::vector<std::pair<Symbol, NumberExprAST*>> scope;
+
+  static NumberExprAST* asNumber(ExprAST* node) {
+    return node->getKind() == ExprKind::Number ? static_cast<NumberExprAST*>(node) : nullptr;
+  }
+
+  static bool isNumber(ExprAST* node, double value) {
+    auto number = asNumber(node);
+    // Compares the bits, as -0 == 0
+    return number && std::signbit(number->getNumber()) == std::signbit(value) &&
+           number->getNumber() == value;
+  }
+
+  NumberExprAST* makeNumber(double value) {
+    return arena.make<NumberExprAST>(value, false);
+  }
+
+  // A literal standing in for another node, e.g. the taken branch of an if
+  ExprAST* replacement(ExprAST* node) {
+    auto number = asNumber(node);
+    return number && number->isLiteral() ? makeNumber(number->getNumber()) : node;
+  }
+
+  // Matches the FCmpONE against 0.0 emitted by CodeGen
+  static bool isTrue(double value) {
+    return value < 0.0 || value > 0.0;
+  }
+
+public:
+  explicit Simplifier(Arena& arena)
+    : arena(arena) {}
+
+  ExprAST* operator()(ExprAST& node) { return &node; }
+
+  ExprAST* operator()(NumberExprAST& node) { return &node; }
+
+  ExprAST* operator()(VariableExprAST& node) {
+    for (auto it = scope.rbegin(); it != scope.rend(); ++it) {
+      if (it->first == node.getName()) {
+        return it->second ? makeNumber(it->second->getNumber()) : static_cast<ExprAST*>(&node);
+      }
+    }
+    return &node;
+  }
+
+  ExprAST* operator()(BinaryExprAST& node) {
+    if (node.getOp() != '=' || node.getLHS().getKind() == ExprKind::Index) {
+      node.setLHS(ast::visit(*this, node.getLHS()));
+    }
+    node.setRHS(ast::visit(*this, node.getRHS()));
+
+    ExprAST* lhs = &node.getLHS();
+    ExprAST* rhs = &node.getRHS();
+    auto l = asNumber(lhs);
+    auto r = asNumber(rhs);
+    if (l && r) {
+      double a = l->getNumber(), b = r->getNumber();
+      switch (node.getOp()) {
+        case '+': return makeNumber(a + b);
+        case '-': return makeNumber(a - b);
+        case '*': return makeNumber(a * b);
+        case '<': return makeNumber(!(a >= b) ? 1.0 : 0.0);
+        default: break;
+      }
+    }
+    switch (node.getOp()) {
+      case '+':
+        if (isNumber(rhs, -0.0)) {
+          return lhs;
+        }
+        if (isNumber(lhs, -0.0)) {
+          return rhs;
+        }
+        break;
+      case '-':
+        if (isNumber(rhs, 0.0)) {
+          return lhs;
+        }
+        break;
+      case '*':
+        if (isNumber(rhs, 1.0)) {
+          return lhs;
+        }
+        if (isNumber(lhs, 1.0)) {
+          return rhs;
+        }
+        break;
+      default:
+        break;
+    }
+    return &node;
+  }
+
+  ExprAST* operator()(CallExprAST& node) {
+    for (auto& arg : node.getArgs()) {
+      arg = ast::visit(*this, *arg);
+    }
+    return &node;
+  }
+
+  ExprAST* operator()(IndexExprAST& node) {
+    node.setArray(ast::visit(*this, node.getArray()));
+    node.setIndex(ast::visit(*this, node.getIndex()));
+    return &node;
+  }
+
+  ExprAST* operator()(IfExprAST& node) {
+    node.setCond(ast::visit(*this, node.getCond()));
+    if (auto cond = asNumber(&node.getCond())) {
+      return replacement(ast::visit(*this, isTrue(cond->getNumber()) ? node.getThen() : node.getElse()));
+    }
+    node.setThen(ast::visit(*this, node.getThen()));
+    node.setElse(ast::visit(*this, node.getElse()));
+    return &node;
+  }
+
+  ExprAST* operator()(ForExprAST& node) {
+    node.setStart(ast::visit(*this, node.getStart()));
+    // The loop variable changes in every iteration
+    scope.emplace_back(node.getVarName(), nullptr);
+    node.setEnd(ast::visit(*this, node.getEnd()));
+    if (node.getStep()) {
+      node.setStep(ast::visit(*this, node.getStep()->get()));
+    }
+    node.setBody(ast::visit(*this, node.getBody()));
+    scope.pop_back();
+    return &node;
+  }
+
+  ExprAST* operator()(ParForExprAST& node) {
+    node.setStart(ast::visit(*this, node.getStart()));
+    node.setEnd(ast::visit(*this, node.getEnd()));
+    scope.emplace_back(node.getVarName(), nullptr);
+    node.setBody(ast::visit(*this, node.getBody()));
+    scope.pop_back();
+    return &node;
+  }
+
+  ExprAST* operator()(VarExprAST& node) {
+    // Inits see the bindings before them, see CodeGen
+    std::size_t scopeSize = scope.size();
+    std::vector<std::pair<Symbol, ExprAST*>> kept;
+    for (auto& entry : node.getVarNames()) {
+      NumberExprAST* value = nullptr;
+      if (entry.second) {
+        entry.second = ast::visit(*this, *entry.second);
+        value = asNumber(entry.second);
+      } else {
+        value = makeNumber(0.0);
+      }
+      // Annotated variables convert their values
+      if (value && assigned.count(entry.first) == 0 && !node.hasVarTypes()) {
+        scope.emplace_back(entry.first, value);
+      } else {
+        scope.emplace_back(entry.first, nullptr);
+        kept.push_back(entry);
+      }
+    }
+    ExprAST* body = ast::visit(*this, node.getBody());
+    scope.resize(scopeSize);
+
+    if (kept.empty()) {
+      return replacement(body);
+    }
+    node.setBody(body);
+    if (kept.size() != node.getVarNames().size()) {
+      node.setVarNames(arena.copy(kept.data(), kept.size()));
+    }
+    return &node;
+  }
+
+  void operator()(PrototypeAST&) {}
+
+  void operator()(FunctionAST& node) {
+    assigned.clear();
+    scope.clear();
+    ast::visit(AssignmentCollector(assigned), node.getBody());
+    node.setBody(ast::visit(*this, node.getBody()));
+  }
+};
+
+#endif
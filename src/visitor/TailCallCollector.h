@@ -0,0 +1,29 @@
+#ifndef K_VISITOR_TAILCALLCOLLECTOR_H_
+#define K_VISITOR_TAILCALLCOLLECTOR_H_
+
+#include <unordered_set>
+
+#include "visitor/Visit.h"
+#include "AST.h"
+
+/// Collects the calls in tail position of a function body, i.e. calls whose
+/// result is the result of the function. Branches of if and bodies of var
+/// are in tail position if the expression itself is.
+class TailCallCollector {
+private:
+  std::unordered_set<CallExprAST const*>& tailCalls;
+
+public:
+  explicit TailCallCollector(std::unordered_set<CallExprAST const*>& tailCalls)
+    : tailCalls(tailCalls) {}
+
+  void operator()(ExprAST&) {}
+  void operator()(CallExprAST& node) { tailCalls.insert(&node); }
+  void operator()(IfExprAST& node) {
+    ast::visit(*this, node.getThen());
+    ast::visit(*this, node.getElse());
+  }
+  void operator()(VarExprAST& node) { ast::visit(*this, node.getBody()); }
+};
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef K_VISITOR_VISIT_H_
+#define K_VISITOR_VISIT_H_
+
+#include <type_traits>
+#include <utility>
+
+#include "AST.h"
+
+namespace ast {
+
+template<typename Visitor>
+using expr_result_t = std::common_type_t<
+  decltype(std::declval<Visitor&>()(std::declval<NumberExprAST&>())),
+  decltype(std::declval<Visitor&>()(std::declval<VariableExprAST&>())),
+  decltype(std::declval<Visitor&>()(std::declval<BinaryExprAST&>())),
+  decltype(std::declval<Visitor&>()(std::declval<CallExprAST&>())),
+  decltype(std::declval<Visitor&>()(std::declval<IndexExprAST&>())),
+  decltype(std::declval<Visitor&>()(std::declval<IfExprAST&>())),
+  decltype(std::declval<Visitor&>()(std::declval<ForExprAST&>())),
+  decltype(std::declval<Visitor&>()(std::declval<ParForExprAST&>())),
+  decltype(std::declval<Visitor&>()(std::declval<VarExprAST&>()))>;
+
+/// Drop-in replacement for md::visit with a single AST node. Dispatches with
+/// a switch over ExprAST::getKind(), hence the call is resolved at compile
+/// time and the visitor's overloads can be inlined.
+template<typename Visitor>
+expr_result_t<Visitor> visit(Visitor&& visitor, ExprAST& node) {
+  switch (node.getKind()) {
+    case ExprKind::Number:
+      return visitor(static_cast<NumberExprAST&>(node));
+    case ExprKind::Variable:
+      return visitor(static_cast<VariableExprAST&>(node));
+    case ExprKind::Binary:
+      return visitor(static_cast<BinaryExprAST&>(node));
+    case ExprKind::Call:
+      return visitor(static_cast<CallExprAST&>(node));
+    case ExprKind::Index:
+      return visitor(static_cast<IndexExprAST&>(node));
+    case ExprKind::If:
+      return visitor(static_cast<IfExprAST&>(node));
+    case ExprKind::For:
+      return visitor(static_cast<ForExprAST&>(node));
+    case ExprKind::ParFor:
+      return visitor(static_cast<ParForExprAST&>(node));
+    case ExprKind::Var:
+      return visitor(static_cast<VarExprAST&>(node));
+  }
+  return visitor(node);
+}
+
+template<typename Visitor>
+decltype(auto) visit(Visitor&& visitor, PrototypeAST& node) {
+  return visitor(node);
+}
+
+template<typename Visitor>
+decltype(auto) visit(Visitor&& visitor, FunctionAST& node) {
+  return visitor(node);
+}
+
+}
+
+#endif